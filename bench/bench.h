@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+// Minimal microbenchmark runner: each benchmark runs in batches doubling their size until a
+// batch takes the minimum time, and reports the time per operation of that batch.
+namespace thinger::monitor::bench {
+
+    // Keeps the compiler from optimizing away a value nobody reads
+    template <typename T>
+    inline void keep(T const& value) {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    struct result {
+        std::string name;
+        unsigned long long iterations = 0;
+        double ns_per_op = 0;
+        double bytes_per_op = 0; // processed by each operation, 0 when it does not apply
+    };
+
+    class runner {
+
+    public:
+
+        using function = std::function<void()>;
+
+        void add(std::string name, function f, double bytes_per_op = 0) {
+            benchmarks_.push_back({std::move(name), std::move(f), bytes_per_op});
+        }
+
+        // Runs the benchmarks whose name contains the filter
+        std::vector<result> run(std::string const& filter, std::chrono::nanoseconds min_time) const {
+            std::vector<result> results;
+            for (auto const& b : benchmarks_) {
+                if ( b.name.find(filter) == std::string::npos ) continue;
+
+                b.f(); // warm up caches and reused buffers
+
+                unsigned long long batch = 1;
+                std::chrono::nanoseconds elapsed{};
+                for (;;) {
+                    auto start = std::chrono::steady_clock::now();
+                    for (unsigned long long i = 0; i < batch; i++) b.f();
+                    elapsed = std::chrono::steady_clock::now() - start;
+                    if ( elapsed >= min_time || batch >= (1ULL << 40) ) break;
+                    batch *= 2;
+                }
+
+                results.push_back({b.name, batch, (double)elapsed.count() / (double)batch, b.bytes_per_op});
+            }
+            return results;
+        }
+
+    private:
+
+        struct benchmark {
+            std::string name;
+            function f;
+            double bytes_per_op;
+        };
+
+        std::vector<benchmark> benchmarks_;
+
+    };
+
+    inline nlohmann::json to_json(std::vector<result> const& results) {
+        nlohmann::json j = nlohmann::json::array();
+        for (auto const& r : results) {
+            nlohmann::json b = {
+                {"name", r.name},
+                {"iterations", r.iterations},
+                {"ns_per_op", r.ns_per_op},
+            };
+            if ( r.bytes_per_op > 0 )
+                b["mb_per_s"] = r.bytes_per_op / r.ns_per_op * 1e9 / (1024 * 1024);
+            j.push_back(std::move(b));
+        }
+        return j;
+    }
+
+}
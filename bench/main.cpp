@@ -0,0 +1,357 @@
+// Microbenchmarks of the collectors, the monitor resource, hashing and signing, archiving, and
+// S3 uploads and downloads with a local stand-in, over the fixture hosts in test/fixtures.
+// Results are printed as json to compare revisions:
+//
+//   thinger_monitor_bench [--filter <name>] [--min-time <ms>] [--out <file>]
+
+#if OPEN_SSL
+  #define CPPHTTPLIB_OPENSSL_SUPPORT
+#endif
+
+#include <thinger/thinger.h>
+#include "../src/thinger/client.h"
+
+#include <boost/program_options.hpp>
+
+#include <fstream>
+#include <iostream>
+
+#include "bench.h"
+
+#ifndef FIXTURES_DIR
+  #define FIXTURES_DIR "../test/fixtures"
+#endif
+
+namespace thinger::monitor::bench {
+
+    // Exposes the sampler to drive it from the benchmarks
+    class client : public Client {
+    public:
+        using Client::Client;
+        using Client::sample;
+    };
+
+    // Records a fixture tree into a capture, so a client can be built in replay mode without
+    // touching the host or the network
+    inline void snapshot(std::filesystem::path const& root, std::string const& capture_path) {
+        capture::recorder recorder(capture_path);
+        capture::snapshot(root, recorder);
+
+        // capacity, free and available bytes of the root filesystem
+        recorder.write("@space:/", true, "1000000000000 400000000000 350000000000");
+    }
+
+    inline std::uintmax_t tree_size(std::filesystem::path const& root) {
+        std::uintmax_t size = 0;
+        for (auto const& entry : std::filesystem::recursive_directory_iterator(root))
+            if ( entry.is_regular_file() ) size += entry.file_size();
+        return size;
+    }
+
+    // Collectors reading the fixture files through the source layer, one op per collector call
+    std::vector<result> collectors(std::string const& fixtures, std::string const& filter, std::chrono::nanoseconds min_time) {
+
+        source::set_root(fixtures + "/large");
+
+        runner r;
+
+        memory::stats memory;
+        std::string memory_buffer;
+        r.add("collector/memory", [&] { memory::retrieve(memory, memory_buffer); keep(memory); });
+
+        std::string numa_buffer;
+        auto nodes = numa::discover(numa_buffer);
+        r.add("collector/numa", [&] { numa::retrieve(nodes, numa_buffer); numa::update(nodes, rates::now()); keep(nodes); });
+
+        sensors::collector sensors;
+        sensors.discover();
+        r.add("collector/sensors", [&] { sensors.read(rates::now()); keep(sensors); });
+
+        std::vector<io::drive> drives;
+        std::vector<std::string> names;
+        source::list("/sys/block", names);
+        for (auto const& name : names)
+            drives.emplace_back().name = name;
+        r.add("collector/io", [&] { io::retrieve_dv_stats(drives); keep(drives); });
+
+        std::vector<network::interface> interfaces(2);
+        interfaces[0].name = "ens0f0";
+        interfaces[1].name = "ens7f1";
+        r.add("collector/network", [&] { network::retrieve_ifc_stats(interfaces); keep(interfaces); });
+
+        std::vector<storage::filesystem> filesystems(1);
+        filesystems[0].path = "/";
+        r.add("collector/storage", [&] { storage::retrieve_fs_stats(filesystems); keep(filesystems); });
+
+        pressure::stall psi;
+        r.add("collector/pressure", [&] { pressure::retrieve_psi("cpu", psi); keep(psi); });
+
+        std::array<float, 3> loads{};
+        r.add("collector/loadavg", [&] { cpu::retrieve_cpu_loads(loads); keep(loads); });
+
+        unsigned int procs = 0;
+        r.add("collector/procs", [&] { cpu::retrieve_cpu_procs(procs); keep(procs); });
+
+        auto results = r.run(filter, min_time);
+        source::set_root("");
+        return results;
+    }
+
+    // The client over a replay of the large fixture host, all of its collectors are due on each sample
+    std::vector<result> monitor(std::string const& fixtures, std::string const& filter, std::chrono::nanoseconds min_time) {
+
+        auto capture = (std::filesystem::temp_directory_path() / "thinger_monitor_bench.cap").string();
+        snapshot(fixtures + "/large", capture);
+        source::replay(capture);
+
+        Config config((std::filesystem::temp_directory_path() / "thinger_monitor_bench.json").string());
+        iotmp::client iotmp_client("");
+        client c(iotmp_client, config);
+
+        nlohmann::json resources = {
+            {"defaults", true},
+            {"filesystems", {"/"}},
+            {"drives", {"nvme0n1", "nvme1n1", "nvme2n1", "nvme3n1"}},
+            {"interfaces", {"ens0f0", "ens0f1", "ens7f0", "ens7f1"}},
+        };
+        config.update("resources", resources);
+        c.reload_configuration("resources");
+
+        runner r;
+
+        r.add("monitor/sample", [&] {
+            source::advance(source::now() + std::chrono::minutes(1));
+            keep(c.sample());
+        });
+
+        r.add("monitor/publish", [&] {
+            protoson::pson out;
+            c.publish(out);
+            keep(out);
+        });
+
+        auto results = r.run(filter, min_time);
+        source::reset();
+        std::filesystem::remove(capture);
+        return results;
+    }
+
+    std::vector<result> crypto(std::string const& filter, std::chrono::nanoseconds min_time) {
+
+        runner r;
+
+        std::string payload(4096, 'x');
+        r.add("crypto/sha256_4k", [&] { keep(Crypto::hash::sha256(payload)); }, (double)payload.size());
+
+        std::string key(32, 'k');
+        std::string message(256, 'm');
+        r.add("crypto/hmac_sha256_256", [&] { keep(Crypto::hash::hmac_sha256(key, message)); }, (double)message.size());
+
+        std::string digest(32, '\xab');
+        r.add("crypto/to_hex_32", [&] { keep(Crypto::to_hex(digest)); });
+
+        S3::AWSV4 signer("AKIDEXAMPLE", "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY", "us-east-1", "s3");
+        std::string canonical_request =
+            "PUT\n/backups/thinger_backup.tar.gz\npartNumber=1&uploadId=example\n"
+            "host:bucket.s3.us-east-1.amazonaws.com\n"
+            "x-amz-content-sha256:UNSIGNED-PAYLOAD\n"
+            "x-amz-date:20240101T000000Z\n\n"
+            "host;x-amz-content-sha256;x-amz-date\nUNSIGNED-PAYLOAD";
+        r.add("s3/awsv4_auth_header", [&] { keep(signer.get_auth_header(Date(), canonical_request)); });
+
+        return r.run(filter, min_time);
+    }
+
+    std::vector<result> archive(std::string const& fixtures, std::string const& filter, std::chrono::nanoseconds min_time) {
+
+        runner r;
+
+        auto tree = fixtures + "/large";
+        auto tar = (std::filesystem::temp_directory_path() / "thinger_monitor_bench.tar").string();
+        auto size = (double)tree_size(tree);
+
+        r.add("tar/write", [&] {
+            auto a = ::utils::tar::write::create_archive(tar);
+            keep(::utils::tar::write::add_directory(a, tree));
+            ::utils::tar::write::close_archive(a);
+        }, size);
+
+        r.add("tar/list", [&] {
+            auto a = ::utils::tar::read::create_archive(tar);
+            keep(::utils::tar::read::list_files(a));
+            ::utils::tar::read::close_archive(a);
+        }, size);
+
+        auto results = r.run(filter, min_time);
+        std::filesystem::remove(tar);
+        return results;
+    }
+
+    // Local stand-in of the S3 multipart upload API answering every request after a delay, the
+    // round trip to S3, so uploads are measured by how well they hide it
+    struct s3_stand_in {
+
+        httplib::Server svr;
+        std::thread thread;
+        int port;
+        std::string object; // served by ranges to downloads
+        std::string etag;
+
+        explicit s3_stand_in(std::chrono::milliseconds latency) {
+            svr.Post(".*", [latency](const httplib::Request& req, httplib::Response& res) {
+                std::this_thread::sleep_for(latency);
+                if ( req.has_param("uploads") )
+                    res.set_content("<InitiateMultipartUploadResult><UploadId>bench</UploadId></InitiateMultipartUploadResult>", "application/xml");
+            });
+            svr.Put(".*", [latency](const httplib::Request& req, httplib::Response& res) {
+                std::this_thread::sleep_for(latency);
+                res.set_header("ETag", "\"" + req.get_param_value("partNumber") + "\"");
+            });
+            svr.Get(".*", [this, latency](const httplib::Request&, httplib::Response& res) {
+                std::this_thread::sleep_for(latency);
+                res.set_header("ETag", etag);
+                res.set_content(object, "application/x-compressed-tar");
+            });
+            port = svr.bind_to_any_port("127.0.0.1");
+            thread = std::thread([this] { svr.listen_after_bind(); });
+            while ( !svr.is_running() )
+                std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        }
+
+        ~s3_stand_in() {
+            svr.stop();
+            thread.join();
+        }
+    };
+
+    std::vector<result> upload(std::string const& filter, std::chrono::nanoseconds min_time) {
+
+        const std::vector<unsigned int> concurrencies = {1, 4, 8};
+        auto name = [](unsigned int concurrency) { return "s3/multipart_upload_64M_c" + std::to_string(concurrency); };
+        if ( std::none_of(concurrencies.begin(), concurrencies.end(), [&](unsigned int c) { return name(c).find(filter) != std::string::npos; }) )
+            return {};
+
+        runner r;
+
+        // 50 ms of round trip, as from a host in Europe to a bucket in the US
+        s3_stand_in s3(std::chrono::milliseconds(50));
+
+        auto file = (std::filesystem::temp_directory_path() / "thinger_monitor_bench_upload.tar").string();
+        std::size_t size = 64 << 20;
+        std::ofstream(file, std::ios::binary | std::ios::trunc) << std::string(size, 'x');
+
+        std::string bucket = "bucket";
+        std::string region = "us-east-1";
+        std::string access_key = "AKIDEXAMPLE";
+        std::string secret_key = "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY";
+
+        for (auto concurrency : concurrencies) {
+            r.add(name(concurrency), [&, concurrency] {
+                S3::MultipartUpload mpu(bucket, region, access_key, secret_key, file,
+                                        {.concurrency = concurrency, .endpoint = "http://127.0.0.1:" + std::to_string(s3.port)});
+                keep(mpu.upload());
+            }, (double)size);
+        }
+
+        auto results = r.run(filter, min_time);
+        std::filesystem::remove(file);
+        return results;
+    }
+
+    std::vector<result> download(std::string const& filter, std::chrono::nanoseconds min_time) {
+
+        const std::vector<unsigned int> concurrencies = {1, 4, 8};
+        auto name = [](unsigned int concurrency) { return "s3/ranged_download_64M_c" + std::to_string(concurrency); };
+        if ( std::none_of(concurrencies.begin(), concurrencies.end(), [&](unsigned int c) { return name(c).find(filter) != std::string::npos; }) )
+            return {};
+
+        runner r;
+
+        s3_stand_in s3(std::chrono::milliseconds(50));
+        s3.object = std::string(64 << 20, 'x');
+
+        // ETag of an object uploaded by parts, verified by the download
+        Crypto::hash::md5 etag;
+        for (std::size_t first = 0; first < s3.object.size(); first += S3::Download::range_size) {
+            Crypto::hash::md5 part;
+            part.update(s3.object.data() + first, std::min(S3::Download::range_size, s3.object.size() - first));
+            auto digest = part.digest();
+            etag.update(digest.data(), digest.size());
+        }
+        auto parts = (s3.object.size() + S3::Download::range_size - 1) / S3::Download::range_size;
+        s3.etag = "\"" + Crypto::to_hex(etag.digest()) + "-" + std::to_string(parts) + "\"";
+
+        auto file = (std::filesystem::temp_directory_path() / "thinger_monitor_bench_download.tar").string();
+
+        for (auto concurrency : concurrencies) {
+            r.add(name(concurrency), [&, concurrency] {
+                S3::Download d("bucket", "us-east-1", "AKIDEXAMPLE", "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY", file,
+                               {.concurrency = concurrency, .endpoint = "http://127.0.0.1:" + std::to_string(s3.port)});
+                keep(d.download());
+            }, (double)s3.object.size());
+        }
+
+        auto results = r.run(filter, min_time);
+        std::filesystem::remove(file);
+        return results;
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+
+    using namespace thinger::monitor;
+
+    std::string filter;
+    std::string out;
+    std::string fixtures;
+    long min_time_ms = 200;
+
+    namespace po = boost::program_options;
+
+    po::options_description desc("thinger_monitor_bench [options]");
+    desc.add_options()
+      ("help,h", "show this help")
+      ("filter,f", po::value<std::string>(&filter)->default_value(""), "only run benchmarks whose name contains this")
+      ("min-time,t", po::value<long>(&min_time_ms)->default_value(200), "minimum time in milliseconds of the measured batch")
+      ("fixtures", po::value<std::string>(&fixtures)->default_value(FIXTURES_DIR), "fixture hosts directory")
+      ("out,o", po::value<std::string>(&out)->default_value(""), "write the json results to a file instead of stdout");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << std::endl;
+        return 1;
+    }
+
+    auto min_time = std::chrono::milliseconds(min_time_ms);
+
+    std::vector<bench::result> results;
+    for (auto&& group : {
+        bench::collectors(fixtures, filter, min_time),
+        bench::monitor(fixtures, filter, min_time),
+        bench::crypto(filter, min_time),
+        bench::archive(fixtures, filter, min_time),
+        bench::upload(filter, min_time),
+        bench::download(filter, min_time),
+    })
+        results.insert(results.end(), group.begin(), group.end());
+
+    nlohmann::json report = {
+        {"version", VERSION},
+        {"date", Date().to_iso8601('-', true, "utc")},
+        {"fixtures", fixtures},
+        {"min_time_ms", min_time_ms},
+        {"benchmarks", bench::to_json(results)},
+    };
+
+    if ( out.empty() ) {
+        std::cout << report.dump(2) << std::endl;
+    } else {
+        std::ofstream(out) << report.dump(2) << std::endl;
+    }
+
+    return 0;
+}
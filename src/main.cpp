@@ -33,6 +33,7 @@
 
 #include "thinger/utils/jwt.h"
 #include "thinger/utils/thinger.h"
+#include "thinger/utils/watch.h"
 
 #include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
@@ -68,6 +69,10 @@ int main(int argc, char *argv[]) {
     ("token,t", po::value<std::string>(), "autoprovisioning token")
     ("insecure,k", "insecure connection")
     ("config,c", po::value<std::string>()->default_value("/etc/thinger_io/thinger_monitor.json"), "configuration file path")
+    ("root,r", po::value<std::string>(), "host root filesystem, i.e., '/host' when running in a container")
+    ("state,s", po::value<std::string>(), "file keeping counters and probe results across restarts, empty to disable")
+    ("record", po::value<std::string>(), "record every file read by the collectors into a capture file")
+    ("replay", po::value<std::string>(), "replay a capture file through the collectors and exit")
     ("transport,p", po::value<std::string>(&transport)->default_value(""), "connection transport, i.e., 'websocket'");
 
   // Parse arguments
@@ -93,6 +98,12 @@ int main(int argc, char *argv[]) {
   if (vm.count("config")) {
     config.set_path(vm["config"].as<std::string>());
   }
+  if (vm.count("root")) {
+    config.set_root(vm["root"].as<std::string>());
+  }
+  if (vm.count("state")) {
+    config.set_state(vm["state"].as<std::string>());
+  }
   // If the thinger token is passed we assume the device needs to be created
   if (vm.count("token")) {
 
@@ -132,6 +143,45 @@ int main(int argc, char *argv[]) {
 
   }
 
+  // collectors read /proc, /sys and /etc below the configured root
+  thinger::monitor::source::set_root(config.get_root());
+  if ( !config.get_root().empty() )
+    LOG_INFO(fmt::format("Monitoring host mounted at {0}", config.get_root()));
+
+  if (vm.count("replay")) {
+    auto capture = vm["replay"].as<std::string>();
+    if ( !thinger::monitor::source::replay(capture) ) {
+      LOG_ERROR(fmt::format("Could not load capture {0}", capture));
+      return -1;
+    }
+
+    iotmp::client client(transport);
+    thinger::monitor::Client monitor(client, config);
+
+    // recorded on each reload of the resources property, the replay starts with the first one
+    std::string resources;
+    if ( thinger::monitor::source::read("#config/resources", resources) ) {
+      auto resources_json = json::parse(resources, nullptr, false);
+      if ( !resources_json.is_discarded() && config.update("resources", resources_json) )
+        monitor.reload_configuration("resources");
+    }
+
+    auto stats = monitor.replay(std::cout);
+    auto wall = std::chrono::duration<double, std::milli>(stats.wall).count();
+    LOG_INFO(fmt::format("Replayed {0} ticks of {1} in {2:.2f} ms, {3:.3f} ms per tick", stats.ticks, capture, wall,
+      stats.ticks == 0 ? 0 : wall / (double)stats.ticks));
+    return 0;
+  }
+
+  if (vm.count("record")) {
+    auto capture = vm["record"].as<std::string>();
+    if ( !thinger::monitor::source::record(capture) ) {
+      LOG_ERROR(fmt::format("Could not create capture {0}", capture));
+      return -1;
+    }
+    LOG_INFO(fmt::format("Recording collector inputs into {0}", capture));
+  }
+
   // run asio workers
   thinger::asio::workers.start();
 
@@ -154,6 +204,15 @@ int main(int argc, char *argv[]) {
 
   thinger::monitor::Client monitor(client, config);
 
+  // local edits of the configuration file are applied without restarting the agent
+  utils::watch::file config_watcher(config.get_path(), std::chrono::milliseconds(500), [&config, &monitor] {
+    if ( config.reload() ) {
+      LOG_INFO(fmt::format("Configuration file {0} changed", config.get_path()));
+      monitor.reconfigure();
+    }
+  });
+  if ( !config_watcher.watching() )
+    LOG_WARNING(fmt::format("Could not watch configuration file {0}, edits need a restart", config.get_path()));
 
   // Retrieve properties on connection and any update
   for (auto const &property: config.remote_properties) {
@@ -175,6 +234,8 @@ int main(int argc, char *argv[]) {
   // wait for asio workers to complete (receive a signal)
  thinger::asio::workers.wait();
 
+  thinger::monitor::source::flush();
+
   return 0;
 
 }
\ No newline at end of file
@@ -1,5 +1,15 @@
 #include "config.h"
 #include "monitor.h"
+#include "monitor/agent.h"
+#include "monitor/batch.h"
+#include "monitor/devices.h"
+#include "monitor/history.h"
+#include "monitor/memory.h"
+#include "monitor/numa.h"
+#include "monitor/probes.h"
+#include "monitor/push.h"
+#include "monitor/sensors.h"
+#include "monitor/state.h"
 
 #include <httplib.h>
 
@@ -8,8 +18,12 @@
 #include <unistd.h>
 #include <thread>
 #include <future>
+#include <map>
+#include <mutex>
+#include <condition_variable>
 
 #include "utils/thinger.h"
+#include "utils/crypto.h"
 #include "utils/date.h"
 
 #include "system/platform/backup.h"
@@ -47,6 +61,7 @@ namespace thinger::monitor {
         Client(thinger::iotmp::client& client, Config& config) :
             resources_{
               {"monitor", client["monitor"](server_)},
+              {"monitor_batch", client["monitor_batch"]},
               {"cmd", client["cmd"]},
               {"reboot", client["reboot"]},
               {"update", client["update"]},
@@ -54,7 +69,8 @@ namespace thinger::monitor {
               {"backup", client["backup"]},
               {"restore", client["restore"]},
             },
-            config_(config)
+            config_(config),
+            client_(client)
         {
 
             /*if ( ! config_.get_backup().empty() ) {
@@ -68,6 +84,16 @@ namespace thinger::monitor {
             system::retrieve_kernel_version(kernel_version);
             cpu::retrieve_cpu_cores(cpu_cores);
 
+            // NUMA topology, only tracked on multi node hosts
+            numa_nodes_ = numa::discover(numa_buffer_);
+            if ( numa_nodes_.size() < 2 ) numa_nodes_.clear();
+            numa::retrieve(numa_nodes_, numa_buffer_);
+            numa::update(numa_nodes_, rates::now());
+
+            // sensors are discovered once and their sysfs attributes kept open
+            sensors_.discover();
+            build_keys(false);
+
             resources_.at("cmd") = [this, &client](iotmp::input& in, iotmp::output& out) {
                 std::string output = cmd(in["input"]);
                 out["output"] = output;
@@ -283,143 +309,299 @@ namespace thinger::monitor {
             //}
 
             resources_.at("monitor") = [this](iotmp::output& out) {
+                publish(out);
+            };
 
-                unsigned long current_seconds = std::chrono::duration_cast<std::chrono::seconds>(
-                    std::chrono::system_clock::now().time_since_epoch()).count();
+            // samples since the last read as gorilla compressed columns, reading drains the batch
+            resources_.at("monitor_batch") = [this](iotmp::output& out) {
+                std::scoped_lock lock(sample_mutex_);
+                out["samples"] = (unsigned int)batch_.size();
+                out["series"] = (unsigned int)batch_.names().size();
+                out["data"] = Crypto::base64::encode(batch_.encode());
+                batch_.clear();
+            };
 
-                // Set values at defined intervals
-                if (current_seconds >= (every5s + 5)) {
-                    cpu::retrieve_cpu_loads(cpu_loads); // load and usage is updated every 5s by sysinfo
-                    cpu::retrieve_cpu_usage(cpu_usage, cpu_loads, cpu_cores);
-                    every5s = current_seconds;
-                }
+            // rollups of the same series on the local server, i.e., /history?metric=cpu_usage&from=<ms>&to=<ms>&step=<ms>
+            server_.Get("/history", [this](const httplib::Request& req, httplib::Response& res) {
+                serve_history(req, res);
+            });
 
-                if (current_seconds >= (every1m + 60)) {
-                    system::retrieve_uptime(uptime);
-                    cpu::retrieve_cpu_procs(cpu_procs);
-                    storage::retrieve_fs_stats(filesystems_);
-                    every1m = current_seconds;
-                }
+            // a replay drives the collectors itself, from the capture
+            if ( source::replaying() ) return;
 
-                if (current_seconds >= (every5m + 60*5)) {
-                    retrieve_restart_status();
-                    retrieve_updates();
-                    if (config_.get_backup() == "platform")
-                      platform::getConsoleVersion(console_version);
-                    every5m = current_seconds;
-                }
+            restore_state();
+            start_probes();
+            start_sampler();
+            start_pusher();
+            start_local_server();
+    }
 
-                if (current_seconds >= (every1d + 60*60*24)) {
-                    public_ip = network::getPublicIPAddress();
-                    // FIXME: config get_backup is not set on first execution since
-                    every1d = current_seconds;
-                }
+    // Last values of every collector, into the monitor resource or a replay line
+    template <typename Output>
+    void publish(Output& out) {
+        // publish runs at once from the pusher, the monitor resource and the local server, the
+        // values refreshed here and the latency histogram are shared with them
+        std::scoped_lock lock(sample_mutex_);
+        agent::timer timer(monitor_latency_);
+
+        unsigned long current_seconds = source::replaying() ?
+            std::chrono::duration_cast<std::chrono::seconds>(source::now().time_since_epoch()).count() :
+            std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        // Set values at defined intervals
+        if (current_seconds >= (every1m + 60)) {
+            system::retrieve_uptime(uptime);
+            cpu::retrieve_cpu_procs(cpu_procs);
+            every1m = current_seconds;
+        }
 
-                // Storage
-                for (auto const & fs : filesystems_) {
-                    std::string name = fs.path;
-                    if ( config_.get_defaults() && &fs == &filesystems_.front()) {
-                        name = "default";
-                    }
-                    out[("st_"+name+"_capacity").c_str()] = std::trunc( (float)fs.space_info.capacity / (float)btogb * 100 ) / 100;
-                    out[("st_"+name+"_used").c_str()] = std::trunc( (float)(fs.space_info.capacity - fs.space_info.free) / (float)btogb * 100 ) / 100;
-                    out[("st_"+name+"_free").c_str()] = std::trunc( (float)fs.space_info.free / (float)btogb * 100 ) / 100;
-                    out[("st_"+name+"_usage").c_str()] = std::trunc( ((float)(fs.space_info.capacity - fs.space_info.free)*100) / (float)fs.space_info.capacity * 100 ) / 100; // usage based on time of io spend doing io operations
-                }
+        // Collectors are sampled by the sampler thread, only publish their last values
+        auto config = config_.snapshot();
+
+        // Storage
+        for (std::size_t i = 0; i < filesystems_.size(); i++) {
+            auto const& fs = filesystems_[i];
+            auto const& keys = keys_.filesystems[i];
+            put(out, keys.capacity, std::trunc( (float)fs.space_info.capacity / (float)btogb * 100 ) / 100);
+            put(out, keys.used, std::trunc( (float)(fs.space_info.capacity - fs.space_info.free) / (float)btogb * 100 ) / 100);
+            put(out, keys.free, std::trunc( (float)fs.space_info.free / (float)btogb * 100 ) / 100);
+            put(out, keys.usage, fs.space_info.capacity == 0 ? 0 : std::trunc( ((float)(fs.space_info.capacity - fs.space_info.free)*100) / (float)fs.space_info.capacity * 100 ) / 100); // no capacity when it could not be stat'ed
+        }
 
-                // IO
-                retrieve_dv_stats(drives_);
-                for (auto & dv : drives_) {
-                    std::string name = dv.name;
-                    if ( config_.get_defaults() && &dv == &drives_.front()) {
-                        name = "default";
-                    }
+        // IO
+        for (std::size_t i = 0; i < drives_.size(); i++) {
+            auto const& dv = drives_[i];
+            auto const& keys = keys_.drives[i];
+            put(out, keys.speed_read, std::trunc( dv.speed_read / btokb * 100 ) / 100);
+            put(out, keys.speed_written, std::trunc( dv.speed_written / btokb * 100 ) / 100);
+            put(out, keys.usage, dv.usage < 1 ? std::trunc( dv.usage * 100 * 100 ) / 100 : 100);
+        }
 
-                    float speed_reading = (((float)(dv.total_io[1][0] - dv.total_io[0][0]) * SECTOR_SIZE) /
-                        (float)(dv.total_io[1][3] - dv.total_io[0][3]))*1000;
-                    float speed_writing = (((float)(dv.total_io[1][1] - dv.total_io[0][1]) * SECTOR_SIZE) /
-                        (float)(dv.total_io[1][3] - dv.total_io[0][3]))*1000;
-                    float usage = (float)(dv.total_io[1][2] - dv.total_io[0][2]) / (float)(dv.total_io[1][3] - dv.total_io[0][3]);
+        // Network
+        for (std::size_t i = 0; i < interfaces_.size(); i++) {
+            auto const& ifc = interfaces_[i];
+            auto const& keys = keys_.interfaces[i];
+            put(out, keys.internal_ip, ifc.internal_ip);
+
+            put(out, keys.transfer_incoming, std::trunc( (float)ifc.total_transfer[0] / (float)btogb * 100 ) / 100);
+            put(out, keys.transfer_outgoing, std::trunc( (float)ifc.total_transfer[1] / (float)btogb * 100 ) / 100);
+            put(out, keys.transfer_total, std::trunc( ((float)ifc.total_transfer[0] + (float)ifc.total_transfer[1]) / (float)btogb * 100 ) / 100);
+            put(out, keys.packetloss_incoming, ifc.total_packets[1]);
+            put(out, keys.packetloss_outgoing, ifc.total_packets[3]);
+
+            put(out, keys.speed_incoming, std::trunc( ifc.speed_incoming * 8 / btokb * 100 ) / 100);
+            put(out, keys.speed_outgoing, std::trunc( ifc.speed_outgoing * 8 / btokb * 100 ) / 100);
+            put(out, keys.speed_total, std::trunc( ((ifc.speed_incoming + ifc.speed_outgoing) * 8) / btokb * 100 ) / 100);
+        }
 
-                    out[("dv_"+name+"_speed_read").c_str()] = std::trunc( speed_reading / btokb * 100 ) / 100;
-                    out[("dv_"+name+"_speed_written").c_str()] = std::trunc( speed_writing / btokb * 100 ) / 100;
-                    out[("dv_"+name+"_usage").c_str()] = usage < 1 ? std::trunc( usage * 100 * 100 ) / 100 : 100;
+        // Slow probes run asynchronously, only publish their last good values, replays do not start them
+        if ( public_ip_probe_ ) {
+            auto public_ip = public_ip_probe_->last();
+            put(out, "nw_public_ip", public_ip.value);
+            put(out, "nw_public_ip_age", public_ip.valid ? (long)public_ip.age.count() : -1);
+        }
 
-                    // flip matrix for speed and usage calculations
-                    for (int z = 0; z < 4; z++) {
-                        dv.total_io[0][z] = dv.total_io[1][z];
-                    }
-                }
+        if (console_version_probe_ && config->backup == "platform") {
+            auto console_version = console_version_probe_->last();
+            put(out, "console_version", console_version.valid ? console_version.value : "Could not retrieve");
+            put(out, "console_version_age", console_version.valid ? (long)console_version.age.count() : -1);
+        }
 
-                // Network
-                retrieve_ifc_stats(interfaces_);
-                for (auto & ifc : interfaces_) {
-                    std::string name = ifc.name;
-                    if ( config_.get_defaults() && &ifc == &interfaces_.front()) {
-                        name = "default";
-                    }
+        // RAM
+        auto const& meminfo = memory_.meminfo;
+        auto ram_total = meminfo[memory::mem_total];
+        auto ram_available = meminfo[memory::mem_available];
+        auto ram_swaptotal = meminfo[memory::swap_total];
+        auto ram_swapfree = meminfo[memory::swap_free];
+        put(out, "ram_total", std::trunc( (float)ram_total / kbtogb * 100 ) / 100);
+        put(out, "ram_available", std::trunc( (float)ram_available / kbtogb * 100) / 100);
+        put(out, "ram_used", std::trunc( (float)(ram_total - ram_available) / kbtogb * 100 ) / 100);
+        put(out, "ram_usage", std::trunc( (float)((ram_total - ram_available) * 100) / (float)ram_total * 100 ) / 100);
+        put(out, "ram_swaptotal", std::trunc( (float)ram_swaptotal / (float)kbtogb * 100 ) / 100);
+        put(out, "ram_swapfree", std::trunc( (float)ram_swapfree / kbtogb * 100 ) / 100);
+        put(out, "ram_swapused", std::trunc( (float)(ram_swaptotal - ram_swapfree) / kbtogb * 100) / 100);
+        put(out, "ram_swapusage", (ram_swaptotal == 0) ? 0 : std::trunc( (float)((ram_swaptotal - ram_swapfree) *100) / (double)ram_swaptotal * 100 ) / 100);
+        put(out, "ram_buffers", std::trunc( (float)meminfo[memory::buffers] / kbtogb * 100 ) / 100);
+        put(out, "ram_cached", std::trunc( (float)meminfo[memory::cached] / kbtogb * 100 ) / 100);
+        put(out, "ram_dirty", std::trunc( (float)meminfo[memory::dirty] / kbtogb * 100 ) / 100);
+        put(out, "ram_writeback", std::trunc( (float)meminfo[memory::writeback] / kbtogb * 100 ) / 100);
+        put(out, "ram_slab", std::trunc( (float)meminfo[memory::slab] / kbtogb * 100 ) / 100);
+        put(out, "ram_slab_reclaimable", std::trunc( (float)meminfo[memory::sreclaimable] / kbtogb * 100 ) / 100);
+        put(out, "ram_anon_hugepages", std::trunc( (float)meminfo[memory::anon_hugepages] / kbtogb * 100 ) / 100);
+        put(out, "ram_hugepages_total", meminfo[memory::hugepages_total]);
+        put(out, "ram_hugepages_free", meminfo[memory::hugepages_free]);
+        put(out, "ram_hugepages_size", meminfo[memory::hugepagesize]); // kB
+
+        // Virtual memory events per second
+        put(out, "vm_pgfault_rate", std::trunc( vm_rates_.rate(memory::pgfault) * 100 ) / 100);
+        put(out, "vm_pgmajfault_rate", std::trunc( vm_rates_.rate(memory::pgmajfault) * 100 ) / 100);
+        put(out, "vm_pswpin_rate", std::trunc( vm_rates_.rate(memory::pswpin) * 100 ) / 100);
+        put(out, "vm_pswpout_rate", std::trunc( vm_rates_.rate(memory::pswpout) * 100 ) / 100);
+        put(out, "vm_oom_kill_rate", std::trunc( vm_rates_.rate(memory::oom_kill) * 100 ) / 100);
+        put(out, "vm_oom_kill", memory_.vmstat[memory::oom_kill]);
+
+        // CPU
+        put(out, "cpu_cores", cpu_cores);
+        put(out, "cpu_load_1m", cpu_loads[0]);
+        put(out, "cpu_load_5m", cpu_loads[1]);
+        put(out, "cpu_load_15m", cpu_loads[2]);
+        put(out, "cpu_usage", std::trunc(cpu_usage*100)/100);
+        put(out, "cpu_procs", cpu_procs);
+
+        // Sensors
+        for (std::size_t i = 0; i < sensors_.temperatures().size(); i++)
+            put(out, keys_.temperatures[i], std::trunc( sensors_.temperatures()[i].value * 10 ) / 10);
+        for (std::size_t i = 0; i < sensors_.fans().size(); i++)
+            put(out, keys_.fans[i], sensors_.fans()[i].value);
+        for (std::size_t i = 0; i < sensors_.cores().size(); i++) {
+            put(out, keys_.cores[i].freq, sensors_.cores()[i].current);
+            put(out, keys_.cores[i].freq_max, sensors_.cores()[i].max);
+        }
+        if ( !sensors_.cores().empty() )
+            put(out, "cpu_throttled", std::trunc( sensors_.throttled() * 100 * 100 ) / 100);
+
+        // NUMA nodes
+        for (std::size_t i = 0; i < numa_nodes_.size(); i++) {
+            auto const& node = numa_nodes_[i];
+            auto const& keys = keys_.numa[i];
+            put(out, keys.mem_total, std::trunc( (float)node.mem_total / kbtogb * 100 ) / 100);
+            put(out, keys.mem_used, std::trunc( (float)(node.mem_total - node.mem_free) / kbtogb * 100 ) / 100);
+            put(out, keys.mem_usage, node.mem_total == 0 ? 0 : std::trunc( (float)(node.mem_total - node.mem_free) * 100 / (float)node.mem_total * 100 ) / 100);
+            put(out, keys.miss_rate, std::trunc( node.miss_rate * 100 ) / 100);
+            put(out, keys.foreign_rate, std::trunc( node.foreign_rate * 100 ) / 100);
+            put(out, keys.cpu_usage, std::trunc( node.cpu_usage * 100 ) / 100);
+        }
 
-                    out[("nw_"+name+"_internal_ip").c_str()] = ifc.internal_ip;
+        // System information
+        put(out, "si_uptime", uptime);
+        put(out, "si_hostname", hostname);
+        put(out, "si_os_version", os_version);
+        put(out, "si_kernel_version", kernel_version);
+        system::updates updates;
+        if ( updates_probe_ )
+            updates = updates_probe_->last().value;
+        else
+            system::retrieve_updates(updates);
+        put(out, "si_normal_updates", updates.normal);
+        put(out, "si_security_updates", updates.security);
+        put(out, "si_restart", updates.restart);
+        put(out, "si_sw_version", VERSION);
+
+        // Alerts
+        put(out, "alerts_firing", (unsigned int)alerts_.firing());
+
+        // Agent, what publishing these values costs is recorded on the next call
+        publish_agent(out);
+    }
 
-                    out[("nw_"+name+"_transfer_incoming").c_str()]    = std::trunc( (float)ifc.total_transfer[0][1] / (float)btogb * 100 ) / 100;
-                    out[("nw_"+name+"_transfer_outgoing").c_str()]    = std::trunc( (float)ifc.total_transfer[1][1] / (float)btogb * 100 ) / 100;
-                    out[("nw_"+name+"_transfer_total").c_str()]       = std::trunc( ((float)ifc.total_transfer[0][1] + (float)ifc.total_transfer[1][1]) / (float)btogb * 100 ) / 100;
-                    out[("nw_"+name+"_packetloss_incoming").c_str()]  = ifc.total_packets[1];
-                    out[("nw_"+name+"_packetloss_outgoing").c_str()]  = ifc.total_packets[3];
+    // Warm start from the state saved before a restart: probe values are served right away and
+    // counters keep their baselines, so the first publish is complete and its rates are right
+    void restore_state() {
+        auto path = config_.get_state();
+        if ( path.empty() ) return;
+        auto restored = state::read(path);
+        if ( !restored ) return;
+
+        std::scoped_lock lock(sample_mutex_);
+        warm_ = std::move(*restored);
+        state::load(config::get(warm_, "/counters/vmstat"_json_pointer, nlohmann::json()), vm_rates_);
+        LOG_INFO(fmt::format("[_STATE] Restored state from {0}", path));
+    }
 
-                    // speeds in B/s
-                    float speed_incoming = ((float)(ifc.total_transfer[0][1] - ifc.total_transfer[0][0]) /
-                        (float)(ifc.total_transfer[2][1] - ifc.total_transfer[2][0]))*1000;
-                    float speed_outgoing = ((float)(ifc.total_transfer[1][1] - ifc.total_transfer[1][0]) /
-                        (float)(ifc.total_transfer[2][1] - ifc.total_transfer[2][0]))*1000;
+    // Baseline saved for a device before a restart, null when there is none
+    [[nodiscard]] nlohmann::json warm_counters(std::string const& kind, std::string const& name) const {
+        auto counters = warm_.value("counters", nlohmann::json::object());
+        auto devices = counters.is_object() ? counters.value(kind, nlohmann::json::object()) : nlohmann::json();
+        return devices.is_object() ? devices.value(name, nlohmann::json()) : nlohmann::json();
+    }
 
-                    out[("nw_"+name+"_speed_incoming").c_str()] = std::trunc( speed_incoming * 8 / btokb * 100 ) / 100;
-                    out[("nw_"+name+"_speed_outgoing").c_str()] = std::trunc( speed_outgoing * 8 / btokb * 100 ) / 100;
-                    out[("nw_"+name+"_speed_total").c_str()]    = std::trunc( ((speed_incoming + speed_outgoing) * 8) / btokb * 100 ) / 100;
+    void save_state() {
+        auto path = config_.get_state();
+        if ( path.empty() || source::replaying() ) return;
 
-                    // flip matrix for speed and usage calculations
-                    for (int i = 0; i < 3; i++) {
-                        ifc.total_transfer[i][0] = ifc.total_transfer[i][1];
-                    }
-                }
-                out["nw_public_ip"] = public_ip;
+        nlohmann::json counters;
+        {
+            std::scoped_lock lock(sample_mutex_);
+            counters["vmstat"] = state::dump(vm_rates_);
+            for (auto const& dv : drives_)
+                counters["dv"][dv.name] = state::dump(dv.io_rates);
+            for (auto const& ifc : interfaces_)
+                counters["nw"][ifc.name] = state::dump(ifc.transfer_rates);
+        }
 
-                if (config_.get_backup() == "platform") {
-                    out["console_version"] = console_version;
-                }
+        nlohmann::json results;
+        if ( public_ip_probe_ )
+            results["public_ip"] = state::dump(public_ip_probe_->last());
+        if ( console_version_probe_ )
+            results["console_version"] = state::dump(console_version_probe_->last());
+
+        // logged once until it can be written again, not every minute
+        std::scoped_lock lock(state_mutex_);
+        bool written = state::write(path, {{"counters", counters}, {"probes", results}});
+        if ( !written && !state_failed_ )
+            LOG_WARNING(fmt::format("[_STATE] Could not write state file {0}", path));
+        state_failed_ = !written;
+    }
 
-                // RAM
-                memory::retrieve_ram(ram_total, ram_available, ram_swaptotal, ram_swapfree);
-                out["ram_total"] = std::trunc( (float)ram_total / kbtogb * 100 ) / 100;
-                out["ram_available"] = std::trunc( (float)ram_available / kbtogb * 100) / 100;
-                out["ram_used"] = std::trunc( (float)(ram_total - ram_available) / kbtogb * 100 ) / 100;
-                out["ram_usage"] = std::trunc( (float)((ram_total - ram_available) * 100) / (float)ram_total * 100 ) / 100;
-                out["ram_swaptotal"] = std::trunc( (float)ram_swaptotal / (float)kbtogb * 100 ) / 100;
-                out["ram_swapfree"] = std::trunc( (float)ram_swapfree / kbtogb * 100 ) / 100;
-                out["ram_swapused"] = std::trunc( (float)(ram_swaptotal - ram_swapfree) / kbtogb * 100) / 100;
-                out["ram_swapusage"] = (ram_swaptotal == 0) ? 0 : std::trunc( (float)((ram_swaptotal - ram_swapfree) *100) / (double)ram_swaptotal * 100 ) / 100;
-
-                // CPU
-                out["cpu_cores"] = cpu_cores;
-                out["cpu_load_1m"] = cpu_loads[0];
-                out["cpu_load_5m"] = cpu_loads[1];
-                out["cpu_load_15m"] = cpu_loads[2];
-                out["cpu_usage"] = std::trunc(cpu_usage*100)/100;
-                out["cpu_procs"] = cpu_procs;
-
-                // System information
-                out["si_uptime"] = uptime;
-                out["si_hostname"] = hostname;
-                out["si_os_version"] = os_version;
-                out["si_kernel_version"] = kernel_version;
-                out["si_normal_updates"] = normal_updates;
-                out["si_security_updates"] = security_updates;
-                out["si_restart"] = system_restart;
-                out["si_sw_version"] = VERSION;
+    // Servers asked by the network probes
+    struct probe_hosts {
+        std::string public_ip = "https://ifconfig.me";
+        std::string console = "http://127.0.0.1";
+    };
 
-            };
+    void start_probes() {
+        start_probes(probe_hosts{});
+    }
 
-            start_local_server();
+    void start_probes(probe_hosts const& hosts) {
+        using namespace std::chrono_literals;
+
+        // values saved before a restart are served until they are due
+        public_ip_probe_ = probes_.add<std::string>([host = hosts.public_ip](std::chrono::milliseconds timeout) {
+            return network::getPublicIPAddress(timeout, host);
+        }, {24h, 10s, 30s, 1h}, state::load(config::get(warm_, "/probes/public_ip"_json_pointer, nlohmann::json())));
+
+        console_version_probe_ = probes_.add<std::string>([this, host = hosts.console](std::chrono::milliseconds timeout) -> std::optional<std::string> {
+            if (config_.snapshot()->backup != "platform")
+                return "";
+            return platform::getConsoleVersion(timeout, host);
+        }, {5min, 2s, 10s, 5min}, state::load(config::get(warm_, "/probes/console_version"_json_pointer, nlohmann::json())));
+
+        updates_probe_ = probes_.add<system::updates>([](std::chrono::milliseconds) {
+            system::updates u;
+            system::retrieve_updates(u);
+            return std::optional<system::updates>(u);
+        }, {5min, 1s, 5min, 5min});
+    }
+
+    void start_sampler() {
+        sampler_jthread = std::jthread( [this](const std::stop_token& stoken) {
+          std::mutex wait_mutex;
+          auto next_state = sampling::clock::now() + std::chrono::minutes(1);
+          while ( !stoken.stop_requested() ) {
+            auto next = sample();
+            // also saved on shutdown, periodically for crashes
+            if ( sampling::clock::now() >= next_state ) {
+              save_state();
+              next_state = sampling::clock::now() + std::chrono::minutes(1);
+            }
+            std::unique_lock lock(wait_mutex);
+            sampler_cv_.wait_until(lock, stoken, next, [this] { return reschedule_.exchange(false); });
+          }
+        }
+      );
+    }
+
+    void start_pusher() {
+        pusher_jthread = std::jthread( [this](const std::stop_token& stoken) {
+          std::mutex wait_mutex;
+          while ( !stoken.stop_requested() ) {
+            auto next = push();
+            std::unique_lock lock(wait_mutex);
+            pusher_cv_.wait_until(lock, stoken, next, [this] { return repush_.exchange(false); });
+          }
+        }
+      );
     }
 
     void start_local_server() {
@@ -440,76 +622,603 @@ namespace thinger::monitor {
     virtual ~Client() {
         THINGER_LOG("stopping monitoring client");
 
+        save_state();
+
         // stop httplib server on shutdown
         server_.stop();//TODO: svr_jthread.request_stop();
     }
 
-    // Recreates and fills up structures
-    void reload_configuration(std::string_view const& property) {
+    // Applies a remote property update
+    void reload_configuration(std::string_view const&) {
+        reconfigure();
+    }
 
-        if ( "resources" == property ) {
-          interfaces_.clear();
-          filesystems_.clear();
-          drives_.clear();
+    // Applies what changed since the last applied configuration, each part on its own, so i.e. a
+    // new alert rule does not restart the local server nor drop the history of the metrics
+    void reconfigure() {
+        std::scoped_lock reconfigure_lock(reconfigure_mutex_);
+
+        // a single version of the configuration for the whole reconfiguration
+        auto current = config_.snapshot();
+        unsigned int changes = applied_ ? config::diff(*applied_, *current) : config::changed::all;
+        bool first = applied_ == nullptr;
+        applied_ = current;
+
+        if ( changes & (config::changed::devices | config::changed::sampling | config::changed::alerts | config::changed::history) ) {
+            std::scoped_lock lock(sample_mutex_);
+
+            if ( changes & config::changed::devices ) {
+              // devices still configured keep their baselines, only new ones start from a fresh read
+              devices::reconcile(filesystems_, current->filesystems, &storage::filesystem::path);
+              retrieve_fs_stats(filesystems_);
+
+              // or from the baselines saved before a restart, the first time
+              auto at = rates::now();
+              auto new_drives = devices::reconcile(drives_, current->drives, &io::drive::name);
+              retrieve_dv_stats(drives_);
+              for (auto i : new_drives)
+                if ( !state::load(warm_counters("dv", drives_[i].name), drives_[i].io_rates) )
+                  drives_[i].io_rates.update(at, drives_[i].total_io);
+
+              auto new_interfaces = devices::reconcile(interfaces_, current->interfaces, &network::interface::name);
+              retrieve_ifc_stats(interfaces_);
+              for (auto i : new_interfaces) {
+                interfaces_[i].internal_ip = network::getIPAddress(interfaces_[i].name);
+                if ( !state::load(warm_counters("nw", interfaces_[i].name), interfaces_[i].transfer_rates) )
+                  interfaces_[i].transfer_rates.update(at, interfaces_[i].total_transfer);
+              }
+              warm_.erase("counters");
+              build_keys(current->defaults);
+            }
 
-          for (const auto& fs_path : config_.get_filesystems()) {
-            storage::filesystem fs;
-            fs.path = fs_path;
-            filesystems_.push_back(fs);
-          }
-          retrieve_fs_stats(filesystems_);
+            if ( changes & config::changed::sampling ) {
+              for (auto& [name, collector] : collectors_)
+                collector.schedule.set_policy(current->sampling_policy(name, collector.defaults));
+              psi_contention_ = current->pressure_contention;
+              psi_memory_ = current->pressure_memory;
+              psi_backoff_ = current->pressure_backoff;
+            }
 
-          for (const auto& dv_name : config_.get_drives()) {
-            io::drive dv;
-            dv.name = dv_name;
-            drives_.push_back(dv);
-          }
-          retrieve_dv_stats(drives_);
+            // alert rules and batched series are bound to the devices
+            if ( changes & (config::changed::devices | config::changed::alerts | config::changed::history) ) {
+              auto catalog = build_catalog();
+              if ( changes & (config::changed::devices | config::changed::alerts) )
+                for (auto const& name : alerts_.compile(current->alerts, catalog))
+                  LOG_WARNING(fmt::format("[_ALERTS] Could not compile alert rule {0}", name));
+              if ( changes & (config::changed::devices | config::changed::history) )
+                reset_series(catalog);
+            }
+        }
+
+        // a capture replays with the resources it was recorded with
+        if ( changes & ~(config::changed::connection | config::changed::backups) )
+          source::annotate("#config/resources", config::get(current->remote, "/resources"_json_pointer, nlohmann::json({})).dump());
+
+        if ( changes & (config::changed::devices | config::changed::sampling) ) {
+          reschedule_ = true;
+          sampler_cv_.notify_all();
+        }
 
-          for (const auto& ifc_name : config_.get_interfaces()) {
-            network::interface ifc;
-            ifc.name = ifc_name;
-            ifc.internal_ip = network::getIPAddress(ifc.name);
-            interfaces_.push_back(ifc);
+        if ( changes & config::changed::push ) {
+          {
+            std::scoped_lock lock(push_mutex_);
+            push_policy_ = current->push;
+            push_changed_ = true;
           }
-          retrieve_ifc_stats(interfaces_);
+          repush_ = true;
+          pusher_cv_.notify_all();
+        }
 
+        if ( changes & config::changed::backups ) {
+          every1m = 0;
+          probes_.trigger();
+        }
+
+        if ( !first && (changes & config::changed::connection) )
+          LOG_WARNING("[CONFIG] Server, device or host root changed, restart the agent to apply them");
+
+        if ( (changes & config::changed::server) && !source::replaying() ) {
           // stop monitor server
           server_.stop();//TODO: svr_jthread.request_stop();
           start_local_server();
-
-        } else {
-          every5s = every1m = every5m = every1d = 0;
         }
+    }
+
+    struct replay_stats {
+        unsigned long ticks = 0;
+        std::chrono::nanoseconds wall{};
+    };
 
+    // Drives the collectors over a capture loaded with source::replay as fast as possible,
+    // writing what would have been published after each tick as a json line
+    replay_stats replay(std::ostream& os) {
+        replay_stats stats;
+        auto start = std::chrono::steady_clock::now();
+        while ( !source::replay_finished() ) {
+            auto next = sample();
+            nlohmann::json out;
+            publish(out);
+            os << out.dump() << '\n';
+            stats.ticks++;
+            source::advance(next);
+        }
+        stats.wall = std::chrono::steady_clock::now() - start;
+        return stats;
     }
 
 protected:
 
-    // TODO: move this functions to ns and make them configurable or self discoverable
-    // -- SYSTEM INFO -- //
-    void retrieve_updates() {
-        // We will use default ubuntu server notifications
-        fs::path f("/var/lib/update-notifier/updates-available");
-        if (fs::exists(f)) {
-            std::ifstream updatesinfo ("/var/lib/update-notifier/updates-available", std::ifstream::in);
-            std::string line;
-            updatesinfo >> normal_updates;
-            if(getline(updatesinfo, line)) {
-                updatesinfo >> security_updates;
-            } else {
-                security_updates = 0;
+    // -- SAMPLING -- //
+    // Runs the collectors that are due and returns when the next one will be
+    sampling::clock::time_point sample() {
+        auto now = source::now();
+        auto next = now;
+        std::vector<alerts::event> events;
+
+        {
+            std::scoped_lock lock(sample_mutex_);
+
+            if ( now >= next_psi_ ) {
+                pressure::retrieve_psi("cpu", psi_cpu_);
+                pressure::retrieve_psi("io", psi_io_);
+                pressure::retrieve_psi("memory", psi_mem_);
+                next_psi_ = now + std::chrono::seconds(1);
+            }
+
+            // cpu or io contention speeds collectors up, memory pressure backs the agent off
+            bool contention = psi_cpu_.some >= psi_contention_ || psi_io_.some >= psi_contention_;
+            unsigned int stretch = psi_mem_.some >= psi_memory_ ? psi_backoff_ : 1;
+
+            alerts::feeds sampled = 0;
+            alerts::feeds bit = 1;
+            next = next_psi_;
+            for (auto& [name, collector] : collectors_) {
+                if ( collector.schedule.due(now) ) {
+                    auto start = sampling::clock::now();
+                    double signal = (this->*collector.sample)();
+                    auto elapsed = sampling::clock::now() - start;
+                    collector.latency.record(elapsed);
+                    auto budget = collector.schedule.get_policy().budget;
+                    if ( budget.count() > 0 && elapsed > budget ) {
+                        // logged on the 1st, 2nd, 4th... overrun to not flood the log from a slow host
+                        auto overruns = ++collector.overruns;
+                        if ( (overruns & (overruns - 1)) == 0 )
+                            LOG_WARNING(fmt::format("[_SAMPLE] Collector {0} took {1} ms, over its {2} ms budget ({3} overruns)", name,
+                                std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(), budget.count(), collector.overruns));
+                    }
+                    collector.schedule.feed(signal, now, contention, stretch);
+                    sampled |= bit;
+                }
+                next = std::min(next, collector.schedule.next());
+                bit <<= 1;
+            }
+
+            // rules only see the metrics of the collectors sampled in this pass
+            if ( sampled ) {
+                alerts_.evaluate(now, events, sampled);
+                append_series(now, sampled);
+            }
+        }
+
+        // endpoints are called without holding the collectors
+        notify_alerts(events);
+
+        return next;
+    }
+
+    // -- PUSHING -- //
+    // Pushes a snapshot of every collector to the push endpoint when due, so collectors updated
+    // since the last push travel in a single message. Returns when the next push is due.
+    push::clock::time_point push() {
+        auto now = push::clock::now();
+
+        {
+            std::scoped_lock lock(push_mutex_);
+            if ( std::exchange(push_changed_, false) ) {
+                push_.set_policy(push_policy_, now);
+                if ( push_.enabled() )
+                    LOG_INFO(fmt::format("[__PUSH] Pushing to endpoint {0} every {1} ms", push_policy_.endpoint, push_policy_.interval.count()));
+            }
+        }
+
+        // disabled until the resources are reloaded
+        if ( !push_.enabled() ) return now + std::chrono::hours(1);
+        if ( !push_.due(now) ) return push_.next();
+
+        pson payload;
+        publish(payload);
+        payload["ts"] = std::chrono::duration_cast<std::chrono::milliseconds>(push_.next().time_since_epoch()).count();
+
+        auto start = std::chrono::steady_clock::now();
+        bool delivered = client_.call_endpoint(push_.get_policy().endpoint.c_str(), payload);
+        auto latency = std::chrono::steady_clock::now() - start;
+
+        bool paused = push_.paused();
+        push_.feed(push::clock::now(), delivered, latency);
+        if ( push_.paused() && !paused )
+            LOG_WARNING(fmt::format("[__PUSH] Pausing pushes until {0}: {1}", push_.failures() > 0 ? "the link is back" : "the link drains",
+                delivered ? fmt::format("push took {0} ms", std::chrono::duration_cast<std::chrono::milliseconds>(latency).count()) : "push failed"));
+        else if ( !push_.paused() && paused )
+            LOG_INFO("[__PUSH] Resuming pushes");
+
+        return push_.next();
+    }
+
+    void notify_alerts(std::vector<alerts::event> const& events) {
+        for (auto const& e : events) {
+            LOG_INFO(fmt::format("[_ALERTS] Alert {0} {1}: {2}; value: {3}", e.name, e.firing ? "firing" : "cleared", e.rule, e.value));
+
+            if (!e.endpoint.empty() && !source::replaying()) {
+                pson payload;
+                payload["device"] = config_.get_id();
+                payload["hostname"] = hostname;
+                payload["alert"] = e.name;
+                payload["rule"] = e.rule;
+                payload["status"] = e.firing ? "firing" : "cleared";
+                payload["value"] = e.value;
+                payload["threshold"] = e.threshold;
+                client_.call_endpoint(e.endpoint.c_str(), payload);
+            }
+        }
+    }
+
+    // Batched and history series are the published catalog metrics sorted by name, so consumers see a stable column order
+    void reset_series(alerts::catalog const& catalog) {
+        std::vector<std::pair<std::string, alerts::metric>> series;
+        for (auto const& entry : catalog)
+            if ( !entry.second.alias )
+                series.push_back(entry);
+        std::sort(series.begin(), series.end(), [](auto const& a, auto const& b) { return a.first < b.first; });
+
+        std::vector<std::string> names;
+        batch_sources_.clear();
+        series_feeds_.clear();
+        for (auto& [name, metric] : series) {
+            names.push_back(name);
+            batch_sources_.push_back(std::move(metric.read));
+            series_feeds_.push_back(metric.fed_by);
+        }
+        batch_.reset(std::move(names));
+        batch_row_.resize(batch_sources_.size());
+
+        std::scoped_lock lock(history_mutex_);
+        history_.reset(batch_.names(), config_.get_history());
+    }
+
+    // A batch row holds the last value of every series, as its columns share the timestamps, while
+    // the history only gets the samples of the collectors sampled in this pass
+    void append_series(sampling::clock::time_point now, alerts::feeds sampled) {
+        auto timestamp = source::replaying() ?
+            std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() :
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        // same precision as published, so unchanged metrics compress to a bit
+        for (std::size_t i = 0; i < batch_sources_.size(); i++)
+            batch_row_[i] = std::trunc(batch_sources_[i]() * 100) / 100;
+        batch_.append(timestamp, batch_row_);
+
+        std::scoped_lock lock(history_mutex_);
+        for (std::size_t i = 0; i < batch_row_.size(); i++)
+            if ( series_feeds_[i] & sampled )
+                history_.add(i, timestamp, batch_row_[i]);
+    }
+
+    // Streams the buckets of a metric a page at a time, without holding the history while writing
+    void serve_history(const httplib::Request& req, httplib::Response& res) {
+        auto metric = req.get_param_value("metric");
+        auto number = [&req](const char* name, std::int64_t fallback) {
+            auto value = req.get_param_value(name);
+            return value.empty() ? fallback : std::strtoll(value.c_str(), nullptr, 10);
+        };
+
+        auto now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        std::int64_t to = number("to", now + 1);
+        std::int64_t from = number("from", to - history::hour_ms);
+        std::int64_t step = number("step", 0);
+
+        {
+            std::scoped_lock lock(history_mutex_);
+            auto series = history_.find(metric);
+            if ( series == nullptr ) {
+                res.status = 404;
+                res.set_content(nlohmann::json({{"error", "unknown metric"}, {"metric", metric}}).dump(), "application/json");
+                return;
+            }
+            if ( step <= 0 ) step = series->resolution(from);
+        }
+
+        std::optional<std::int64_t> cursor = from;
+        bool first = true;
+        res.set_chunked_content_provider("application/json", [this, metric, to, step, cursor, first](std::size_t, httplib::DataSink& sink) mutable {
+            std::string chunk;
+            if ( std::exchange(first, false) )
+                chunk = fmt::format(R"({{"metric":{},"step":{},"points":[)", nlohmann::json(metric).dump(), step);
+            bool separate = chunk.empty();
+
+            {
+                std::scoped_lock lock(history_mutex_);
+                auto series = history_.find(metric);
+                cursor = series == nullptr ? std::nullopt : series->query(*cursor, to, step, 512, [&chunk, &separate](history::point const& p) {
+                    if ( std::exchange(separate, true) ) chunk.push_back(',');
+                    history::format(chunk, p);
+                });
+            }
+
+            if ( !cursor ) chunk.append("]}");
+            if ( !sink.write(chunk.data(), chunk.size()) ) return false;
+            if ( !cursor ) sink.done();
+            return true;
+        });
+    }
+
+    // Metrics available to alert rules with the same names and units they are published with
+    alerts::catalog build_catalog() {
+        alerts::catalog catalog;
+
+        auto const storage_feed = feed("storage"), io_feed = feed("io"), network_feed = feed("network"), memory_feed = feed("memory");
+        auto const cpu_feed = feed("cpu"), sensors_feed = feed("sensors"), numa_feed = feed("numa");
+
+        // the front device is published as default, its own name is kept for the rules
+        bool defaults = config_.get_defaults();
+        auto add = [defaults, &catalog](std::string const& prefix, std::string const& name, bool front, std::string const& metric, alerts::feeds fed_by, alerts::source const& source) {
+            catalog[prefix+"_"+name+"_"+metric] = {source, fed_by, front && defaults};
+            if ( front && defaults )
+                catalog[prefix+"_default_"+metric] = {source, fed_by};
+        };
+
+        for (auto const & fs : filesystems_) {
+            bool front = &fs == &filesystems_.front();
+            add("st", fs.path, front, "capacity", storage_feed, [&fs] { return (double)fs.space_info.capacity / btogb; });
+            add("st", fs.path, front, "used", storage_feed, [&fs] { return (double)(fs.space_info.capacity - fs.space_info.free) / btogb; });
+            add("st", fs.path, front, "free", storage_feed, [&fs] { return (double)fs.space_info.free / btogb; });
+            add("st", fs.path, front, "usage", storage_feed, [&fs] {
+                return fs.space_info.capacity == 0 ? 0 : (double)(fs.space_info.capacity - fs.space_info.free) * 100 / (double)fs.space_info.capacity;
+            });
+        }
+
+        for (auto const & dv : drives_) {
+            bool front = &dv == &drives_.front();
+            add("dv", dv.name, front, "speed_read", io_feed, [&dv] { return (double)dv.speed_read / btokb; });
+            add("dv", dv.name, front, "speed_written", io_feed, [&dv] { return (double)dv.speed_written / btokb; });
+            add("dv", dv.name, front, "usage", io_feed, [&dv] { return std::min((double)dv.usage * 100, 100.0); });
+        }
+
+        for (auto const & ifc : interfaces_) {
+            bool front = &ifc == &interfaces_.front();
+            add("nw", ifc.name, front, "transfer_incoming", network_feed, [&ifc] { return (double)ifc.total_transfer[0] / btogb; });
+            add("nw", ifc.name, front, "transfer_outgoing", network_feed, [&ifc] { return (double)ifc.total_transfer[1] / btogb; });
+            add("nw", ifc.name, front, "packetloss_incoming", network_feed, [&ifc] { return (double)ifc.total_packets[1]; });
+            add("nw", ifc.name, front, "packetloss_outgoing", network_feed, [&ifc] { return (double)ifc.total_packets[3]; });
+            add("nw", ifc.name, front, "speed_incoming", network_feed, [&ifc] { return (double)ifc.speed_incoming * 8 / btokb; });
+            add("nw", ifc.name, front, "speed_outgoing", network_feed, [&ifc] { return (double)ifc.speed_outgoing * 8 / btokb; });
+            add("nw", ifc.name, front, "speed_total", network_feed, [&ifc] { return (double)(ifc.speed_incoming + ifc.speed_outgoing) * 8 / btokb; });
+        }
+
+        auto const& meminfo = memory_.meminfo;
+        catalog["ram_available"] = {[&meminfo] { return (double)meminfo[memory::mem_available] / kbtogb; }, memory_feed};
+        catalog["ram_usage"] = {[this] { return memory_usage(); }, memory_feed};
+        catalog["ram_swapusage"] = {[&meminfo] {
+            auto total = meminfo[memory::swap_total];
+            return total == 0 ? 0 : (double)(total - meminfo[memory::swap_free]) * 100 / (double)total;
+        }, memory_feed};
+        catalog["ram_dirty"] = {[&meminfo] { return (double)meminfo[memory::dirty] / kbtogb; }, memory_feed};
+        catalog["ram_writeback"] = {[&meminfo] { return (double)meminfo[memory::writeback] / kbtogb; }, memory_feed};
+        catalog["ram_hugepages_free"] = {[&meminfo] { return (double)meminfo[memory::hugepages_free]; }, memory_feed};
+        catalog["vm_pgfault_rate"] = {[this] { return (double)vm_rates_.rate(memory::pgfault); }, memory_feed};
+        catalog["vm_pgmajfault_rate"] = {[this] { return (double)vm_rates_.rate(memory::pgmajfault); }, memory_feed};
+        catalog["vm_pswpin_rate"] = {[this] { return (double)vm_rates_.rate(memory::pswpin); }, memory_feed};
+        catalog["vm_pswpout_rate"] = {[this] { return (double)vm_rates_.rate(memory::pswpout); }, memory_feed};
+        catalog["vm_oom_kill_rate"] = {[this] { return (double)vm_rates_.rate(memory::oom_kill); }, memory_feed};
+
+        catalog["cpu_usage"] = {[this] { return (double)cpu_usage; }, cpu_feed};
+        catalog["cpu_load_1m"] = {[this] { return (double)cpu_loads[0]; }, cpu_feed};
+        catalog["cpu_load_5m"] = {[this] { return (double)cpu_loads[1]; }, cpu_feed};
+        catalog["cpu_load_15m"] = {[this] { return (double)cpu_loads[2]; }, cpu_feed};
+
+        for (auto const & sensor : sensors_.temperatures())
+            catalog["sn_temp_"+sensor.name] = {[&sensor] { return sensor.value; }, sensors_feed};
+        for (auto const & sensor : sensors_.fans())
+            catalog["sn_fan_"+sensor.name] = {[&sensor] { return sensor.value; }, sensors_feed};
+        catalog["cpu_throttled"] = {[this] { return (double)sensors_.throttled() * 100; }, sensors_feed};
+
+        for (auto const & node : numa_nodes_) {
+            auto prefix = "numa_" + std::to_string(node.id) + "_";
+            catalog[prefix+"mem_usage"] = {[&node] { return node.mem_total == 0 ? 0 : (double)(node.mem_total - node.mem_free) * 100 / (double)node.mem_total; }, numa_feed};
+            catalog[prefix+"miss_rate"] = {[&node] { return (double)node.miss_rate; }, numa_feed};
+            catalog[prefix+"foreign_rate"] = {[&node] { return (double)node.foreign_rate; }, numa_feed};
+            catalog[prefix+"cpu_usage"] = {[&node] { return (double)node.cpu_usage; }, numa_feed};
+        }
+
+        return catalog;
+    }
+
+    // Bit of a collector in the feeds of the alert rules, by its position in collectors_
+    [[nodiscard]] alerts::feeds feed(std::string_view name) const {
+        auto it = collectors_.find(name);
+        return it == collectors_.end() ? 0 : alerts::feeds{1} << std::distance(collectors_.begin(), it);
+    }
+
+    // Each sampling function updates the collector state and returns the signal driving its rate
+    double sample_cpu() {
+        cpu::retrieve_cpu_loads(cpu_loads); // load and usage is updated every 5s by sysinfo
+        cpu::retrieve_cpu_usage(cpu_usage, cpu_loads, cpu_cores);
+        return cpu_usage;
+    }
+
+    double sample_memory() {
+        memory::retrieve(memory_, memory_buffer_);
+        vm_rates_.update(rates::now(), memory_.vmstat);
+        return memory_usage();
+    }
+
+    [[nodiscard]] double memory_usage() const {
+        auto total = memory_.meminfo[memory::mem_total];
+        return total == 0 ? 0 : (double)(total - memory_.meminfo[memory::mem_available]) * 100 / (double)total;
+    }
+
+    double sample_numa() {
+        if ( numa_nodes_.empty() ) return 0;
+
+        numa::retrieve(numa_nodes_, numa_buffer_);
+        numa::update(numa_nodes_, rates::now());
+
+        // imbalance is what host wide numbers hide, follow the spread between nodes
+        auto [min, max] = std::minmax_element(numa_nodes_.begin(), numa_nodes_.end(),
+            [](numa::node const& a, numa::node const& b) { return a.cpu_usage < b.cpu_usage; });
+        return max->cpu_usage - min->cpu_usage;
+    }
+
+    template <typename Output>
+    void publish_agent(Output& out) {
+        auto now = sampling::clock::now();
+        double cpu_time = agent_usage_.cpu_time;
+        agent::retrieve_usage(agent_usage_, agent_buffer_);
+
+        if ( agent_ts_ != sampling::clock::time_point{} ) {
+            auto elapsed = std::chrono::duration<double>(now - agent_ts_).count();
+            if ( elapsed > 0 )
+                agent_cpu_usage_ = (agent_usage_.cpu_time - cpu_time) * 100 / elapsed;
+        }
+        agent_ts_ = now;
+
+        put(out, "agent_rss", std::trunc( (float)agent_usage_.rss / 1024 * 100 ) / 100); // MB
+        put(out, "agent_cpu_usage", std::trunc( agent_cpu_usage_ * 1000 ) / 1000); // % of a core
+        put(out, "agent_cpu_time", std::trunc( agent_usage_.cpu_time * 100 ) / 100);
+        put(out, "agent_fds", agent_usage_.fds);
+        put(out, "agent_threads", agent_usage_.threads);
+
+        // latencies in microseconds
+        auto latencies = [&out](agent_keys const& keys, agent::histogram const& h) {
+            put(out, keys.latency_p50, (unsigned long)h.quantile(0.5));
+            put(out, keys.latency_p99, (unsigned long)h.quantile(0.99));
+            put(out, keys.latency_max, (unsigned long)h.max());
+            put(out, keys.count, (unsigned long)h.count());
+        };
+        latencies(keys_.monitor, monitor_latency_);
+        auto keys = keys_.collectors.begin();
+        for (auto const& [name, collector] : collectors_) {
+            latencies(*keys, collector.latency);
+            put(out, keys->overruns, collector.overruns);
+            ++keys;
+        }
+    }
+
+    // Sets a published value, values already in a json are assigned in place so publishing into
+    // the same json again does not allocate
+    template <typename Output, typename Value>
+    static void put(Output& out, const char* key, Value const& value) {
+        if constexpr ( std::is_same_v<Output, nlohmann::json> ) {
+            if ( auto it = out.find(key); it != out.end() ) {
+                if constexpr ( std::is_convertible_v<Value const&, std::string_view> ) {
+                    if ( it->is_string() ) {
+                        it->template get_ref<std::string&>() = value;
+                        return;
+                    }
+                }
+                *it = value;
+                return;
             }
         }
+        out[key] = value;
+    }
+
+    template <typename Output, typename Value>
+    static void put(Output& out, std::string const& key, Value const& value) {
+        put(out, key.c_str(), value);
+    }
+
+    // Published names of the devices, sensors, nodes and collectors, built when they change
+    void build_keys(bool defaults) {
+        auto device = [defaults](std::string const& prefix, std::string const& name, bool front) {
+            return prefix + "_" + (front && defaults ? std::string("default") : name) + "_";
+        };
+
+        keys_.filesystems.clear();
+        for (auto const & fs : filesystems_) {
+            auto prefix = device("st", fs.path, &fs == &filesystems_.front());
+            keys_.filesystems.push_back({prefix+"capacity", prefix+"used", prefix+"free", prefix+"usage"});
+        }
+
+        keys_.drives.clear();
+        for (auto const & dv : drives_) {
+            auto prefix = device("dv", dv.name, &dv == &drives_.front());
+            keys_.drives.push_back({prefix+"speed_read", prefix+"speed_written", prefix+"usage"});
+        }
+
+        keys_.interfaces.clear();
+        for (auto const & ifc : interfaces_) {
+            auto prefix = device("nw", ifc.name, &ifc == &interfaces_.front());
+            keys_.interfaces.push_back({prefix+"internal_ip", prefix+"transfer_incoming", prefix+"transfer_outgoing", prefix+"transfer_total",
+                prefix+"packetloss_incoming", prefix+"packetloss_outgoing", prefix+"speed_incoming", prefix+"speed_outgoing", prefix+"speed_total"});
+        }
+
+        keys_.temperatures.clear();
+        for (auto const & sensor : sensors_.temperatures())
+            keys_.temperatures.push_back("sn_temp_"+sensor.name);
+        keys_.fans.clear();
+        for (auto const & sensor : sensors_.fans())
+            keys_.fans.push_back("sn_fan_"+sensor.name);
+        keys_.cores.clear();
+        for (auto const & core : sensors_.cores()) {
+            auto prefix = "cpu_" + std::to_string(core.id) + "_";
+            keys_.cores.push_back({prefix+"freq", prefix+"freq_max"});
+        }
+
+        keys_.numa.clear();
+        for (auto const & node : numa_nodes_) {
+            auto prefix = "numa_" + std::to_string(node.id) + "_";
+            keys_.numa.push_back({prefix+"mem_total", prefix+"mem_used", prefix+"mem_usage", prefix+"miss_rate", prefix+"foreign_rate", prefix+"cpu_usage"});
+        }
+
+        auto agent = [](std::string const& prefix) {
+            return agent_keys{prefix+"_latency_p50", prefix+"_latency_p99", prefix+"_latency_max", prefix+"_count", prefix+"_overruns"};
+        };
+        keys_.monitor = agent("agent_monitor");
+        keys_.collectors.clear();
+        for (auto const& [name, collector] : collectors_)
+            keys_.collectors.push_back(agent("agent_"+name));
+    }
+
+    double sample_sensors() {
+        sensors_.read(rates::now());
+        return sensors_.max_temperature();
+    }
+
+    double sample_storage() {
+        storage::retrieve_fs_stats(filesystems_);
+        double usage = 0;
+        for (auto const & fs : filesystems_) {
+            if ( fs.space_info.capacity > 0 )
+                usage = std::max(usage, (double)(fs.space_info.capacity - fs.space_info.free) * 100 / (double)fs.space_info.capacity);
+        }
+        return usage;
     }
 
-    void retrieve_restart_status() {
-        fs::path f("/var/run/reboot-required");
-        if (fs::exists(f)) {
-            system_restart = true;
-        } else {
-            system_restart = false;
+    double sample_io() {
+        io::retrieve_dv_stats(drives_);
+        auto at = rates::now();
+        double usage = 0;
+        for (auto & dv : drives_) {
+            dv.io_rates.update(at, dv.total_io);
+            dv.speed_read = dv.io_rates.rate(0) * SECTOR_SIZE;
+            dv.speed_written = dv.io_rates.rate(1) * SECTOR_SIZE;
+            dv.usage = dv.io_rates.rate(2) / 1000; // ms in io per second
+            usage = std::max(usage, (double)dv.usage * 100);
         }
+        return usage;
+    }
+
+    double sample_network() {
+        network::retrieve_ifc_stats(interfaces_);
+        auto at = rates::now();
+        double speed = 0;
+        for (auto & ifc : interfaces_) {
+            ifc.transfer_rates.update(at, ifc.total_transfer);
+            ifc.speed_incoming = ifc.transfer_rates.rate(0);
+            ifc.speed_outgoing = ifc.transfer_rates.rate(1);
+            speed += ifc.speed_incoming + ifc.speed_outgoing;
+        }
+        // traffic spans orders of magnitude, thresholds are expressed in doublings of kbps
+        return std::log2(1 + speed * 8 / btokb);
     }
 
     static std::string cmd(const char *in) {
@@ -545,6 +1254,7 @@ private:
     std::unordered_map<std::string, iotmp::iotmp_resource&> resources_;
 
     Config& config_;
+    thinger::iotmp::client& client_;
 
     struct future_task {
         std::string task;
@@ -554,7 +1264,6 @@ private:
 
     // network
     std::vector<network::interface> interfaces_;
-    std::string public_ip;
 
     // storage
     std::vector<storage::filesystem> filesystems_;
@@ -567,35 +1276,124 @@ private:
     std::string os_version;
     std::string kernel_version;
     std::string uptime;
-    unsigned int normal_updates = 0;
-    unsigned int security_updates = 0;
-    bool system_restart = false;
 
     // CPU
-    std::array<float, 3> cpu_loads; // 1, 5 and 15 mins loads
-    float cpu_usage;
+    std::array<float, 3> cpu_loads{}; // 1, 5 and 15 mins loads
+    float cpu_usage = 0;
     unsigned int cpu_cores;
     unsigned int cpu_procs;
 
-    // ram
-    unsigned long ram_total;
-    unsigned long ram_available;
-    unsigned long ram_swaptotal;
-    unsigned long ram_swapfree;
+    // ram, /proc/meminfo and /proc/vmstat are parsed together into a reused buffer
+    memory::stats memory_;
+    rates::counters<memory::vmstat_fields> vm_rates_; // of the vmstat counters, per second
+    std::string memory_buffer_;
+
+    // numa
+    std::vector<numa::node> numa_nodes_;
+    std::string numa_buffer_;
+
+    // sensors
+    sensors::collector sensors_;
 
     // timing variables
-    unsigned long every5s = 0;
     unsigned long every1m = 0;
-    unsigned long every5m = 0;
-    unsigned long every1d = 0;
 
-    // thinger.io platform
-    std::string console_version;
+    // state kept across restarts
+    nlohmann::json warm_ = nlohmann::json::object(); // restored on start, counters until the devices are created
+    std::mutex state_mutex_; // the sampler and shutdown may save at once
+    bool state_failed_ = false;
+
+    // slow probes over the network, thinger.io platform and package manager
+    probes::executor probes_;
+    std::shared_ptr<probes::probe<std::string>> public_ip_probe_;
+    std::shared_ptr<probes::probe<std::string>> console_version_probe_;
+    std::shared_ptr<probes::probe<system::updates>> updates_probe_;
 
     // local server for resources
     httplib::Server server_;
     std::jthread svr_jthread;
 
+    // sampling, floor and ceiling in seconds may be overridden from resources/sampling/<collector>
+    struct collector {
+        double (Client::*sample)();
+        sampling::policy defaults;
+        sampling::adaptive schedule{defaults};
+        agent::histogram latency{};
+        unsigned long overruns = 0;
+    };
+    std::map<std::string, collector, std::less<>> collectors_{
+        {"cpu",     {&Client::sample_cpu,     {std::chrono::seconds(5), std::chrono::seconds(30), 4, 1, std::chrono::milliseconds(50)}}},
+        {"memory",  {&Client::sample_memory,  {std::chrono::seconds(1), std::chrono::seconds(30), 1, 0.5, std::chrono::milliseconds(50)}}},
+        {"storage", {&Client::sample_storage, {std::chrono::seconds(10), std::chrono::seconds(60), 0.25, 0.05, std::chrono::milliseconds(50)}}},
+        {"io",      {&Client::sample_io,      {std::chrono::seconds(1), std::chrono::seconds(30), 25, 10, std::chrono::milliseconds(50)}}},
+        {"network", {&Client::sample_network, {std::chrono::seconds(1), std::chrono::seconds(30), 0.5, 1, std::chrono::milliseconds(50)}}},
+        {"numa",    {&Client::sample_numa,    {std::chrono::seconds(5), std::chrono::seconds(30), 4, 1, std::chrono::milliseconds(50)}}},
+        {"sensors", {&Client::sample_sensors, {std::chrono::seconds(2), std::chrono::seconds(30), 1, 0.5, std::chrono::milliseconds(50)}}},
+    };
+
+    alerts::engine alerts_;
+
+    batch::columns batch_;
+    std::vector<alerts::source> batch_sources_;
+    std::vector<alerts::feeds> series_feeds_; // collectors updating each series
+    std::vector<double> batch_row_;
+
+    history::store history_;
+    std::mutex history_mutex_; // guards history between sampler and local server
+
+    // agent self metrics, over collectors and the monitor resource
+    agent::histogram monitor_latency_;
+    agent::usage agent_usage_;
+    double agent_cpu_usage_ = 0;
+    sampling::clock::time_point agent_ts_{};
+    std::string agent_buffer_;
+
+    pressure::stall psi_cpu_;
+    pressure::stall psi_io_;
+    pressure::stall psi_mem_;
+    float psi_contention_ = 10;
+    float psi_memory_ = 10;
+    unsigned int psi_backoff_ = 4;
+    sampling::clock::time_point next_psi_{};
+
+    // names of the published values, see build_keys
+    struct filesystem_keys { std::string capacity, used, free, usage; };
+    struct drive_keys { std::string speed_read, speed_written, usage; };
+    struct interface_keys {
+        std::string internal_ip, transfer_incoming, transfer_outgoing, transfer_total, packetloss_incoming, packetloss_outgoing,
+            speed_incoming, speed_outgoing, speed_total;
+    };
+    struct core_keys { std::string freq, freq_max; };
+    struct node_keys { std::string mem_total, mem_used, mem_usage, miss_rate, foreign_rate, cpu_usage; };
+    struct agent_keys { std::string latency_p50, latency_p99, latency_max, count, overruns; };
+    struct {
+        std::vector<filesystem_keys> filesystems;
+        std::vector<drive_keys> drives;
+        std::vector<interface_keys> interfaces;
+        std::vector<std::string> temperatures;
+        std::vector<std::string> fans;
+        std::vector<core_keys> cores;
+        std::vector<node_keys> numa;
+        agent_keys monitor;
+        std::vector<agent_keys> collectors; // in the order of collectors_
+    } keys_;
+
+    std::mutex sample_mutex_; // guards collectors state between sampler and resources
+    std::condition_variable_any sampler_cv_;
+    std::atomic<bool> reschedule_ = false;
+    std::jthread sampler_jthread;
+
+    push::schedule push_; // only used by the pusher thread
+    push::policy push_policy_;
+    bool push_changed_ = false;
+    std::mutex push_mutex_; // guards the policy between reloads and the pusher
+    std::condition_variable_any pusher_cv_;
+    std::atomic<bool> repush_ = false;
+    std::jthread pusher_jthread;
+
+    std::mutex reconfigure_mutex_; // property updates and local file edits are applied one at a time
+    std::shared_ptr<const config::snapshot> applied_;
+
     };
 
 }
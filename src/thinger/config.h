@@ -1,22 +1,40 @@
 #include <nlohmann/json.hpp>
 
+#include "monitor/sampling.h"
+#include "monitor/alerts.h"
+#include "monitor/history.h"
+#include "monitor/push.h"
+
+#include <atomic>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <iostream>
 #include <fstream>
 #include <random>
 #include <regex>
+#include <type_traits>
 
 constexpr std::string_view DF_CONFIG_PATH = "/etc/thinger_io/thinger_monitor.json";
 
 namespace thinger::monitor::config {
 
     template< typename T >
-    T get(nlohmann::json j, const nlohmann::json::json_pointer& p, T fallback) {
+    T get(nlohmann::json const& j, const nlohmann::json::json_pointer& p, T fallback) {
 
+        // a missing value, one of another type or a negative one for an unsigned field gives the
+        // fallback, so a bad remote property does not break the whole configuration
         try {
-            return j.at(p);
+            auto const& value = j.at(p);
+            if constexpr ( std::is_unsigned_v<T> && !std::is_same_v<T, bool> ) {
+                if ( value.is_number_integer() && !value.is_number_unsigned() && value.template get<long long>() < 0 )
+                    return fallback;
+            }
+            return value;
         } catch (nlohmann::json::out_of_range const&) {
             return fallback;
+        } catch (nlohmann::json::type_error const&) {
+            return fallback;
         }
     }
 
@@ -24,11 +42,12 @@ namespace thinger::monitor::config {
 
 namespace thinger::monitor::utils {
 
-    bool is_placeholder(const std::string& value) {
-        return std::regex_match(value, std::regex("(<.*>)"));
+    inline bool is_placeholder(const std::string& value) {
+        static const std::regex placeholder("(<.*>)");
+        return std::regex_match(value, placeholder);
     }
 
-    std::string generate_credentials(std::size_t length) {
+    inline std::string generate_credentials(std::size_t length) {
 
         const std::string CHARACTERS = "0123456789abcdefghijklmnopqrstuvwxyz!@#$%^&*()ABCDEFGHIJKLMNOPQRSTUVWXYZ";
 
@@ -47,6 +66,198 @@ namespace thinger::monitor::utils {
 
 }
 
+namespace thinger::monitor::config {
+
+    struct storage_settings {
+        std::string bucket;
+        std::string region;
+        std::string access_key;
+        std::string secret_key;
+    };
+
+    // Typed and immutable view of the local and remote configuration, rebuilt on every change and
+    // shared with readers, which keep using the one they hold while a newer one is published
+    struct snapshot {
+
+        // local
+        std::string url;
+        std::string user;
+        std::string id;
+        std::string name;
+        std::string credentials;
+        bool ssl = true;
+        std::string root;
+        std::string state = "/var/lib/thinger_io/thinger_monitor_state.json"; // empty disables it
+
+        // resources
+        bool defaults = false;
+        std::vector<std::string> filesystems;
+        std::vector<std::string> drives;
+        std::vector<std::string> interfaces;
+        float pressure_contention = 10;
+        float pressure_memory = 10;
+        unsigned int pressure_backoff = 4;
+        std::vector<alerts::definition> alerts;
+        history::retention history;
+        push::policy push;
+        std::string svr_host = "0.0.0.0";
+        unsigned short svr_port = 7890;
+
+        // backups and storage
+        std::string backup;
+        std::string storage;
+        std::string data_path = "/data";
+        std::string compose_path = "/root/";
+        bool backup_stream = false; // uploads to S3 while the archive is written, without a local copy nor resuming
+        unsigned int backup_concurrency = 4; // parts uploaded to, or ranges downloaded from, S3 at once
+        std::chrono::hours backup_stale_uploads{24}; // unfinished S3 uploads older than this are aborted
+        std::map<std::string, storage_settings, std::less<>> storages;
+
+        nlohmann::json local;
+        nlohmann::json remote;
+
+        [[nodiscard]] storage_settings const& find_storage(std::string_view st) const {
+            static const storage_settings none;
+            auto it = storages.find(st);
+            return it != storages.end() ? it->second : none;
+        }
+
+        // sampling, floor and ceiling in seconds may be overridden from resources/sampling/<collector>
+        [[nodiscard]] sampling::policy sampling_policy(std::string const& collector, sampling::policy p) const {
+            auto jp = nlohmann::json::json_pointer("/resources/sampling/"+collector);
+            nlohmann::json j = config::get(remote, jp, nlohmann::json({}));
+
+            // intervals are configured in seconds
+            p.floor = std::chrono::milliseconds(static_cast<long>(config::get(j, "/floor"_json_pointer, (double)p.floor.count() / 1000) * 1000));
+            p.ceiling = std::chrono::milliseconds(static_cast<long>(config::get(j, "/ceiling"_json_pointer, (double)p.ceiling.count() / 1000) * 1000));
+            p.floor = std::max(p.floor, sampling::policy::min_floor);
+            p.ceiling = std::max(p.ceiling, p.floor);
+            p.variance = config::get(j, "/variance"_json_pointer, p.variance);
+            p.rate = config::get(j, "/rate"_json_pointer, p.rate);
+            p.budget = std::chrono::milliseconds(config::get(j, "/budget"_json_pointer, (long)p.budget.count()));
+
+            return p;
+        }
+
+    };
+
+    // Parts of the configuration reconfigured on their own when they change
+    namespace changed {
+        constexpr unsigned int connection = 1 << 0; // server, device or host root
+        constexpr unsigned int devices    = 1 << 1; // defaults, filesystems, drives and interfaces
+        constexpr unsigned int sampling   = 1 << 2;
+        constexpr unsigned int alerts     = 1 << 3;
+        constexpr unsigned int history    = 1 << 4;
+        constexpr unsigned int push       = 1 << 5;
+        constexpr unsigned int server     = 1 << 6; // local server host and port
+        constexpr unsigned int backups    = 1 << 7; // backups and storage
+        constexpr unsigned int all        = ~0u;
+    }
+
+    inline std::vector<std::string> strings(nlohmann::json const& j, const nlohmann::json::json_pointer& p) {
+        std::vector<std::string> values;
+        for (auto const& v : config::get(j, p, nlohmann::json::array()))
+            if ( v.is_string() ) values.push_back(v.get<std::string>());
+        return values;
+    }
+
+    inline std::string unless_placeholder(std::string value) {
+        return utils::is_placeholder(value) ? "" : value;
+    }
+
+    inline snapshot parse(nlohmann::json const& local, nlohmann::json const& remote) {
+        snapshot s;
+
+        s.url = config::get(local, "/server/url"_json_pointer, std::string(""));
+        s.user = config::get(local, "/server/user"_json_pointer, std::string(""));
+        s.id = unless_placeholder(config::get(local, "/device/id"_json_pointer, std::string("")));
+        s.name = unless_placeholder(config::get(local, "/device/name"_json_pointer, std::string("")));
+        s.credentials = unless_placeholder(config::get(local, "/device/credentials"_json_pointer, std::string("")));
+        s.ssl = config::get(local, "/server/ssl"_json_pointer, s.ssl);
+        s.root = config::get(local, "/host/root"_json_pointer, std::string(""));
+        s.state = config::get(local, "/host/state"_json_pointer, s.state);
+
+        s.defaults = config::get(remote, "/resources/defaults"_json_pointer, s.defaults);
+        s.filesystems = strings(remote, "/resources/filesystems"_json_pointer);
+        s.drives = strings(remote, "/resources/drives"_json_pointer);
+        s.interfaces = strings(remote, "/resources/interfaces"_json_pointer);
+        s.pressure_contention = config::get(remote, "/resources/sampling/pressure/contention"_json_pointer, s.pressure_contention);
+        s.pressure_memory = config::get(remote, "/resources/sampling/pressure/memory"_json_pointer, s.pressure_memory);
+        s.pressure_backoff = config::get(remote, "/resources/sampling/pressure/backoff"_json_pointer, s.pressure_backoff);
+
+        for (auto const& a : config::get(remote, "/resources/alerts"_json_pointer, nlohmann::json::array())) {
+            alerts::definition d;
+            d.name = config::get(a, "/name"_json_pointer, std::string(""));
+            d.rule = config::get(a, "/rule"_json_pointer, std::string(""));
+            if ( a.contains("clear") )
+                d.clear = config::get(a, "/clear"_json_pointer, 0.0);
+            d.endpoint = config::get(a, "/endpoint"_json_pointer, std::string(""));
+            s.alerts.push_back(d);
+        }
+
+        s.history.raw = config::get(remote, "/resources/history/raw"_json_pointer, s.history.raw);
+        s.history.minutes = config::get(remote, "/resources/history/minutes"_json_pointer, s.history.minutes);
+        s.history.hours = config::get(remote, "/resources/history/hours"_json_pointer, s.history.hours);
+
+        // interval in seconds, pushing is disabled by default
+        nlohmann::json j = config::get(remote, "/resources/push"_json_pointer, nlohmann::json({}));
+        s.push.interval = std::chrono::milliseconds(static_cast<long>(config::get(j, "/interval"_json_pointer, 0.0) * 1000));
+        s.push.endpoint = config::get(j, "/endpoint"_json_pointer, s.push.endpoint);
+        s.push.max_backoff = std::chrono::milliseconds(static_cast<long>(config::get(j, "/max_backoff"_json_pointer, (double)s.push.max_backoff.count() / 1000) * 1000));
+
+        s.svr_host = config::get(remote, "/resources/server/host"_json_pointer, s.svr_host);
+        s.svr_port = config::get(remote, "/resources/server/port"_json_pointer, s.svr_port);
+
+        s.backup = config::get(remote, "/backups/system"_json_pointer, std::string(""));
+        s.storage = config::get(remote, "/backups/storage"_json_pointer, std::string(""));
+        s.data_path = config::get(remote, "/backups/data_path"_json_pointer, s.data_path);
+        s.compose_path = config::get(remote, "/backups/compose_path"_json_pointer, s.compose_path);
+        s.backup_stream = config::get(remote, "/backups/stream"_json_pointer, s.backup_stream);
+        s.backup_concurrency = std::max(config::get(remote, "/backups/concurrency"_json_pointer, s.backup_concurrency), 1u);
+        s.backup_stale_uploads = std::chrono::hours(std::max(config::get(remote, "/backups/stale_uploads"_json_pointer, (long)s.backup_stale_uploads.count()), 1L));
+        j = config::get(remote, "/storage"_json_pointer, nlohmann::json::object());
+        for (auto const& st : j.is_object() ? j.items() : nlohmann::json::object().items()) {
+            storage_settings settings;
+            settings.bucket = config::get(st.value(), "/bucket"_json_pointer, std::string(""));
+            settings.region = config::get(st.value(), "/region"_json_pointer, std::string(""));
+            settings.access_key = config::get(st.value(), "/access_key"_json_pointer, std::string(""));
+            settings.secret_key = config::get(st.value(), "/secret_key"_json_pointer, std::string(""));
+            s.storages.emplace(st.key(), std::move(settings));
+        }
+
+        s.local = local;
+        s.remote = remote;
+        return s;
+    }
+
+    // Parts changed from one snapshot to another
+    inline unsigned int diff(snapshot const& a, snapshot const& b) {
+        auto subtree = [&a, &b](const nlohmann::json::json_pointer& p) {
+            return config::get(a.remote, p, nlohmann::json()) != config::get(b.remote, p, nlohmann::json());
+        };
+
+        unsigned int c = 0;
+        if ( a.url != b.url || a.user != b.user || a.id != b.id || a.name != b.name || a.credentials != b.credentials || a.ssl != b.ssl || a.root != b.root )
+            c |= changed::connection;
+        if ( a.defaults != b.defaults || a.filesystems != b.filesystems || a.drives != b.drives || a.interfaces != b.interfaces )
+            c |= changed::devices;
+        if ( subtree("/resources/sampling"_json_pointer) )
+            c |= changed::sampling;
+        if ( subtree("/resources/alerts"_json_pointer) )
+            c |= changed::alerts;
+        if ( a.history.raw != b.history.raw || a.history.minutes != b.history.minutes || a.history.hours != b.history.hours )
+            c |= changed::history;
+        if ( a.push.interval != b.push.interval || a.push.endpoint != b.push.endpoint || a.push.max_backoff != b.push.max_backoff )
+            c |= changed::push;
+        if ( a.svr_host != b.svr_host || a.svr_port != b.svr_port )
+            c |= changed::server;
+        if ( subtree("/backups"_json_pointer) || subtree("/storage"_json_pointer) )
+            c |= changed::backups;
+        return c;
+    }
+
+}
+
 namespace thinger::monitor {
 
     class Config {
@@ -57,10 +268,12 @@ namespace thinger::monitor {
         Config() {
             path_ = std::string(DF_CONFIG_PATH);
             load_config();
+            publish();
         }
 
         explicit Config(std::string_view path) : path_(path) {
             load_config();
+            publish();
         }
 
         bool update(std::string const& property, pson& data) {
@@ -68,40 +281,69 @@ namespace thinger::monitor {
           nlohmann::json remote_config;
           protoson::json_decoder::to_json(data, remote_config);
 
+          return update(property, remote_config);
+        }
+
+        bool update(std::string const& property, nlohmann::json const& remote_config) {
+
+          std::scoped_lock lock(write_mutex_);
           if (remote_config != config_remote_[property]) {
                 config_remote_[property] = remote_config;
+                publish();
 
                 return true;
             }
             return false;
         }
 
+        // Reads the file again, false when its content did not change
+        bool reload() {
+            std::scoped_lock lock(write_mutex_);
+            auto previous = config_local_;
+            load_config();
+            if ( config_local_ == previous )
+                return false;
+            publish();
+            return true;
+        }
+
         /* Setters */
         void set_path(std::string_view path) {
+            std::scoped_lock lock(write_mutex_);
             path_ = path;
             load_config();
+            publish();
         }
 
         void set_url(std::string_view url) {
-            config_local_["server"]["url"] = url;
+            set_local("/server/url"_json_pointer, url);
         }
 
         void set_user(std::string_view user) {
-            config_local_["server"]["user"] = user;
+            set_local("/server/user"_json_pointer, user);
         }
 
         void set_ssl(bool ssl) {
-            config_local_["server"]["ssl"] = ssl;
+            set_local("/server/ssl"_json_pointer, ssl);
+        }
+
+        void set_root(std::string_view root) {
+            set_local("/host/root"_json_pointer, root);
+        }
+
+        void set_state(std::string_view state) {
+            set_local("/host/state"_json_pointer, state);
         }
 
         void set_device() {
+            std::scoped_lock lock(write_mutex_);
             // Check if device name exists, if not set it to hostname
-            if (this->get_id().empty()) {
+            if (snapshot()->id.empty()) {
                 std::string hostname;
                 std::ifstream hostinfo ("/etc/hostname", std::ifstream::in);
                 hostinfo >> hostname;
 
-                if (this->get_name().empty())
+                if (snapshot()->name.empty())
                     config_local_["device"]["name"] = hostname;
 
                 // device_id can't use some chars
@@ -119,99 +361,144 @@ namespace thinger::monitor {
                 }
                 config_local_["device"]["id"] = device_id;
             }
-            if (this->get_credentials().empty()) {
+            if (snapshot()->credentials.empty()) {
                 config_local_["device"]["credentials"] = utils::generate_credentials(16);
             }
+            publish();
             save_config();
         }
 
+        // Current configuration, readers holding it are not affected by later updates
+        [[nodiscard]] std::shared_ptr<const config::snapshot> snapshot() const {
+            return snapshot_.load(std::memory_order_acquire);
+        }
+
         /* Getters */
+        [[nodiscard]] std::string get_path() const {
+            std::scoped_lock lock(write_mutex_);
+            return path_;
+        }
+
         [[nodiscard]] std::string get_url() const {
-            return config::get(config_local_, "/server/url"_json_pointer, std::string(""));
+            return snapshot()->url;
         }
 
         [[nodiscard]] std::string get_user() const {
-
-            return config::get(config_local_, "/server/user"_json_pointer, std::string(""));
+            return snapshot()->user;
         }
 
         [[nodiscard]] std::string get_id() const {
-            const std::string id = config::get(config_local_, "/device/id"_json_pointer, std::string(""));
-            return utils::is_placeholder(id) ? "" : id;
+            return snapshot()->id;
         }
 
         [[nodiscard]] std::string get_name() const {
-            const std::string name = config::get(config_local_, "/device/name"_json_pointer, std::string(""));
-            return utils::is_placeholder(name) ? "" : name;
+            return snapshot()->name;
         }
 
         [[nodiscard]] std::string get_credentials() const {
-            const std::string credentials = config::get(config_local_, "/device/credentials"_json_pointer, std::string(""));
-            return utils::is_placeholder(credentials) ? "" : credentials;
+            return snapshot()->credentials;
         }
 
         [[nodiscard]] bool get_ssl() const {
-            return config::get(config_local_, "/server/ssl"_json_pointer, true);
+            return snapshot()->ssl;
+        }
+
+        // Where the host filesystem is mounted, i.e., "/host" when running in a container
+        [[nodiscard]] std::string get_root() const {
+            return snapshot()->root;
+        }
+
+        // File keeping counters and probe results across restarts
+        [[nodiscard]] std::string get_state() const {
+            return snapshot()->state;
         }
 
         [[nodiscard]] bool get_defaults() const {
-            return config::get(config_remote_, "/resources/defaults"_json_pointer, false);
+            return snapshot()->defaults;
+        }
+
+        [[nodiscard]] std::vector<std::string> get_filesystems() const {
+            return snapshot()->filesystems;
+        }
+
+        [[nodiscard]] std::vector<std::string> get_drives() const {
+            return snapshot()->drives;
+        }
+
+        [[nodiscard]] std::vector<std::string> get_interfaces() const {
+            return snapshot()->interfaces;
+        }
+
+        [[nodiscard]] sampling::policy get_sampling(std::string const& collector, sampling::policy p) const {
+            return snapshot()->sampling_policy(collector, p);
+        }
+
+        [[nodiscard]] float get_pressure_contention() const {
+            return snapshot()->pressure_contention;
+        }
+
+        [[nodiscard]] float get_pressure_memory() const {
+            return snapshot()->pressure_memory;
+        }
+
+        [[nodiscard]] unsigned int get_pressure_backoff() const {
+            return snapshot()->pressure_backoff;
         }
 
-        [[nodiscard]] nlohmann::json get_filesystems() const {
-            return config::get(config_remote_, "/resources/filesystems"_json_pointer, nlohmann::json({}));
+        [[nodiscard]] std::vector<alerts::definition> get_alerts() const {
+            return snapshot()->alerts;
         }
 
-        [[nodiscard]] nlohmann::json get_drives() const {
-            return config::get(config_remote_, "/resources/drives"_json_pointer, nlohmann::json({}));
+        [[nodiscard]] history::retention get_history() const {
+            return snapshot()->history;
         }
 
-        [[nodiscard]] nlohmann::json get_interfaces() const {
-          return config::get(config_remote_, "/resources/interfaces"_json_pointer, nlohmann::json({}));
+        [[nodiscard]] push::policy get_push() const {
+            return snapshot()->push;
         }
 
         [[nodiscard]] std::string get_svr_host() const {
-          return config::get(config_remote_, "/resources/server/host"_json_pointer, std::string("0.0.0.0"));
+          return snapshot()->svr_host;
         }
 
         [[nodiscard]] unsigned short get_svr_port() const {
-          return config::get(config_remote_, "/resources/server/port"_json_pointer, (unsigned short) 7890);
+          return snapshot()->svr_port;
         }
 
         [[nodiscard]] std::string get_storage() const {
-            return config::get(config_remote_, "/backups/storage"_json_pointer, std::string(""));
+            return snapshot()->storage;
         }
 
         [[nodiscard]] std::string get_data_path() const {
-            return config::get(config_remote_, "/backups/data_path"_json_pointer, std::string("/data"));
+            return snapshot()->data_path;
         }
 
         [[nodiscard]] std::string get_compose_path() const {
-            return config::get(config_remote_, "/backups/compose_path"_json_pointer, std::string("/root/"));
+            return snapshot()->compose_path;
         }
 
         [[nodiscard]] std::string get_bucket(std::string const& st) const {
-            auto jp = nlohmann::json::json_pointer("/storage/"+st+"/bucket");
-            return config::get(config_remote_, jp, std::string(""));
+            return snapshot()->find_storage(st).bucket;
         }
 
         [[nodiscard]] std::string get_region(std::string const& st) const {
-            auto jp = nlohmann::json::json_pointer("/storage/"+st+"/region");
-            return config::get(config_remote_, jp, std::string(""));
+            return snapshot()->find_storage(st).region;
         }
 
         [[nodiscard]] std::string get_access_key(std::string const& st) const {
-            auto jp = nlohmann::json::json_pointer("/storage/"+st+"/access_key");
-            return config::get(config_remote_, jp, std::string(""));
+            return snapshot()->find_storage(st).access_key;
         }
 
         [[nodiscard]] std::string get_secret_key(std::string const& st) const {
-            auto jp = nlohmann::json::json_pointer("/storage/"+st+"/secret_key");
-            return config::get(config_remote_, jp, std::string(""));
+            return snapshot()->find_storage(st).secret_key;
         }
 
         [[nodiscard]] std::string get_backup() const {
-            return config::get(config_remote_, "/backups/system"_json_pointer, std::string(""));
+            return snapshot()->backup;
+        }
+
+        [[nodiscard]] nlohmann::json get_remote(std::string const& property) const {
+            return config::get(snapshot()->remote, nlohmann::json::json_pointer("/"+property), nlohmann::json({}));
         }
 
         [[nodiscard]] pson get(std::string const& property) const {
@@ -224,25 +511,48 @@ namespace thinger::monitor {
 
             auto jp = nlohmann::json::json_pointer("/"+property);
 
-            nlohmann::json j = config::get(config_remote_, jp, nlohmann::json({}));
+            nlohmann::json j = config::get(snapshot()->remote, jp, nlohmann::json({}));
             protoson::json_decoder::parse(j, p);
 
             return p;
         }
 
     private:
+        // only modified by writers holding write_mutex_, readers go through the snapshot
         nlohmann::json config_local_ ;
         nlohmann::json config_remote_;
 
         std::string path_;
 
+        mutable std::mutex write_mutex_;
+        std::atomic<std::shared_ptr<const config::snapshot>> snapshot_{std::make_shared<const config::snapshot>()};
+
+        // remote properties not received yet may be given in the local file
+        void publish() {
+            nlohmann::json remote = config_remote_;
+            for (auto const& property : remote_properties)
+                if ( config_local_.contains(property) && (!remote.contains(property) || remote[property].is_null()) )
+                    remote[property] = config_local_[property];
+            snapshot_.store(std::make_shared<const config::snapshot>(config::parse(config_local_, remote)), std::memory_order_release);
+        }
+
+        template <typename T>
+        void set_local(nlohmann::json::json_pointer const& p, T const& value) {
+            std::scoped_lock lock(write_mutex_);
+            config_local_[p] = value;
+            publish();
+        }
+
+        // Keeps the previous configuration when the file is being written or is not valid json
         void load_config() {
 
             std::filesystem::path f(path_);
 
             if (std::filesystem::exists(f)) {
                 std::ifstream config_file(path_);
-                config_file >> config_local_;
+                auto local = nlohmann::json::parse(config_file, nullptr, false);
+                if ( !local.is_discarded() )
+                    config_local_ = std::move(local);
             }
         }
 
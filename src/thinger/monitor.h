@@ -1,26 +1,45 @@
 
 #include <httplib.h>
+#include <fmt/format.h>
+
+#include "utils/http_status.h"
+#include "monitor/rates.h"
+#include "monitor/source.h"
 
 namespace thinger::monitor::network {
 
     struct interface {
         std::string name;
         std::string internal_ip;
-        std::array<std::array<unsigned long long int, 2>, 3> total_transfer; // before, after; b incoming, b outgoing, 3-> ts
-        std::array<unsigned long long, 4> total_packets; // incoming (total, dropped), outgoing (total, dropped)
+        std::array<unsigned long long, 2> total_transfer{}; // b incoming, b outgoing
+        std::array<unsigned long long, 4> total_packets{}; // incoming (total, dropped), outgoing (total, dropped)
+        rates::counters<2> transfer_rates; // of total_transfer
+        float speed_incoming = 0; // B/s
+        float speed_outgoing = 0; // B/s
     };
 
-    std::string getPublicIPAddress() {
-        httplib::Client cli("https://ifconfig.me");
-        auto res = cli.Get("/ip");
-        if ( res.error() == httplib::Error::SSLServerVerification ) {
-            httplib::Client cli("http://ifconfig.me");
-            res = cli.Get("/ip");
+    // Public address as seen by host, falling back to plain http when its certificate can not be verified
+    inline std::optional<std::string> getPublicIPAddress(std::chrono::milliseconds timeout = std::chrono::seconds(10), std::string const& host = "https://ifconfig.me") {
+        auto get = [&timeout](std::string const& url) {
+            httplib::Client cli(url);
+            cli.set_connection_timeout(timeout);
+            cli.set_read_timeout(timeout);
+            cli.set_write_timeout(timeout);
+            return cli.Get("/ip");
+        };
+
+        auto res = get(host);
+        if ( res.error() == httplib::Error::SSLServerVerification && host.starts_with("https://") ) {
+            res = get("http://" + host.substr(8));
         }
+
+        if ( !res || res.error() != httplib::Error::Success || !HttpStatus::isSuccessful(res->status) )
+            return std::nullopt;
+
         return res->body;
     }
 
-    std::string getIPAddress(const std::string_view& interface){
+    inline std::string getIPAddress(const std::string_view& interface){
         std::string ipAddress="Unable to get IP Address";
         struct ifaddrs *interfaces = nullptr;
         struct ifaddrs *temp_addr = nullptr;
@@ -46,28 +65,37 @@ namespace thinger::monitor::network {
         return ipAddress;
     }
 
-    void retrieve_ifc_stats(std::vector<interface>& interfaces) {
-        for (auto & ifc : interfaces) {
-
-            std::ifstream netinfo ("/proc/net/dev", std::ifstream::in);
-            std::string line;
-            std::string null;
-
-            while(netinfo >> line) {
-                if (line == ifc.name+":") {
-                    netinfo >> ifc.total_transfer[0][1]; //first bytes inc
-                    netinfo >> ifc.total_packets[0]; // total packets inc
-                    netinfo >> null >> ifc.total_packets[1]; // drop packets inc
-                    netinfo >> null >> null >> null >> null >> ifc.total_transfer[1][1]; // total bytes out
-                    netinfo >> ifc.total_packets[2]; // total packets out
-                    netinfo >> null >> ifc.total_packets[3]; // drop packets out
+    inline void retrieve_ifc_stats(std::vector<interface>& interfaces) {
+        thread_local std::string content; // reused between ticks
+        source::read("/proc/net/dev", content);
 
-                    ifc.total_transfer[2][1] = std::chrono::duration_cast<std::chrono::milliseconds>(
-                      std::chrono::system_clock::now().time_since_epoch()).count();
+        for (auto & ifc : interfaces) {
 
-                    break;
-                }
+            // lines are "  <name>: <16 counters>"
+            std::string_view netinfo(content);
+            std::size_t pos = 0;
+            while ( (pos = netinfo.find(ifc.name, pos)) != std::string_view::npos ) {
+                auto end = pos + ifc.name.size();
+                bool line_start = pos == 0 || netinfo[pos - 1] == ' ' || netinfo[pos - 1] == '\n';
+                if ( line_start && end < netinfo.size() && netinfo[end] == ':' ) break;
+                pos = end;
+            }
+            if ( pos == std::string_view::npos ) continue;
+
+            std::array<unsigned long long, 12> fields{};
+            const char* p = content.c_str() + pos + ifc.name.size() + 1;
+            for (auto & field : fields) {
+                char* next;
+                field = std::strtoull(p, &next, 10);
+                p = next;
             }
+
+            ifc.total_transfer[0] = fields[0]; // bytes inc
+            ifc.total_packets[0] = fields[1];  // total packets inc
+            ifc.total_packets[1] = fields[3];  // drop packets inc
+            ifc.total_transfer[1] = fields[8]; // total bytes out
+            ifc.total_packets[2] = fields[9];  // total packets out
+            ifc.total_packets[3] = fields[11]; // drop packets out
         }
     }
 
@@ -77,21 +105,33 @@ namespace thinger::monitor::io {
 
     struct drive {
         std::string name;
-        std::array<std::array<unsigned long long int, 4>, 2> total_io; // before, after; sectors read, sectors writte, io tics, ts
+        std::string stat; // path of the stat file, built on the first read
+        std::array<unsigned long long, 3> total_io{}; // sectors read, sectors written, io ticks
+        rates::counters<3> io_rates; // of total_io
+        float speed_read = 0; // B/s
+        float speed_written = 0; // B/s
+        float usage = 0; // ratio of time spent doing io
     };
 
-    void retrieve_dv_stats(std::vector<drive>& drives) {
+    inline void retrieve_dv_stats(std::vector<drive>& drives) {
+        thread_local std::string content; // reused between ticks
         for(auto & dv : drives) {
 
-            std::ifstream dvinfo ("/sys/block/"+dv.name+"/stat", std::ifstream::in);
-            std::string null;
+            if ( dv.stat.empty() )
+                dv.stat = "/sys/block/"+dv.name+"/stat";
+            if ( !source::read(dv.stat, content) ) continue;
 
-            dvinfo >> null >> null >> dv.total_io[1][0]; // sectors read [0]
-            dvinfo >> null >> null >> null >> dv.total_io[1][1]; // sectors written [1]
-            dvinfo >> null >> null >> dv.total_io[1][2]; // io ticks -> time spent in io [2]
+            std::array<unsigned long long, 10> fields{};
+            const char* p = content.c_str();
+            for (auto & field : fields) {
+                char* next;
+                field = std::strtoull(p, &next, 10);
+                p = next;
+            }
 
-            dv.total_io[1][3] = std::chrono::duration_cast<std::chrono::milliseconds>( // millis [3]
-              std::chrono::system_clock::now().time_since_epoch()).count();
+            dv.total_io[0] = fields[2]; // sectors read
+            dv.total_io[1] = fields[6]; // sectors written
+            dv.total_io[2] = fields[9]; // io ticks -> ms spent in io
         }
     }
 
@@ -104,9 +144,9 @@ namespace thinger::monitor::storage {
         std::filesystem::space_info space_info;
     };
 
-    void retrieve_fs_stats(std::vector<filesystem>& filesystems) {
+    inline void retrieve_fs_stats(std::vector<filesystem>& filesystems) {
         for (auto & fs : filesystems) {
-            fs.space_info = std::filesystem::space(fs.path);
+            fs.space_info = source::space(fs.path);
         }
     }
 
@@ -114,15 +154,19 @@ namespace thinger::monitor::storage {
 
 namespace thinger::monitor::cpu {
 
-    void retrieve_cpu_cores(unsigned int& cores) {
+    inline void retrieve_cpu_cores(unsigned int& cores) {
         cores = std::thread::hardware_concurrency();
     }
 
     template <size_t N>
     void retrieve_cpu_loads(std::array<float, N>& loads) {
-        std::ifstream loadinfo ("/proc/loadavg", std::ifstream::in);
+        thread_local std::string content; // reused between ticks
+        if ( !source::read("/proc/loadavg", content) ) return;
+        const char* p = content.c_str();
         for (auto i = 0; i < 3; i++) {
-            loadinfo >> loads[i];
+            char* next;
+            loads[i] = std::strtof(p, &next);
+            p = next;
         }
     }
 
@@ -131,11 +175,12 @@ namespace thinger::monitor::cpu {
         usage = loads[0] * 100 / cores;
     }
 
-    void retrieve_cpu_procs(unsigned int& procs) {
-        std::string path = "/proc";
+    inline void retrieve_cpu_procs(unsigned int& procs) {
+        thread_local std::vector<std::string> entries; // reused between refreshes
+        source::list("/proc", entries);
         procs = 0;
-        for (const auto & entry : std::filesystem::directory_iterator(path)) {
-            if (entry.is_directory() && isdigit(entry.path().u8string().back()))  {
+        for (const auto & entry : entries) {
+            if (!entry.empty() && isdigit(entry.back()))  {
                 procs++;
             }
         }
@@ -143,38 +188,40 @@ namespace thinger::monitor::cpu {
 
 }
 
-namespace thinger::monitor::memory {
+namespace thinger::monitor::pressure {
 
-    void retrieve_ram(unsigned long& total, unsigned long& free, unsigned long& swp_total, unsigned long& swp_free) {
+    struct stall {
+        float some = 0; // avg10 percentage of time at least one task was stalled
+        float full = 0; // avg10 percentage of time all non idle tasks were stalled
+    };
 
-        std::ifstream raminfo ("/proc/meminfo", std::ifstream::in);
-        std::string line;
+    // Pressure Stall Information is available from kernel 4.20, otherwise values are left at 0
+    inline void retrieve_psi(std::string_view resource, stall& psi) {
 
-        while(raminfo >> line) {
-            if (line == "MemTotal:") {
-                raminfo >> total;
-            } else if (line == "MemAvailable:") {
-                raminfo >> free;
-            } else if (line == "SwapTotal:") {
-                raminfo >> swp_total;
-            } else if (line == "SwapFree:") {
-                raminfo >> swp_free;
-                // From /proc/meminfo order once we reach available we may stop reading
-                break;
-            }
+        thread_local std::string content; // reused between ticks
+        if ( !source::read("/proc/pressure/", resource, content) ) return;
+
+        // lines are "some avg10=0.00 avg60=0.00 avg300=0.00 total=0"
+        for (std::string_view line : {std::string_view("some"), std::string_view("full")}) {
+            auto pos = content.find(line);
+            if ( pos == std::string::npos ) continue;
+            pos = content.find('=', pos);
+            if ( pos == std::string::npos ) continue;
+            (line == "some" ? psi.some : psi.full) = std::strtof(content.c_str() + pos + 1, nullptr);
         }
     }
+
 }
 
 namespace thinger::monitor::system {
 
-    void retrieve_hostname(std::string& hostname) {
-        std::ifstream hostinfo ("/etc/hostname", std::ifstream::in);
+    inline void retrieve_hostname(std::string& hostname) {
+        auto hostinfo = source::stream("/etc/hostname");
         hostinfo >> hostname;
     }
 
-    void retrieve_os_version(std::string& os_version) {
-        std::ifstream osinfo ("/etc/os-release", std::ifstream::in);
+    inline void retrieve_os_version(std::string& os_version) {
+        auto osinfo = source::stream("/etc/os-release");
         std::string line;
 
         while(std::getline(osinfo,line)) {
@@ -187,8 +234,8 @@ namespace thinger::monitor::system {
         }
     }
 
-    void retrieve_kernel_version(std::string& kernel_version) {
-        std::ifstream kernelinfo ("/proc/version", std::ifstream::in);
+    inline void retrieve_kernel_version(std::string& kernel_version) {
+        auto kernelinfo = source::stream("/proc/version");
         std::string version;
 
         kernelinfo >> kernel_version;
@@ -198,31 +245,60 @@ namespace thinger::monitor::system {
         kernel_version = kernel_version + " " + version;
     }
 
-    void retrieve_uptime(std::string& uptime) {
-        double uptime_seconds;
-        if (std::ifstream("/proc/uptime", std::ios::in) >> uptime_seconds) {
-            int days = (int)uptime_seconds / (60*60*24);
-            int hours = ((int)uptime_seconds % (((days > 0) ? days : 1)*60*60*24)) / (60*60);
-            int minutes = (int)uptime_seconds % (((days > 0) ? days : 1)*60*60*24) % (((hours > 0) ? hours: 1)*60*60) / 60;
-            uptime =
-              ((days > 0) ? std::to_string(days)+((days == 1) ? " day, ":" days, ") : "") +
-              ((hours > 0) ? std::to_string(hours)+((hours == 1) ? " hour, ":" hours, ") : "") +
-              std::to_string(minutes)+((minutes == 1) ? " minute":" minutes");
+    struct updates {
+        unsigned int normal = 0;
+        unsigned int security = 0;
+        bool restart = false;
+    };
+
+    inline void retrieve_updates(updates& u) {
+        // We will use default ubuntu server notifications, the counts start the first two lines
+        thread_local std::string content; // reused between refreshes
+        if ( source::read("/var/lib/update-notifier/updates-available", content) ) {
+            char* next;
+            u.normal = std::strtoul(content.c_str(), &next, 10);
+            auto line = std::strchr(next, '\n');
+            u.security = line ? std::strtoul(line + 1, nullptr, 10) : 0;
         }
+
+        u.restart = source::read("/var/run/reboot-required", content);
+    }
+
+    inline void retrieve_uptime(std::string& uptime) {
+        thread_local std::string content; // reused between refreshes
+        if ( !source::read("/proc/uptime", content) ) return;
+        char* next;
+        double uptime_seconds = std::strtod(content.c_str(), &next);
+        if ( next == content.c_str() ) return;
+
+        int days = (int)uptime_seconds / (60*60*24);
+        int hours = ((int)uptime_seconds % (((days > 0) ? days : 1)*60*60*24)) / (60*60);
+        int minutes = (int)uptime_seconds % (((days > 0) ? days : 1)*60*60*24) % (((hours > 0) ? hours: 1)*60*60) / 60;
+
+        // formatted in place, so a refresh reuses the capacity of uptime
+        uptime.clear();
+        auto out = std::back_inserter(uptime);
+        if ( days > 0 ) fmt::format_to(out, "{} {}, ", days, days == 1 ? "day" : "days");
+        if ( hours > 0 ) fmt::format_to(out, "{} {}, ", hours, hours == 1 ? "hour" : "hours");
+        fmt::format_to(out, "{} {}", minutes, minutes == 1 ? "minute" : "minutes");
     }
 }
 
 namespace thinger::monitor::platform {
 
-    void getConsoleVersion(std::string& console_version) {
-        httplib::Client cli("http://127.0.0.1");
+    inline std::optional<std::string> getConsoleVersion(std::chrono::milliseconds timeout = std::chrono::seconds(10), std::string const& host = "http://127.0.0.1") {
+        httplib::Client cli(host);
+        cli.set_connection_timeout(timeout);
+        cli.set_read_timeout(timeout);
         auto res = cli.Get("/v1/server/version");
-        if (res.error() != httplib::Error::Success) {
-            console_version = "Could not retrieve";
-        } else {
-            auto res_json = nlohmann::json::parse(res->body);
-            console_version = res_json["version"].get<std::string>();
+        if (!res || res.error() != httplib::Error::Success || !HttpStatus::isSuccessful(res->status)) {
+            return std::nullopt;
         }
+
+        auto res_json = nlohmann::json::parse(res->body, nullptr, false);
+        if ( res_json.is_discarded() || !res_json.contains("version") )
+            return std::nullopt;
+        return res_json["version"].get<std::string>();
   }
 
 }
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "../utils/file.h"
+
+namespace thinger::monitor::agent {
+
+    // Latency histogram with power of two buckets in microseconds, recording is a couple of
+    // relaxed atomic increments so it can be left on every collector and resource call.
+    class histogram {
+
+    public:
+
+        static constexpr std::size_t buckets = 32; // [0, 1), [1, 2), [2, 4) ... up to ~35 minutes
+
+        histogram() = default;
+
+        // Copies are snapshots, counters recorded concurrently may be split between them
+        histogram(histogram const& other) {
+            for (std::size_t i = 0; i < buckets; i++)
+                counts_[i].store(other.counts_[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            count_.store(other.count(), std::memory_order_relaxed);
+            sum_.store(other.sum_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            max_.store(other.max(), std::memory_order_relaxed);
+        }
+
+        histogram& operator=(histogram const&) = delete;
+
+        void record(std::chrono::nanoseconds elapsed) {
+            auto us = static_cast<std::uint64_t>(std::max<std::int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+            auto bucket = std::min<std::size_t>(std::bit_width(us), buckets - 1);
+            counts_[bucket].fetch_add(1, std::memory_order_relaxed);
+            count_.fetch_add(1, std::memory_order_relaxed);
+            sum_.fetch_add(us, std::memory_order_relaxed);
+            auto max = max_.load(std::memory_order_relaxed);
+            while ( us > max && !max_.compare_exchange_weak(max, us, std::memory_order_relaxed) ) {}
+        }
+
+        [[nodiscard]] std::uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+        [[nodiscard]] std::uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+        [[nodiscard]] double mean() const {
+            auto c = count();
+            return c == 0 ? 0 : (double)sum_.load(std::memory_order_relaxed) / (double)c;
+        }
+
+        // Upper bound in microseconds of the bucket holding the q quantile
+        [[nodiscard]] std::uint64_t quantile(double q) const {
+            auto c = count();
+            if ( c == 0 ) return 0;
+            auto rank = static_cast<std::uint64_t>(q * (double)c);
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < buckets; i++) {
+                seen += counts_[i].load(std::memory_order_relaxed);
+                if ( seen > rank ) return std::min(std::uint64_t(1) << i, max());
+            }
+            return max();
+        }
+
+    private:
+
+        std::array<std::atomic<std::uint64_t>, buckets> counts_{};
+        std::atomic<std::uint64_t> count_{0};
+        std::atomic<std::uint64_t> sum_{0};
+        std::atomic<std::uint64_t> max_{0};
+
+    };
+
+    // Records the lifetime of the scope into a histogram
+    class timer {
+
+    public:
+
+        explicit timer(histogram& h) : histogram_(h), start_(std::chrono::steady_clock::now()) {}
+
+        ~timer() {
+            histogram_.record(elapsed());
+        }
+
+        timer(timer const&) = delete;
+        timer& operator=(timer const&) = delete;
+
+        [[nodiscard]] std::chrono::nanoseconds elapsed() const {
+            return std::chrono::steady_clock::now() - start_;
+        }
+
+    private:
+
+        histogram& histogram_;
+        std::chrono::steady_clock::time_point start_;
+
+    };
+
+    struct usage {
+        unsigned long long rss = 0;  // kB
+        double cpu_time = 0;         // seconds in user and kernel mode
+        unsigned int threads = 0;
+        unsigned int fds = 0;
+    };
+
+    // Parses /proc/<pid>/stat, fields after the command name which may contain spaces
+    inline void parse_stat(std::string_view content, usage& u, long ticks, long page_size) {
+
+        auto end = content.rfind(')');
+        if ( end == std::string_view::npos ) return;
+
+        // field 3 is the state right after the command name
+        unsigned int field = 3;
+        unsigned long long utime = 0, stime = 0;
+        for (auto i = end + 2; i < content.size(); field++) {
+            auto next = content.find(' ', i);
+            if ( next == std::string_view::npos ) next = content.size();
+
+            unsigned long long value = 0;
+            for (auto j = i; j < next && content[j] >= '0' && content[j] <= '9'; j++)
+                value = value * 10 + (content[j] - '0');
+
+            if ( field == 14 ) utime = value;
+            else if ( field == 15 ) stime = value;
+            else if ( field == 20 ) u.threads = static_cast<unsigned int>(value);
+            else if ( field == 24 ) {
+                u.rss = value * page_size / 1024;
+                break;
+            }
+            i = next + 1;
+        }
+
+        u.cpu_time = (double)(utime + stime) / (double)ticks;
+    }
+
+    // Resources used by this process
+    inline void retrieve_usage(usage& u, std::string& buffer) {
+
+        static const long ticks = sysconf(_SC_CLK_TCK);
+        static const long page_size = sysconf(_SC_PAGESIZE);
+
+        if ( ::utils::file::read("/proc/self/stat", buffer) )
+            parse_stat(buffer, u, ticks, page_size);
+
+        // listed into a stack buffer, as directory iterators allocate on every call
+        u.fds = 0;
+        int fd = ::open("/proc/self/fd", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if ( fd < 0 ) return;
+        alignas(dirent64) char entries[4096];
+        for (long n; (n = ::syscall(SYS_getdents64, fd, entries, sizeof(entries))) > 0; ) {
+            for (long pos = 0; pos < n; ) {
+                auto const* entry = reinterpret_cast<dirent64 const*>(entries + pos);
+                if ( entry->d_name[0] != '.' ) u.fds++;
+                pos += entry->d_reclen;
+            }
+        }
+        ::close(fd);
+        if ( u.fds > 0 ) u.fds--; // the descriptor used to list them
+    }
+
+}
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace thinger::monitor::alerts {
+
+    using clock = std::chrono::steady_clock;
+
+    // Reads the current value of a metric by its published name, i.e., st_/_usage
+    using source = std::function<double()>;
+
+    // Collectors as bits, a pass of the sampler hands the ones it sampled to evaluate
+    using feeds = std::uint32_t;
+    constexpr feeds every_feed = ~feeds{0};
+
+    struct metric {
+        source read;
+        feeds fed_by = every_feed; // collectors updating the metric
+        bool alias = false;        // published under another name, only looked up by rules
+    };
+    using catalog = std::unordered_map<std::string, metric>;
+
+    enum class comparison { greater, greater_equal, less, less_equal };
+
+    struct expression {
+        std::string metric;
+        bool rate = false; // compare the rate of change per second instead of the value
+        comparison op = comparison::greater;
+        double threshold = 0;
+        std::chrono::milliseconds duration{0}; // condition must hold this long before firing
+    };
+
+    struct definition {
+        std::string name;
+        std::string rule;     // i.e., "st_/_usage > 90 for 2m" or "nw_eth0_packetloss_incoming rate > 10"
+        std::optional<double> clear; // hysteresis level to clear, defaults to the threshold
+        std::string endpoint; // endpoint called when the alert fires or clears
+    };
+
+    struct event {
+        std::string name;
+        std::string rule;
+        std::string endpoint;
+        bool firing;
+        double value;
+        double threshold;
+    };
+
+    // Parses "<metric> [rate] <op> <threshold> [for <duration>]". Metric tokens separated by
+    // spaces are joined with '_', so "st_/ usage > 90" and "st_/_usage > 90" are equivalent.
+    inline std::optional<expression> parse(std::string const& rule) {
+
+        std::istringstream ss(rule);
+        std::vector<std::string> tokens;
+        std::string token;
+        while ( ss >> token )
+            tokens.push_back(token);
+
+        expression e;
+
+        std::size_t i = 0;
+        for (; i < tokens.size(); i++) {
+            auto const& t = tokens[i];
+            if ( t == ">" || t == ">=" || t == "<" || t == "<=" ) break;
+            if ( t == "rate" ) {
+                e.rate = true;
+                continue;
+            }
+            e.metric += e.metric.empty() ? t : "_" + t;
+        }
+
+        if ( e.metric.empty() || i + 1 >= tokens.size() ) return std::nullopt;
+
+        if ( tokens[i] == ">" ) e.op = comparison::greater;
+        else if ( tokens[i] == ">=" ) e.op = comparison::greater_equal;
+        else if ( tokens[i] == "<" ) e.op = comparison::less;
+        else e.op = comparison::less_equal;
+
+        char* end = nullptr;
+        e.threshold = std::strtod(tokens[i+1].c_str(), &end);
+        if ( end == tokens[i+1].c_str() ) return std::nullopt;
+
+        i += 2;
+        if ( i == tokens.size() ) return e;
+        if ( tokens[i] != "for" || i + 2 != tokens.size() ) return std::nullopt;
+
+        // duration with s, m or h units, seconds when no unit is given
+        auto const& d = tokens[i+1];
+        double amount = std::strtod(d.c_str(), &end);
+        if ( end == d.c_str() || amount < 0 ) return std::nullopt;
+        std::string_view unit(end);
+        double ms = 1000;
+        if ( unit == "m" ) ms = 60 * 1000;
+        else if ( unit == "h" ) ms = 60 * 60 * 1000;
+        else if ( !unit.empty() && unit != "s" ) return std::nullopt;
+        e.duration = std::chrono::milliseconds(static_cast<long long>(amount * ms));
+
+        return e;
+    }
+
+    // Rules are compiled into a flat table bound to the metric sources, so evaluating them
+    // on every sample does not involve any lookup.
+    class engine {
+
+    public:
+
+        // Returns the names of the rules that could not be compiled
+        std::vector<std::string> compile(std::vector<definition> const& definitions, catalog const& metrics) {
+
+            std::vector<std::string> failed;
+            std::vector<entry> table;
+
+            for (auto const& d : definitions) {
+                auto e = parse(d.rule);
+                auto metric = e ? metrics.find(e->metric) : metrics.end();
+                if ( metric == metrics.end() ) {
+                    failed.push_back(d.name);
+                    continue;
+                }
+
+                entry en{d, *e, metric->second.read, metric->second.fed_by};
+                en.clear = d.clear.value_or(e->threshold);
+
+                // keep the state of rules that did not change
+                for (auto const& previous : table_) {
+                    if ( previous.def.name == d.name && previous.def.rule == d.rule ) {
+                        en.firing = previous.firing;
+                        en.pending = previous.pending;
+                        en.since = previous.since;
+                        en.last_value = previous.last_value;
+                        en.last_ts = previous.last_ts;
+                        break;
+                    }
+                }
+                table.push_back(std::move(en));
+            }
+
+            table_ = std::move(table);
+            return failed;
+        }
+
+        // Rules on metrics whose collectors were not sampled are skipped, so a rate spans the
+        // samples of its metric and a stale value does not restart a duration
+        void evaluate(clock::time_point now, std::vector<event>& events, feeds sampled = every_feed) {
+
+            for (auto& en : table_) {
+
+                if ( (en.fed_by & sampled) == 0 ) continue;
+
+                double value = en.read();
+
+                if ( en.expr.rate ) {
+                    double previous = en.last_value;
+                    auto previous_ts = en.last_ts;
+                    en.last_value = value;
+                    en.last_ts = now;
+                    if ( previous_ts == clock::time_point{} || now <= previous_ts ) continue;
+                    value = (value - previous) / std::chrono::duration<double>(now - previous_ts).count();
+                }
+
+                en.value = value;
+
+                if ( !en.firing ) {
+                    if ( !holds(en.expr.op, value, en.expr.threshold) ) {
+                        en.pending = false;
+                        continue;
+                    }
+                    if ( !en.pending ) {
+                        en.pending = true;
+                        en.since = now;
+                    }
+                    if ( now - en.since >= en.expr.duration ) {
+                        en.firing = true;
+                        en.pending = false;
+                        events.push_back({en.def.name, en.def.rule, en.def.endpoint, true, value, en.expr.threshold});
+                    }
+                } else if ( !holds(en.expr.op, value, en.clear) ) { // hysteresis, clears once the clear level is crossed
+                    en.firing = false;
+                    events.push_back({en.def.name, en.def.rule, en.def.endpoint, false, value, en.clear});
+                }
+            }
+        }
+
+        [[nodiscard]] std::size_t size() const { return table_.size(); }
+
+        [[nodiscard]] std::size_t firing() const {
+            std::size_t count = 0;
+            for (auto const& en : table_)
+                if ( en.firing ) count++;
+            return count;
+        }
+
+    private:
+
+        struct entry {
+            definition def;
+            expression expr;
+            source read;
+            feeds fed_by = every_feed;
+            double clear = 0;
+
+            bool firing = false;
+            bool pending = false;
+            clock::time_point since{};
+
+            double value = 0;
+            double last_value = 0;
+            clock::time_point last_ts{};
+        };
+
+        std::vector<entry> table_;
+
+        static bool holds(comparison op, double value, double threshold) {
+            switch (op) {
+                case comparison::greater:       return value > threshold;
+                case comparison::greater_equal: return value >= threshold;
+                case comparison::less:          return value < threshold;
+                case comparison::less_equal:    return value <= threshold;
+            }
+            return false;
+        }
+
+    };
+
+}
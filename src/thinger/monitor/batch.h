@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../utils/gorilla.h"
+
+namespace thinger::monitor::batch {
+
+    // Samples of a fixed set of series kept as columns, a timestamp column and one value column
+    // per series, each compressed as it grows so holding a batch costs a few bits per sample.
+    //
+    // Encoded layout, integers are little endian varints:
+    //   series count, sample count, then for each series its name length and name,
+    //   then the timestamps column and each values column as length and gorilla bytes
+    class columns {
+
+    public:
+
+        explicit columns(std::size_t capacity = 600) : capacity_(capacity) {}
+
+        // Starts over with another set of series, i.e., after the devices are reconfigured
+        void reset(std::vector<std::string> names) {
+            names_ = std::move(names);
+            clear();
+        }
+
+        // Columns keep their bytes, so a batch filled again after being read does not allocate
+        void clear() {
+            timestamps_.clear();
+            values_.resize(names_.size());
+            for (auto& column : values_)
+                column.clear();
+        }
+
+        // Appends a row with a value per series in the order of names, a full batch starts over
+        // so an unread batch does not grow without bound
+        void append(std::int64_t timestamp_ms, std::vector<double> const& row) {
+            if ( row.size() != names_.size() ) return;
+            if ( size() >= capacity_ ) clear();
+            timestamps_.append(timestamp_ms);
+            for (std::size_t i = 0; i < row.size(); i++)
+                values_[i].append(row[i]);
+        }
+
+        [[nodiscard]] std::size_t size() const { return timestamps_.size(); }
+
+        [[nodiscard]] std::vector<std::string> const& names() const { return names_; }
+
+        [[nodiscard]] std::string encode() const {
+            std::string out;
+            write_varint(out, names_.size());
+            write_varint(out, size());
+            for (auto const& name : names_) {
+                write_varint(out, name.size());
+                out.append(name);
+            }
+            write_varint(out, timestamps_.bytes().size());
+            out.append(timestamps_.bytes());
+            for (auto const& column : values_) {
+                write_varint(out, column.bytes().size());
+                out.append(column.bytes());
+            }
+            return out;
+        }
+
+        static void write_varint(std::string& out, std::uint64_t value) {
+            while ( value >= 0x80 ) {
+                out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+                value >>= 7;
+            }
+            out.push_back(static_cast<char>(value));
+        }
+
+    private:
+
+        std::size_t capacity_;
+        std::vector<std::string> names_;
+        ::utils::gorilla::timestamp_encoder timestamps_;
+        std::vector<::utils::gorilla::value_encoder> values_;
+
+    };
+
+    struct decoded {
+        std::vector<std::string> names;
+        std::vector<std::int64_t> timestamps;
+        std::vector<std::vector<double>> values; // a column per series
+    };
+
+    namespace detail {
+
+        inline bool read_varint(std::string_view& in, std::uint64_t& value) {
+            value = 0;
+            for (unsigned int shift = 0; shift < 64; shift += 7) {
+                if ( in.empty() ) return false;
+                auto byte = static_cast<unsigned char>(in.front());
+                in.remove_prefix(1);
+                value |= std::uint64_t(byte & 0x7f) << shift;
+                if ( (byte & 0x80) == 0 ) return true;
+            }
+            return false;
+        }
+
+        inline bool read_bytes(std::string_view& in, std::string_view& bytes) {
+            std::uint64_t size;
+            if ( !read_varint(in, size) || size > in.size() ) return false;
+            bytes = in.substr(0, size);
+            in.remove_prefix(size);
+            return true;
+        }
+
+    }
+
+    // Decodes a batch produced by columns::encode, nothing when it is truncated or malformed
+    inline std::optional<decoded> decode(std::string_view in) {
+        decoded d;
+        std::uint64_t series, samples;
+        if ( !detail::read_varint(in, series) || !detail::read_varint(in, samples) ) return std::nullopt;
+        if ( series > in.size() || samples > in.size() * 8 ) return std::nullopt;
+
+        std::string_view bytes;
+        for (std::uint64_t i = 0; i < series; i++) {
+            if ( !detail::read_bytes(in, bytes) ) return std::nullopt;
+            d.names.emplace_back(bytes);
+        }
+
+        if ( !detail::read_bytes(in, bytes) ) return std::nullopt;
+        ::utils::gorilla::timestamp_decoder timestamps(bytes);
+        d.timestamps.resize(samples);
+        for (auto& ts : d.timestamps)
+            if ( !timestamps.next(ts) ) return std::nullopt;
+
+        d.values.resize(series);
+        for (auto& column : d.values) {
+            if ( !detail::read_bytes(in, bytes) ) return std::nullopt;
+            ::utils::gorilla::value_decoder values(bytes);
+            column.resize(samples);
+            for (auto& v : column)
+                if ( !values.next(v) ) return std::nullopt;
+        }
+
+        return d;
+    }
+
+}
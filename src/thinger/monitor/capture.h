@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Capture files hold the raw bytes of every file read by the collectors with the time of the
+// read, so a host can be replayed later. Records are
+//
+//   u8 kind, i64 nanoseconds since the start of the capture, u32 path size, path
+//   u32 content size, content (only for kind::content)
+//
+// in little endian after an 8 bytes magic. Files that did not change since their last read,
+// which are most of them, are stored as kind::same without content.
+namespace thinger::monitor::capture {
+
+    constexpr std::string_view magic = "THMCAP1\n";
+
+    enum class kind : std::uint8_t { content = 0, missing = 1, same = 2 };
+
+    namespace detail {
+
+        template <typename T>
+        void put(std::ostream& os, T value) {
+            for (std::size_t i = 0; i < sizeof(T); i++)
+                os.put(static_cast<char>((static_cast<std::uint64_t>(value) >> (i * 8)) & 0xff));
+        }
+
+        // Paths are looked up by the collectors as views, without building a string per read
+        struct path_hash {
+            using is_transparent = void;
+            std::size_t operator()(std::string_view path) const { return std::hash<std::string_view>{}(path); }
+        };
+
+        template <typename T>
+        bool get(std::istream& is, T& value) {
+            std::uint64_t v = 0;
+            for (std::size_t i = 0; i < sizeof(T); i++) {
+                int c = is.get();
+                if ( c == std::char_traits<char>::eof() ) return false;
+                v |= static_cast<std::uint64_t>(static_cast<unsigned char>(c)) << (i * 8);
+            }
+            value = static_cast<T>(v);
+            return true;
+        }
+
+    }
+
+    class recorder {
+
+    public:
+
+        explicit recorder(std::string const& path) :
+            file_(path, std::ios::binary | std::ios::trunc),
+            start_(std::chrono::steady_clock::now())
+        {
+            file_.write(magic.data(), magic.size());
+        }
+
+        [[nodiscard]] bool good() const { return file_.good(); }
+
+        // Safe to call from the sampler, resource and probe threads
+        void write(std::string_view path, bool found, std::string_view content) {
+            std::scoped_lock lock(mutex_);
+
+            // taken under the lock, so the records of a path are in time order
+            auto ts = std::chrono::steady_clock::now() - start_;
+
+            auto k = found ? kind::content : kind::missing;
+            auto [last, inserted] = last_.try_emplace(std::string(path), found, content);
+            if ( !inserted ) {
+                if ( last->second.first == found && last->second.second == content )
+                    k = kind::same;
+                else
+                    last->second = {found, std::string(content)};
+            }
+
+            detail::put(file_, static_cast<std::uint8_t>(k));
+            detail::put(file_, static_cast<std::int64_t>(ts.count()));
+            detail::put(file_, static_cast<std::uint32_t>(path.size()));
+            file_.write(path.data(), static_cast<std::streamsize>(path.size()));
+            if ( k == kind::content ) {
+                detail::put(file_, static_cast<std::uint32_t>(content.size()));
+                file_.write(content.data(), static_cast<std::streamsize>(content.size()));
+            }
+        }
+
+        void flush() {
+            std::scoped_lock lock(mutex_);
+            file_.flush();
+        }
+
+    private:
+
+        std::mutex mutex_;
+        std::ofstream file_;
+        std::chrono::steady_clock::time_point start_;
+        std::unordered_map<std::string, std::pair<bool, std::string>> last_; // to store unchanged files as kind::same
+    };
+
+    // Serves the recorded content of each path as it was at a given time of the capture
+    class replayer {
+
+    public:
+
+        // Returns false if the file is not a capture or it is truncated
+        bool load(std::string const& path) {
+            std::ifstream file(path, std::ios::binary);
+            std::string header(magic.size(), '\0');
+            if ( !file.read(header.data(), static_cast<std::streamsize>(header.size())) || header != magic )
+                return false;
+
+            for (;;) {
+                std::uint8_t k;
+                std::int64_t ts;
+                std::uint32_t size;
+                if ( !detail::get(file, k) ) break; // end of capture
+                if ( !detail::get(file, ts) || !detail::get(file, size) ) return false;
+
+                std::string name(size, '\0');
+                if ( !file.read(name.data(), size) ) return false;
+
+                auto& records = paths_[name];
+                record r{std::chrono::nanoseconds(ts)};
+                switch ( static_cast<kind>(k) ) {
+                    case kind::content:
+                        if ( !detail::get(file, size) ) return false;
+                        r.found = true;
+                        r.content = contents_.size();
+                        contents_.emplace_back(size, '\0');
+                        if ( !file.read(contents_.back().data(), size) ) return false;
+                        break;
+                    case kind::missing:
+                        break;
+                    case kind::same:
+                        if ( records.empty() ) return false;
+                        r.found = records.back().found;
+                        r.content = records.back().content;
+                        break;
+                    default:
+                        return false;
+                }
+                end_ = std::max(end_, r.ts);
+                records.push_back(r);
+            }
+            return true;
+        }
+
+        // Content of the path at ts, the first record when it was read for the first time later
+        bool read(std::string_view path, std::chrono::nanoseconds ts, std::string& buffer) const {
+            auto it = paths_.find(path);
+            if ( it == paths_.end() ) return false;
+
+            auto const& records = it->second;
+            auto next = std::upper_bound(records.begin(), records.end(), ts,
+                [](std::chrono::nanoseconds t, record const& r) { return t < r.ts; });
+            auto const& r = next == records.begin() ? *next : *(next - 1);
+
+            if ( !r.found ) return false;
+            buffer.assign(contents_[r.content]);
+            return true;
+        }
+
+        // Time of the last record
+        [[nodiscard]] std::chrono::nanoseconds end() const { return end_; }
+
+        [[nodiscard]] std::size_t size() const { return paths_.size(); }
+
+    private:
+
+        struct record {
+            std::chrono::nanoseconds ts{};
+            bool found = false;
+            std::size_t content = 0; // index in contents_, shared by unchanged reads
+        };
+
+        std::unordered_map<std::string, std::vector<record>, detail::path_hash, std::equal_to<>> paths_;
+        std::vector<std::string> contents_;
+        std::chrono::nanoseconds end_{};
+    };
+
+    // Records every file and directory of a tree as read from the root of a host, so a client can be
+    // built in replay mode over a fixture without touching the host
+    inline void snapshot(std::filesystem::path const& root, recorder& recorder) {
+        std::string buffer;
+
+        for (auto const& entry : std::filesystem::recursive_directory_iterator(root)) {
+            auto path = "/" + entry.path().lexically_relative(root).generic_string();
+            if ( entry.is_directory() ) {
+                std::vector<std::string> names;
+                for (auto const& child : std::filesystem::directory_iterator(entry.path()))
+                    names.push_back(child.path().filename().string());
+                std::sort(names.begin(), names.end());
+                buffer.clear();
+                for (auto const& name : names)
+                    buffer.append(name).append("\n");
+                recorder.write(path + "/", true, buffer);
+            } else if ( entry.is_regular_file() ) {
+                std::ifstream file(entry.path(), std::ios::binary);
+                buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+                if ( file ) recorder.write(path, true, buffer);
+            }
+        }
+    }
+
+}
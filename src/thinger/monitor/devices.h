@@ -0,0 +1,42 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace thinger::monitor::devices {
+
+    // Rebuilds devices in the order of the configured keys keeping the devices still configured,
+    // with their counters and baselines, so a reconfiguration does not disturb their rates. New
+    // devices are default constructed with their key and returned by index to be initialized, the
+    // removed ones are dropped. A key configured twice is kept once.
+    template <typename Device>
+    std::vector<std::size_t> reconcile(std::vector<Device>& devices, std::vector<std::string> const& keys, std::string Device::* key) {
+        std::map<std::string, Device*, std::less<>> existing;
+        for (auto& device : devices)
+            existing.emplace(device.*key, &device);
+
+        std::vector<Device> rebuilt;
+        std::vector<std::size_t> added;
+        rebuilt.reserve(keys.size());
+        std::set<std::string_view> seen;
+        for (auto const& k : keys) {
+            if ( !seen.insert(k).second ) continue;
+            auto it = existing.find(k);
+            if ( it != existing.end() ) {
+                rebuilt.push_back(std::move(*it->second));
+            } else {
+                rebuilt.emplace_back();
+                rebuilt.back().*key = k;
+                added.push_back(rebuilt.size() - 1);
+            }
+        }
+
+        devices = std::move(rebuilt);
+        return added;
+    }
+
+}
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace thinger::monitor::history {
+
+    constexpr std::int64_t minute_ms = 60 * 1000;
+    constexpr std::int64_t hour_ms = 60 * minute_ms;
+
+    // Aggregate of the samples in [ts, ts + period), a single sample at raw resolution
+    struct point {
+        std::int64_t ts = 0; // milliseconds since epoch
+        float min = 0;
+        float max = 0;
+        float avg = 0;
+        std::uint32_t count = 0;
+
+        void merge(point const& other) {
+            if ( count == 0 ) {
+                auto ts0 = ts;
+                *this = other;
+                ts = ts0;
+                return;
+            }
+            min = std::min(min, other.min);
+            max = std::max(max, other.max);
+            avg = (float)(((double)avg * count + (double)other.avg * other.count) / (count + other.count));
+            count += other.count;
+        }
+    };
+
+    // Points sorted by time in a fixed capacity ring, growing up to the capacity as they arrive
+    class ring {
+
+    public:
+
+        explicit ring(std::size_t capacity = 0) : capacity_(capacity) {}
+
+        void push(point const& p) {
+            if ( capacity_ == 0 ) return;
+            if ( points_.size() < capacity_ ) {
+                points_.push_back(p);
+            } else {
+                points_[head_] = p;
+                head_ = (head_ + 1) % capacity_;
+                dropped_ = true;
+            }
+        }
+
+        [[nodiscard]] std::size_t size() const { return points_.size(); }
+
+        // Whether older points were overwritten, or could not be kept at all
+        [[nodiscard]] bool dropped() const { return dropped_ || capacity_ == 0; }
+
+        // i-th oldest point
+        [[nodiscard]] point const& at(std::size_t i) const {
+            return points_[(head_ + i) % points_.size()];
+        }
+
+        // Index of the first point at or after ts
+        [[nodiscard]] std::size_t lower_bound(std::int64_t ts) const {
+            std::size_t first = 0, count = size();
+            while ( count > 0 ) {
+                auto half = count / 2;
+                if ( at(first + half).ts < ts ) {
+                    first += half + 1;
+                    count -= half + 1;
+                } else {
+                    count = half;
+                }
+            }
+            return first;
+        }
+
+    private:
+
+        std::size_t capacity_;
+        std::size_t head_ = 0; // oldest point once full
+        bool dropped_ = false;
+        std::vector<point> points_;
+
+    };
+
+    // Points kept at each resolution, i.e., ten minutes of raw samples at one per second, a week
+    // of minutes and three months of hours
+    struct retention {
+        std::size_t raw = 600;
+        std::size_t minutes = 7 * 24 * 60;
+        std::size_t hours = 90 * 24;
+    };
+
+    // Rollups of a metric updated as samples arrive: each sample goes to the raw ring and into the
+    // open minute, a closed minute into the minute ring and the open hour, and so on. Open buckets
+    // are part of the queries, so the latest minute or hour is never missing.
+    class series {
+
+    public:
+
+        static constexpr std::size_t levels = 3;
+
+        explicit series(retention const& r = {}) :
+            levels_{{{0, ring(r.raw), {}}, {minute_ms, ring(r.minutes), {}}, {hour_ms, ring(r.hours), {}}}} {}
+
+        // Samples older than the last one are dropped, the rings must stay sorted
+        void add(std::int64_t ts, double value) {
+            if ( samples_ > 0 && ts < last_ ) return;
+            last_ = ts;
+            samples_++;
+            auto v = (float)value;
+            feed(0, {ts, v, v, v, 1});
+        }
+
+        [[nodiscard]] std::uint64_t samples() const { return samples_; }
+
+        // Period in milliseconds of the finest resolution still holding from, 1 for raw samples
+        [[nodiscard]] std::int64_t resolution(std::int64_t from) const {
+            return std::max<std::int64_t>(levels_[pick(from, 0)].period, 1);
+        }
+
+        // Buckets of step milliseconds in [from, to) starting at from, read from the finest
+        // resolution that still holds from without being coarser than step. A step of 0 uses the
+        // resolution of from. Stops after limit buckets, returning where to resume.
+        template <typename F>
+        std::optional<std::int64_t> query(std::int64_t from, std::int64_t to, std::int64_t step, std::size_t limit, F&& emit) const {
+            if ( step <= 0 ) step = resolution(from);
+            auto index = pick(from, step);
+            auto const& l = levels_[index];
+
+            point bucket;
+            std::size_t emitted = 0;
+            std::optional<std::int64_t> resume;
+
+            auto add = [&](point const& p) {
+                if ( p.ts < from || p.ts >= to ) return true;
+                auto start = from + (p.ts - from) / step * step;
+                if ( bucket.count > 0 && bucket.ts != start ) {
+                    if ( emitted == limit ) {
+                        resume = bucket.ts;
+                        return false;
+                    }
+                    emit(bucket);
+                    emitted++;
+                    bucket = {};
+                }
+                bucket.ts = start;
+                bucket.merge(p);
+                return true;
+            };
+
+            for (auto i = l.points.lower_bound(from); i < l.points.size(); i++)
+                if ( l.points.at(i).ts >= to || !add(l.points.at(i)) ) break;
+            // the open bucket of each level is not yet in the next one
+            for (auto i = index; i > 0 && !resume; i--)
+                if ( levels_[i].open.count > 0 ) add(levels_[i].open);
+            if ( resume ) return resume;
+
+            if ( bucket.count > 0 ) {
+                if ( emitted == limit ) return bucket.ts;
+                emit(bucket);
+            }
+            return std::nullopt;
+        }
+
+    private:
+
+        struct level {
+            std::int64_t period; // 0 for raw samples
+            ring points;
+            point open; // bucket being filled, count 0 when empty
+        };
+
+        void feed(std::size_t i, point const& p) {
+            auto& l = levels_[i];
+            if ( l.period == 0 ) {
+                l.points.push(p);
+            } else {
+                auto start = p.ts - p.ts % l.period;
+                if ( l.open.count > 0 && l.open.ts != start ) {
+                    l.points.push(l.open);
+                    if ( i + 1 < levels ) feed(i + 1, l.open);
+                    l.open = {};
+                }
+                l.open.ts = start;
+                l.open.merge(p);
+            }
+            if ( i == 0 ) feed(1, p);
+        }
+
+        // Finest level holding every sample since from, else the coarsest one not coarser than step
+        std::size_t pick(std::int64_t from, std::int64_t step) const {
+            std::size_t coarsest = 0;
+            for (std::size_t i = 0; i < levels; i++) {
+                auto const& l = levels_[i];
+                if ( step > 0 && l.period > step ) break;
+                coarsest = i;
+                if ( !l.points.dropped() || (l.points.size() > 0 && l.points.at(0).ts <= from) ) return i;
+            }
+            return coarsest;
+        }
+
+        std::array<level, levels> levels_;
+        std::int64_t last_ = 0;
+        std::uint64_t samples_ = 0;
+
+    };
+
+    // Series by metric name
+    class store {
+
+    public:
+
+        explicit store(retention const& r = {}) : retention_(r) {}
+
+        // Keeps the series of the metrics still present and starts the new ones, values are then
+        // added in the order of names. Changing the retention starts every series over.
+        void reset(std::vector<std::string> const& names, retention const& r) {
+            if ( r.raw != retention_.raw || r.minutes != retention_.minutes || r.hours != retention_.hours )
+                series_.clear();
+            retention_ = r;
+
+            std::map<std::string, series, std::less<>> kept;
+            for (auto const& name : names) {
+                auto it = series_.find(name);
+                kept.emplace(name, it != series_.end() ? std::move(it->second) : series(retention_));
+            }
+            series_ = std::move(kept);
+
+            order_.clear();
+            for (auto const& name : names)
+                order_.push_back(&series_.at(name));
+        }
+
+        void add(std::int64_t ts, std::vector<double> const& row) {
+            if ( row.size() != order_.size() ) return;
+            for (std::size_t i = 0; i < row.size(); i++)
+                order_[i]->add(ts, row[i]);
+        }
+
+        // Adds a sample to the i-th series in the order of names only, the others keep their last one
+        void add(std::size_t i, std::int64_t ts, double value) {
+            if ( i < order_.size() )
+                order_[i]->add(ts, value);
+        }
+
+        [[nodiscard]] series const* find(std::string_view name) const {
+            auto it = series_.find(name);
+            return it != series_.end() ? &it->second : nullptr;
+        }
+
+    private:
+
+        retention retention_;
+        std::map<std::string, series, std::less<>> series_;
+        std::vector<series*> order_;
+
+    };
+
+    // Appends a bucket as a json object, i.e., {"ts":1700000000000,"min":1,"max":3,"avg":2,"count":3}
+    inline void format(std::string& out, point const& p) {
+        fmt::format_to(std::back_inserter(out), R"({{"ts":{},"min":{},"max":{},"avg":{},"count":{}}})", p.ts, p.min, p.max, p.avg, p.count);
+    }
+
+}
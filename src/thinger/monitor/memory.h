@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <string_view>
+
+#include "../utils/perfect_hash.h"
+#include "source.h"
+
+namespace thinger::monitor::memory {
+
+    // /proc/meminfo fields, in kB except for the HugePages counts
+    enum meminfo_field {
+        mem_total, mem_available, buffers, cached, swap_total, swap_free, dirty, writeback,
+        slab, sreclaimable, hugepages_total, hugepages_free, hugepagesize, anon_hugepages,
+        meminfo_fields
+    };
+
+    // /proc/vmstat cumulative counters
+    enum vmstat_field {
+        pgfault, pgmajfault, pswpin, pswpout, oom_kill,
+        vmstat_fields
+    };
+
+    constexpr ::utils::perfect_hash<meminfo_fields> meminfo_keys({
+        "MemTotal", "MemAvailable", "Buffers", "Cached", "SwapTotal", "SwapFree", "Dirty", "Writeback",
+        "Slab", "SReclaimable", "HugePages_Total", "HugePages_Free", "Hugepagesize", "AnonHugePages"
+    });
+
+    constexpr ::utils::perfect_hash<vmstat_fields> vmstat_keys({
+        "pgfault", "pgmajfault", "pswpin", "pswpout", "oom_kill"
+    });
+
+    struct stats {
+        std::array<unsigned long long, meminfo_fields> meminfo{};
+        std::array<unsigned long long, vmstat_fields> vmstat{};
+    };
+
+    namespace detail {
+
+        // Walks "<key><separator> <value> [unit]" lines storing the values of known keys
+        template <std::size_t N, std::size_t M>
+        void parse(std::string_view content, char separator, ::utils::perfect_hash<N> const& keys, std::array<unsigned long long, M>& values) {
+
+            std::size_t pos = 0;
+            while ( pos < content.size() ) {
+                auto eol = content.find('\n', pos);
+                if ( eol == std::string_view::npos ) eol = content.size();
+
+                auto line = content.substr(pos, eol - pos);
+                pos = eol + 1;
+
+                auto sep = line.find(separator);
+                if ( sep == std::string_view::npos ) continue;
+
+                int field = keys.find(line.substr(0, sep));
+                if ( field == ::utils::perfect_hash<N>::npos ) continue;
+
+                unsigned long long value = 0;
+                for (auto i = sep + 1; i < line.size(); i++) {
+                    char c = line[i];
+                    if ( c >= '0' && c <= '9' )
+                        value = value * 10 + (c - '0');
+                    else if ( c != ' ' )
+                        break;
+                }
+                values[field] = value;
+            }
+        }
+
+    }
+
+    inline void parse_meminfo(std::string_view content, stats& s) {
+        detail::parse(content, ':', meminfo_keys, s.meminfo);
+    }
+
+    inline void parse_vmstat(std::string_view content, stats& s) {
+        detail::parse(content, ' ', vmstat_keys, s.vmstat);
+    }
+
+    // Single pass over /proc/meminfo and /proc/vmstat, the buffer is reused between calls
+    inline bool retrieve(stats& s, std::string& buffer) {
+
+        bool ok = source::read("/proc/meminfo", buffer);
+        if ( ok ) parse_meminfo(buffer, s);
+
+        if ( source::read("/proc/vmstat", buffer) )
+            parse_vmstat(buffer, s);
+        else
+            ok = false;
+
+        return ok;
+    }
+
+}
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "rates.h"
+#include "source.h"
+
+namespace thinger::monitor::numa {
+
+    // Cumulative counters of a node, read together
+    enum counter_field {
+        numa_miss,    // pages allocated here while intended for another node
+        numa_foreign, // pages intended for here but allocated on another node
+        cpu_busy,     // jiffies
+        cpu_total,    // jiffies
+        counter_fields
+    };
+
+    struct node {
+        unsigned int id = 0;
+        std::string path; // sysfs directory
+        std::vector<unsigned int> cpus;
+
+        unsigned long long mem_total = 0; // kB
+        unsigned long long mem_free = 0;  // kB
+
+        std::array<unsigned long long, counter_fields> counters{};
+        rates::counters<counter_fields> counter_rates; // of counters, per second
+
+        float cpu_usage = 0;    // %
+        float miss_rate = 0;    // pages/s
+        float foreign_rate = 0; // pages/s
+    };
+
+    // Parses a kernel cpu list, i.e., "0-3,8-11"
+    inline std::vector<unsigned int> parse_cpulist(std::string_view list) {
+        std::vector<unsigned int> cpus;
+
+        auto number = [&list](std::size_t& i) {
+            unsigned int n = 0;
+            for (; i < list.size() && list[i] >= '0' && list[i] <= '9'; i++)
+                n = n * 10 + (list[i] - '0');
+            return n;
+        };
+
+        std::size_t i = 0;
+        while ( i < list.size() ) {
+            if ( list[i] < '0' || list[i] > '9' ) {
+                i++;
+                continue;
+            }
+            unsigned int first = number(i);
+            unsigned int last = first;
+            if ( i < list.size() && list[i] == '-' ) {
+                i++;
+                last = number(i);
+            }
+            for (auto cpu = first; cpu <= last; cpu++)
+                cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+
+    namespace detail {
+
+        inline unsigned long long parse_number(std::string_view s) {
+            unsigned long long n = 0;
+            auto i = s.find_first_of("0123456789");
+            for (; i < s.size() && s[i] >= '0' && s[i] <= '9'; i++)
+                n = n * 10 + (s[i] - '0');
+            return n;
+        }
+
+        template <typename F>
+        void for_each_line(std::string_view content, F&& f) {
+            std::size_t pos = 0;
+            while ( pos < content.size() ) {
+                auto eol = content.find('\n', pos);
+                if ( eol == std::string_view::npos ) eol = content.size();
+                f(content.substr(pos, eol - pos));
+                pos = eol + 1;
+            }
+        }
+
+    }
+
+    // Parses node<N>/meminfo, lines are like "Node 0 MemTotal:       16314352 kB"
+    inline void parse_meminfo(std::string_view content, node& n) {
+        detail::for_each_line(content, [&n](std::string_view line) {
+            auto colon = line.find(':');
+            if ( colon == std::string_view::npos ) return;
+            auto key = line.substr(0, colon);
+            key = key.substr(key.rfind(' ') + 1);
+            if ( key == "MemTotal" ) n.mem_total = detail::parse_number(line.substr(colon));
+            else if ( key == "MemFree" ) n.mem_free = detail::parse_number(line.substr(colon));
+        });
+    }
+
+    // Parses node<N>/numastat, lines are like "numa_miss 1234"
+    inline void parse_numastat(std::string_view content, node& n) {
+        detail::for_each_line(content, [&n](std::string_view line) {
+            auto space = line.find(' ');
+            if ( space == std::string_view::npos ) return;
+            auto key = line.substr(0, space);
+            if ( key == "numa_miss" ) n.counters[numa_miss] = detail::parse_number(line.substr(space));
+            else if ( key == "numa_foreign" ) n.counters[numa_foreign] = detail::parse_number(line.substr(space));
+        });
+    }
+
+    // Parses the per core lines of /proc/stat into busy and total jiffies indexed by cpu
+    inline void parse_stat(std::string_view content, std::vector<unsigned long long>& busy, std::vector<unsigned long long>& total) {
+        detail::for_each_line(content, [&busy, &total](std::string_view line) {
+            if ( line.size() < 4 || line.substr(0, 3) != "cpu" || line[3] < '0' || line[3] > '9' ) return;
+
+            std::size_t i = 3;
+            unsigned int cpu = 0;
+            for (; i < line.size() && line[i] >= '0' && line[i] <= '9'; i++)
+                cpu = cpu * 10 + (line[i] - '0');
+
+            // user nice system idle iowait irq softirq steal, guest time is already in user
+            std::array<unsigned long long, 8> fields{};
+            for (auto& field : fields) {
+                while ( i < line.size() && line[i] == ' ' ) i++;
+                for (; i < line.size() && line[i] >= '0' && line[i] <= '9'; i++)
+                    field = field * 10 + (line[i] - '0');
+            }
+
+            if ( cpu >= busy.size() ) {
+                busy.resize(cpu + 1);
+                total.resize(cpu + 1);
+            }
+            unsigned long long sum = 0;
+            for (auto field : fields) sum += field;
+            total[cpu] = sum;
+            busy[cpu] = sum - fields[3] - fields[4];
+        });
+    }
+
+    // Lists the nodes under /sys/devices/system/node with their cpus, empty on non NUMA kernels
+    inline std::vector<node> discover(std::string& buffer) {
+        std::vector<node> nodes;
+
+        std::vector<std::string> entries;
+        source::list("/sys/devices/system/node", entries);
+        for (auto const& name : entries) {
+            if ( name.size() < 5 || name.compare(0, 4, "node") != 0 || !isdigit(name[4]) ) continue;
+
+            node n;
+            n.id = static_cast<unsigned int>(detail::parse_number(name));
+            n.path = "/sys/devices/system/node/" + name;
+            if ( source::read(n.path, "/cpulist", buffer) )
+                n.cpus = parse_cpulist(buffer);
+            nodes.push_back(std::move(n));
+        }
+
+        std::sort(nodes.begin(), nodes.end(), [](node const& a, node const& b) { return a.id < b.id; });
+        return nodes;
+    }
+
+    // Reads the current counters of every node
+    inline void retrieve(std::vector<node>& nodes, std::string& buffer) {
+
+        // reused between ticks, sized to the highest cpu seen
+        thread_local std::vector<unsigned long long> busy;
+        thread_local std::vector<unsigned long long> total;
+        busy.clear();
+        total.clear();
+        if ( source::read("/proc/stat", buffer) )
+            parse_stat(buffer, busy, total);
+
+        for (auto& n : nodes) {
+            if ( source::read(n.path, "/meminfo", buffer) )
+                parse_meminfo(buffer, n);
+            if ( source::read(n.path, "/numastat", buffer) )
+                parse_numastat(buffer, n);
+
+            n.counters[cpu_busy] = 0;
+            n.counters[cpu_total] = 0;
+            for (auto cpu : n.cpus) {
+                if ( cpu >= total.size() ) continue; // offline
+                n.counters[cpu_busy] += busy[cpu];
+                n.counters[cpu_total] += total[cpu];
+            }
+        }
+    }
+
+    // Computes usage and rates from the counters read since the last call. A cpu going offline
+    // lowers the jiffies of its node, which takes them as a new baseline as any other reset.
+    inline void update(std::vector<node>& nodes, rates::stamp const& at) {
+        for (auto& n : nodes) {
+            n.counter_rates.update(at, n.counters);
+
+            auto total = n.counter_rates.rate(cpu_total);
+            if ( total > 0 )
+                n.cpu_usage = n.counter_rates.rate(cpu_busy) * 100 / total;
+            n.miss_rate = n.counter_rates.rate(numa_miss);
+            n.foreign_rate = n.counter_rates.rate(numa_foreign);
+        }
+    }
+
+}
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace thinger::monitor::probes {
+
+    using clock = std::chrono::steady_clock;
+
+    struct options {
+        std::chrono::milliseconds interval{std::chrono::minutes(5)}; // between successful runs
+        std::chrono::milliseconds timeout{std::chrono::seconds(10)}; // handed to the probe for its own I/O
+        std::chrono::milliseconds backoff{std::chrono::seconds(5)};  // first retry after a failure, doubled on each one
+        std::chrono::milliseconds max_backoff{std::chrono::minutes(5)};
+    };
+
+    template <typename T>
+    struct result {
+        T value{};                  // last good value
+        bool valid = false;         // there has been at least one good value
+        std::chrono::seconds age{}; // since the last good value
+        unsigned int failures = 0;  // consecutive failures
+    };
+
+    class task {
+    public:
+        virtual ~task() = default;
+        virtual void trigger() = 0;
+    };
+
+    // Runs a slow function, i.e., a network request, in its own thread and caches its last
+    // good value, so readers never wait on its I/O.
+    template <typename T>
+    class probe : public task {
+
+    public:
+
+        using function = std::function<std::optional<T>(std::chrono::milliseconds timeout)>;
+
+        // A seed, i.e., the last good value before a restart, is served until the probe runs, which
+        // is delayed until the seed is as old as the interval between runs
+        probe(function fn, options const& o, std::optional<result<T>> seed = std::nullopt) : fn_(std::move(fn)), options_(o) {
+            if ( seed && seed->valid ) {
+                last_.value = std::move(seed->value);
+                last_.valid = true;
+                updated_ = clock::now() - seed->age;
+                if ( seed->age < options_.interval )
+                    delay_ = std::chrono::duration_cast<std::chrono::milliseconds>(options_.interval - seed->age);
+            }
+            thread_ = std::jthread([this](std::stop_token const& stoken) { run(stoken); });
+        }
+
+        ~probe() override {
+            thread_.request_stop();
+            cv_.notify_all();
+        }
+
+        [[nodiscard]] result<T> last() const {
+            std::scoped_lock lock(mutex_);
+            result<T> r = last_;
+            if ( r.valid )
+                r.age = std::chrono::duration_cast<std::chrono::seconds>(clock::now() - updated_);
+            return r;
+        }
+
+        // Runs the probe as soon as possible, i.e., after a configuration change
+        void trigger() override {
+            {
+                std::scoped_lock lock(mutex_);
+                triggered_ = true;
+            }
+            cv_.notify_all();
+        }
+
+    private:
+
+        function fn_;
+        options options_;
+
+        mutable std::mutex mutex_;
+        std::condition_variable_any cv_;
+        result<T> last_;
+        clock::time_point updated_{};
+        std::chrono::milliseconds delay_{0}; // before the first run
+        bool triggered_ = false;
+
+        std::jthread thread_; // last, so it is stopped before the members it uses are destroyed
+
+        void run(std::stop_token const& stoken) {
+
+            auto backoff = options_.backoff;
+
+            if ( delay_.count() > 0 ) {
+                std::unique_lock lock(mutex_);
+                cv_.wait_for(lock, stoken, delay_, [this] { return triggered_; });
+                triggered_ = false;
+            }
+
+            while ( !stoken.stop_requested() ) {
+
+                std::optional<T> value;
+                try {
+                    value = fn_(options_.timeout);
+                } catch (...) {
+                    value = std::nullopt;
+                }
+
+                std::chrono::milliseconds wait;
+                {
+                    std::scoped_lock lock(mutex_);
+                    if ( value ) {
+                        last_.value = std::move(*value);
+                        last_.valid = true;
+                        last_.failures = 0;
+                        updated_ = clock::now();
+                        backoff = options_.backoff;
+                        wait = options_.interval;
+                    } else {
+                        last_.failures++;
+                        wait = std::min(backoff, options_.max_backoff);
+                        backoff = std::min(backoff * 2, options_.max_backoff);
+                    }
+                }
+
+                std::unique_lock lock(mutex_);
+                cv_.wait_for(lock, stoken, wait, [this] { return triggered_; });
+                triggered_ = false;
+            }
+        }
+
+    };
+
+    // Owns the probes of the agent and triggers them together
+    class executor {
+
+    public:
+
+        template <typename T>
+        std::shared_ptr<probe<T>> add(typename probe<T>::function fn, options const& o, std::optional<result<T>> seed = std::nullopt) {
+            auto p = std::make_shared<probe<T>>(std::move(fn), o, std::move(seed));
+            tasks_.push_back(p);
+            return p;
+        }
+
+        void trigger() {
+            for (auto const& t : tasks_)
+                t->trigger();
+        }
+
+    private:
+
+        std::vector<std::shared_ptr<task>> tasks_;
+
+    };
+
+}
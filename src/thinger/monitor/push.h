@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+namespace thinger::monitor::push {
+
+    // wall clock, so hosts pushing at the same interval push at the same instants
+    using clock = std::chrono::system_clock;
+
+    struct policy {
+        std::chrono::milliseconds interval{0}; // 0 disables pushing
+        std::string endpoint = "monitor_push";
+        std::chrono::milliseconds max_backoff{std::chrono::minutes(5)};
+    };
+
+    // First boundary after now of the intervals counted from the epoch, i.e., :00, :15, :30, :45
+    // for 15 seconds
+    inline clock::time_point align(clock::time_point now, std::chrono::milliseconds interval) {
+        if ( interval.count() <= 0 ) return now;
+        auto since = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch());
+        return clock::time_point(std::chrono::duration_cast<clock::duration>((since / interval + 1) * interval));
+    }
+
+    // Decides when the next snapshot is pushed. A failed push backs off doubling up to the maximum,
+    // and a push slower than half the interval skips the next boundary, so a down or congested link
+    // is not fed faster than it drains. Pushes always land on a boundary.
+    class schedule {
+
+    public:
+
+        explicit schedule(policy const& p = {}) : policy_(p) {}
+
+        void set_policy(policy const& p, clock::time_point now) {
+            policy_ = p;
+            backoff_ = {};
+            next_ = align(now, policy_.interval);
+        }
+
+        [[nodiscard]] policy const& get_policy() const { return policy_; }
+
+        [[nodiscard]] bool enabled() const { return policy_.interval.count() > 0 && !policy_.endpoint.empty(); }
+
+        [[nodiscard]] bool due(clock::time_point now) const {
+            return enabled() && now >= next_;
+        }
+
+        [[nodiscard]] clock::time_point next() const { return next_; }
+
+        // Paused after a failure or a congested push, until a push goes through in time
+        [[nodiscard]] bool paused() const { return backoff_.count() > 0; }
+
+        [[nodiscard]] unsigned long failures() const { return failures_; }
+
+        void feed(clock::time_point now, bool delivered, std::chrono::nanoseconds latency) {
+            if ( !delivered ) {
+                failures_++;
+                backoff_ = std::clamp(backoff_ * 2, policy_.interval, std::max(policy_.max_backoff, policy_.interval));
+            } else if ( latency > policy_.interval / 2 ) {
+                backoff_ = policy_.interval;
+            } else {
+                failures_ = 0;
+                backoff_ = {};
+            }
+            next_ = align(now + backoff_, policy_.interval);
+        }
+
+    private:
+
+        policy policy_;
+        clock::time_point next_{};
+        std::chrono::milliseconds backoff_{0};
+        unsigned long failures_ = 0;
+
+    };
+
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <limits>
+#include <optional>
+
+#include <time.h>
+
+#include "source.h"
+
+namespace thinger::monitor::rates {
+
+    // Time of a reading. Rates are computed over monotonic time, which neither steps with NTP nor
+    // advances while suspended; boot time does advance while suspended, so the difference between
+    // both tells whether the host slept between two readings.
+    struct stamp {
+        std::chrono::nanoseconds monotonic{0};
+        std::chrono::nanoseconds boottime{0};
+    };
+
+    inline stamp now() {
+        auto monotonic = source::now().time_since_epoch();
+        // a capture carries no suspends
+        if ( source::replaying() ) return {monotonic, monotonic};
+        timespec ts{};
+        ::clock_gettime(CLOCK_BOOTTIME, &ts);
+        return {monotonic, std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec)};
+    }
+
+    // Increase of a counter between two readings, taking a counter going back near the top of its
+    // range as a wrap, 32 bits ones included as procfs exposes 32 bits counters on some drivers
+    // and architectures. Nothing when the counter was reset, i.e., an interface created again or
+    // a driver reloaded.
+    inline std::optional<unsigned long long> delta(unsigned long long before, unsigned long long after) {
+        if ( after >= before ) return after - before;
+
+        constexpr unsigned long long range32 = 1ULL << 32;
+        if ( before < range32 && after < range32 && after + range32 - before < range32 / 2 )
+            return after + range32 - before;
+
+        constexpr auto max = std::numeric_limits<unsigned long long>::max();
+        if ( before > max - max / 4 && after < max / 4 )
+            return after - before; // modular
+
+        return std::nullopt;
+    }
+
+    // Per second rates of N cumulative counters read together, i.e., the sectors read and written
+    // of a drive. Values and rates are kept as arrays so a reading updates them in a single pass.
+    // A counter that was reset, or every counter after a suspend, takes the reading as its new
+    // baseline and keeps its last rate, so neither shows as a spike nor as a drop to zero.
+    template <std::size_t N>
+    class counters {
+
+    public:
+
+        // Suspends longer than this are seen as a gap in the readings
+        static constexpr std::chrono::nanoseconds max_suspend = std::chrono::seconds(1);
+
+        void update(stamp const& at, std::array<unsigned long long, N> const& values) {
+            if ( !primed_ ) {
+                last_ = values;
+                at_ = at;
+                primed_ = true;
+                return;
+            }
+
+            auto elapsed = at.monotonic - at_.monotonic;
+            if ( elapsed.count() <= 0 ) return;
+
+            bool suspended = (at.boottime - at_.boottime) - elapsed > max_suspend;
+            if ( suspended ) gaps_++;
+
+            auto seconds = std::chrono::duration<double>(elapsed).count();
+            for (std::size_t i = 0; i < N; i++) {
+                auto d = delta(last_[i], values[i]);
+                if ( !d ) resets_++;
+                else if ( !suspended ) rates_[i] = (float)((double)*d / seconds);
+            }
+
+            last_ = values;
+            at_ = at;
+        }
+
+        // Takes a previous reading as the baseline, i.e., one saved before a restart in the same
+        // boot, where monotonic time goes on
+        void restore(stamp const& at, std::array<unsigned long long, N> const& values) {
+            last_ = values;
+            at_ = at;
+            primed_ = true;
+        }
+
+        [[nodiscard]] stamp const& at() const { return at_; }
+
+        [[nodiscard]] std::array<unsigned long long, N> const& values() const { return last_; }
+
+        [[nodiscard]] float rate(std::size_t i) const { return rates_[i]; }
+
+        [[nodiscard]] std::array<float, N> const& rates() const { return rates_; }
+
+        // Whether a baseline was read, rates are 0 until the second reading
+        [[nodiscard]] bool primed() const { return primed_; }
+
+        [[nodiscard]] unsigned long resets() const { return resets_; }
+
+        [[nodiscard]] unsigned long gaps() const { return gaps_; }
+
+    private:
+
+        std::array<unsigned long long, N> last_{};
+        std::array<float, N> rates_{};
+        stamp at_{};
+        bool primed_ = false;
+        unsigned long resets_ = 0;
+        unsigned long gaps_ = 0;
+
+    };
+
+}
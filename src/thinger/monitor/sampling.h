@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace thinger::monitor::sampling {
+
+    using clock = std::chrono::steady_clock;
+
+    struct policy {
+        std::chrono::milliseconds floor{1000};    // fastest sampling interval
+        std::chrono::milliseconds ceiling{10000}; // slowest sampling interval, reached while the signal is flat
+        double variance = 0; // threshold over the exponentially weighted variance of the signal; 0 disables it
+        double rate = 0;     // threshold over the absolute rate of change of the signal per second; 0 disables it
+        std::chrono::milliseconds budget{0}; // samples taking longer are reported as overruns; 0 disables it
+
+        // configured floors are raised to this, as a null one would busy-loop the sampler
+        static constexpr std::chrono::milliseconds min_floor{100};
+    };
+
+    // Decides when a collector is due based on how volatile its signal is.
+    // Every flat sample doubles the interval up to the ceiling, while any volatile
+    // sample or host contention drops it straight to the floor.
+    class adaptive {
+
+    public:
+
+        static constexpr double alpha = 0.3; // weight of the newest sample in the moving mean and variance
+
+        explicit adaptive(policy const& p = {}) : policy_(p), interval_(p.floor) {}
+
+        void set_policy(policy const& p) {
+            policy_ = p;
+            interval_ = std::clamp(interval_, policy_.floor, policy_.ceiling);
+            next_ = std::min(next_, last_ + interval_);
+        }
+
+        [[nodiscard]] bool due(clock::time_point now) const {
+            return now >= next_;
+        }
+
+        // Feeds the signal of the last sample. Contention forces the floor, stretch > 1
+        // delays the next sample to back off the agent when the host is under pressure.
+        void feed(double value, clock::time_point now, bool contention = false, unsigned int stretch = 1) {
+
+            double rate = 0;
+            if ( samples_ == 0 ) {
+                mean_ = value;
+                variance_ = 0;
+            } else {
+                double delta = value - mean_;
+                mean_ += alpha * delta;
+                variance_ = (1 - alpha) * (variance_ + alpha * delta * delta);
+
+                auto elapsed = std::chrono::duration<double>(now - last_).count();
+                if ( elapsed > 0 )
+                    rate = std::abs(value - last_value_) / elapsed;
+            }
+
+            bool is_volatile = contention ||
+                (policy_.variance > 0 && variance_ > policy_.variance) ||
+                (policy_.rate > 0 && rate > policy_.rate);
+
+            if ( is_volatile )
+                interval_ = policy_.floor;
+            else if ( samples_ > 0 )
+                interval_ = std::min(interval_ * 2, policy_.ceiling);
+
+            samples_++;
+            last_value_ = value;
+            last_ = now;
+            next_ = now + interval_ * std::max(stretch, 1u);
+        }
+
+        [[nodiscard]] policy const& get_policy() const { return policy_; }
+        [[nodiscard]] std::chrono::milliseconds interval() const { return interval_; }
+        [[nodiscard]] clock::time_point next() const { return next_; }
+        [[nodiscard]] double mean() const { return mean_; }
+        [[nodiscard]] double variance() const { return variance_; }
+
+    private:
+
+        policy policy_;
+        std::chrono::milliseconds interval_;
+
+        unsigned long samples_ = 0;
+        double mean_ = 0;
+        double variance_ = 0;
+        double last_value_ = 0;
+
+        clock::time_point last_{};
+        clock::time_point next_{}; // due on first check
+    };
+
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../utils/file.h"
+#include "rates.h"
+#include "source.h"
+
+namespace thinger::monitor::sensors {
+
+    // Attribute kept open to be read with a single pread, or read through the source while a
+    // capture is recorded or replayed
+    class input {
+
+    public:
+
+        input() = default;
+
+        explicit input(std::string path) : path_(std::move(path)) {
+            if ( source::replaying() ) {
+                std::string buffer;
+                found_ = source::read(path_, buffer);
+            } else {
+                fd_ = ::utils::file::descriptor(source::path(path_).c_str());
+                found_ = fd_.valid();
+            }
+        }
+
+        [[nodiscard]] bool valid() const { return found_; }
+
+        [[nodiscard]] std::optional<long long> read_integer() const {
+            if ( !found_ ) return std::nullopt;
+            if ( !source::recording() && !source::replaying() ) return fd_.read_integer();
+
+            std::string buffer;
+            if ( !source::read(path_, buffer) ) return std::nullopt;
+            std::size_t i = !buffer.empty() && buffer[0] == '-' ? 1 : 0;
+            if ( i == buffer.size() || !std::isdigit(static_cast<unsigned char>(buffer[i])) ) return std::nullopt;
+            long long value = 0;
+            for (; i < buffer.size() && std::isdigit(static_cast<unsigned char>(buffer[i])); i++)
+                value = value * 10 + (buffer[i] - '0');
+            return buffer[0] == '-' ? -value : value;
+        }
+
+    private:
+
+        std::string path_;
+        ::utils::file::descriptor fd_;
+        bool found_ = false;
+
+    };
+
+    struct sensor {
+        std::string name;
+        sensors::input input;
+        double scale = 1; // from the sysfs unit to the published one
+        double value = 0;
+    };
+
+    struct core {
+        unsigned int id = 0;
+        input current_input;  // kHz
+        input max_input;      // kHz
+        input throttle_input; // ms, x86 only
+        float current = 0; // MHz
+        float max = 0;     // MHz
+        rates::counters<1> throttle_rates; // of the throttled ms
+    };
+
+    namespace detail {
+
+        inline std::string read_name(std::string const& path, std::string& buffer) {
+            if ( !source::read(path, buffer) ) return {};
+            std::string name;
+            for (char c : buffer) {
+                if ( c == '\n' ) break;
+                name += std::isalnum(static_cast<unsigned char>(c)) ? static_cast<char>(std::tolower(c)) : '_';
+            }
+            return name;
+        }
+
+        // Entries named <prefix><number> sorted by number, i.e., thermal_zone0, thermal_zone1
+        inline std::vector<std::pair<unsigned int, std::string>> numbered(std::string const& dir, std::string_view prefix) {
+            std::vector<std::pair<unsigned int, std::string>> entries;
+            std::vector<std::string> names;
+            source::list(dir, names);
+            for (auto const& name : names) {
+                if ( name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0 ) continue;
+                auto suffix = name.substr(prefix.size());
+                if ( !std::all_of(suffix.begin(), suffix.end(), ::isdigit) ) continue;
+                entries.emplace_back(std::stoul(suffix), dir + "/" + name);
+            }
+            std::sort(entries.begin(), entries.end());
+            return entries;
+        }
+
+    }
+
+    // Discovers the sensors once and keeps their attributes open, each tick costs one pread per value
+    class collector {
+
+    public:
+
+        // Reads every value once, at is the baseline of the throttled time
+        void discover(rates::stamp const& at = rates::now()) {
+
+            temperatures_.clear();
+            fans_.clear();
+            cores_.clear();
+
+            std::string buffer;
+
+            auto add = [](std::vector<sensor>& sensors, std::string name, std::string path, double scale) {
+                sensor s{std::move(name), input(std::move(path)), scale};
+                if ( !s.input.valid() ) return;
+                // names must be unique to be published
+                for (auto const& other : sensors)
+                    if ( other.name == s.name ) s.name += "_" + std::to_string(sensors.size());
+                sensors.push_back(std::move(s));
+            };
+
+            // thermal zones, millidegree Celsius
+            for (auto const& [n, path] : detail::numbered("/sys/class/thermal", "thermal_zone")) {
+                auto type = detail::read_name(path + "/type", buffer);
+                add(temperatures_, type.empty() ? "zone" + std::to_string(n) : type, path + "/temp", 0.001);
+            }
+
+            // hwmon chips, millidegree Celsius temperatures and RPM fans
+            for (auto const& [n, path] : detail::numbered("/sys/class/hwmon", "hwmon")) {
+                auto chip = detail::read_name(path + "/name", buffer);
+                if ( chip.empty() ) chip = "hwmon" + std::to_string(n);
+
+                std::vector<std::string> inputs;
+                source::list(path, inputs);
+
+                for (auto const& input : inputs) {
+                    auto end = input.find("_input");
+                    if ( end == std::string::npos || end + 6 != input.size() ) continue;
+                    auto channel = input.substr(0, end); // temp1, fan2
+                    auto label = detail::read_name(path + "/" + channel + "_label", buffer);
+                    auto name = chip + "_" + (label.empty() ? channel : label);
+                    if ( channel.compare(0, 4, "temp") == 0 )
+                        add(temperatures_, name, path + "/" + input, 0.001);
+                    else if ( channel.compare(0, 3, "fan") == 0 )
+                        add(fans_, name, path + "/" + input, 1);
+                }
+            }
+
+            // cpu frequencies and thermal throttling
+            for (auto const& [n, path] : detail::numbered("/sys/devices/system/cpu", "cpu")) {
+                core c;
+                c.id = n;
+                c.current_input = input(path + "/cpufreq/scaling_cur_freq");
+                c.max_input = input(path + "/cpufreq/cpuinfo_max_freq");
+                c.throttle_input = input(path + "/thermal_throttle/core_throttle_total_time_ms");
+                if ( !c.current_input.valid() && !c.throttle_input.valid() ) continue;
+                cores_.push_back(std::move(c));
+            }
+
+            read(at);
+        }
+
+        // Reads every value, the throttled fraction is over the time since the last read
+        void read(rates::stamp const& at) {
+
+            for (auto* sensors : {&temperatures_, &fans_}) {
+                for (auto& s : *sensors) {
+                    if ( auto v = s.input.read_integer() ) s.value = (double)*v * s.scale;
+                }
+            }
+
+            float throttled = 0; // ms per second
+            std::size_t throttling = 0;
+            for (auto& c : cores_) {
+                if ( auto v = c.current_input.read_integer() ) c.current = (float)*v / 1000;
+                if ( auto v = c.max_input.read_integer() ) c.max = (float)*v / 1000;
+                if ( auto v = c.throttle_input.read_integer(); v && *v >= 0 ) {
+                    c.throttle_rates.update(at, {static_cast<unsigned long long>(*v)});
+                    throttled += c.throttle_rates.rate(0);
+                    throttling++;
+                }
+            }
+
+            // average over the cores reporting it, clamped as counters are updated asynchronously
+            if ( throttling > 0 )
+                throttled_ = std::clamp(throttled / ((float)throttling * 1000), 0.f, 1.f);
+        }
+
+        [[nodiscard]] std::vector<sensor> const& temperatures() const { return temperatures_; }
+        [[nodiscard]] std::vector<sensor> const& fans() const { return fans_; }
+        [[nodiscard]] std::vector<core> const& cores() const { return cores_; }
+
+        // Fraction of time the cores spent throttled between the last two reads
+        [[nodiscard]] float throttled() const { return throttled_; }
+
+        [[nodiscard]] double max_temperature() const {
+            double max = 0;
+            for (auto const& s : temperatures_) max = std::max(max, s.value);
+            return max;
+        }
+
+    private:
+
+        std::vector<sensor> temperatures_;
+        std::vector<sensor> fans_;
+        std::vector<core> cores_;
+        float throttled_ = 0;
+
+    };
+
+}
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/statvfs.h>
+
+#include "../utils/file.h"
+#include "capture.h"
+
+// Every file read by the collectors is resolved through this namespace, so the host can be
+// monitored from a container with its root mounted, i.e., at /host, collectors can be driven
+// from fixture trees, and their inputs recorded and replayed.
+namespace thinger::monitor::source {
+
+    using clock = std::chrono::steady_clock;
+
+    namespace detail {
+        inline std::string root;
+        inline std::unique_ptr<capture::recorder> recorder;
+        inline std::unique_ptr<capture::replayer> replayer;
+
+        // replays start at an arbitrary non zero time point, advanced by the sampler
+        inline const clock::time_point replay_origin = clock::time_point{} + std::chrono::hours(1);
+        inline std::atomic<clock::duration::rep> replay_offset{0};
+
+        // Root prefixed path in a buffer reused by each thread, so steady state reads do not allocate
+        inline const char* resolve(std::string_view p) {
+            thread_local std::string resolved;
+            resolved.assign(root).append(p);
+            return resolved.c_str();
+        }
+    }
+
+    // Prefix for /proc, /sys, /etc and /var paths, empty for the real root
+    inline void set_root(std::string_view root) {
+        while ( !root.empty() && root.back() == '/' )
+            root.remove_suffix(1);
+        detail::root = root;
+    }
+
+    inline std::string const& root() {
+        return detail::root;
+    }
+
+    inline std::string path(std::string_view p) {
+        std::string resolved;
+        resolved.reserve(detail::root.size() + p.size());
+        resolved.append(detail::root).append(p);
+        return resolved;
+    }
+
+    // Records every read into a capture file until the agent stops
+    inline bool record(std::string const& capture_path) {
+        detail::recorder = std::make_unique<capture::recorder>(capture_path);
+        if ( detail::recorder->good() ) return true;
+        detail::recorder.reset();
+        return false;
+    }
+
+    // Serves every read from a capture file instead of the host
+    inline bool replay(std::string const& capture_path) {
+        auto replayer = std::make_unique<capture::replayer>();
+        if ( !replayer->load(capture_path) ) return false;
+        detail::replayer = std::move(replayer);
+        detail::replay_offset = 0;
+        return true;
+    }
+
+    // Back to reading the host, closing any capture
+    inline void reset() {
+        detail::recorder.reset();
+        detail::replayer.reset();
+    }
+
+    inline bool recording() { return detail::recorder != nullptr; }
+    inline bool replaying() { return detail::replayer != nullptr; }
+
+    // Collectors take their timestamps from here, while replaying time only moves with advance()
+    inline clock::time_point now() {
+        if ( !detail::replayer ) return clock::now();
+        return detail::replay_origin + clock::duration(detail::replay_offset.load(std::memory_order_relaxed));
+    }
+
+    inline void advance(clock::time_point to) {
+        auto offset = std::max(clock::duration::zero(), to - detail::replay_origin);
+        detail::replay_offset.store(offset.count(), std::memory_order_relaxed);
+    }
+
+    // Whether the replay went past the last record of the capture
+    inline bool replay_finished() {
+        return detail::replayer && now() - detail::replay_origin > detail::replayer->end();
+    }
+
+    inline bool read(std::string_view p, std::string& buffer) {
+        if ( detail::replayer ) {
+            buffer.clear();
+            return detail::replayer->read(p, now() - detail::replay_origin, buffer);
+        }
+
+        bool found = ::utils::file::read(detail::resolve(p), buffer);
+        if ( detail::recorder ) detail::recorder->write(p, found, buffer);
+        return found;
+    }
+
+    // Reads <dir><file>, for collectors keeping the directory of each device
+    inline bool read(std::string_view dir, std::string_view file, std::string& buffer) {
+        thread_local std::string p;
+        p.assign(dir).append(file);
+        return read(p, buffer);
+    }
+
+    // Records a value the collectors depend on which is not read from a file, i.e., the configuration
+    inline void annotate(std::string_view key, std::string_view content) {
+        if ( detail::recorder ) detail::recorder->write(key, true, content);
+    }
+
+    // Whole file as a stream for the collectors parsing with operator>>, empty when missing
+    inline std::istringstream stream(std::string_view p) {
+        std::string buffer;
+        bool found = read(p, buffer);
+        std::istringstream stream(std::move(buffer));
+        if ( !found ) stream.setstate(std::ios::failbit);
+        return stream;
+    }
+
+    // Sorted entry names of a directory, recorded as a file under "<dir>/" with one name per line.
+    // The strings of names are reused, so listing a directory again does not allocate on replays.
+    inline bool list(std::string_view dir, std::vector<std::string>& names) {
+        thread_local std::string key;
+        thread_local std::string content;
+        key.assign(dir).append("/");
+        content.clear();
+
+        std::size_t count = 0;
+        auto add = [&names, &count](std::string_view name) {
+            if ( count < names.size() ) names[count].assign(name);
+            else names.emplace_back(name);
+            count++;
+        };
+
+        if ( detail::replayer ) {
+            bool found = detail::replayer->read(key, now() - detail::replay_origin, content);
+            for (std::size_t pos = 0; pos < content.size(); ) {
+                auto end = std::min(content.find('\n', pos), content.size());
+                add(std::string_view(content).substr(pos, end - pos));
+                pos = end + 1;
+            }
+            names.resize(count);
+            return found;
+        }
+
+        std::error_code ec;
+        for (std::filesystem::directory_iterator it(path(dir), ec), end; !ec && it != end; it.increment(ec))
+            add(it->path().filename().native());
+        names.resize(count);
+        std::sort(names.begin(), names.end());
+
+        if ( detail::recorder ) {
+            for (auto const& name : names)
+                content.append(name).append("\n");
+            detail::recorder->write(key, !ec, content);
+        }
+        return !ec;
+    }
+
+    // Filesystem capacity, recorded under "@space:<path>" as "capacity free available"
+    inline std::filesystem::space_info space(std::string_view p) {
+        std::filesystem::space_info info{};
+
+        thread_local std::string key;
+        key.assign("@space:").append(p);
+
+        if ( detail::replayer ) {
+            thread_local std::string content;
+            if ( detail::replayer->read(key, now() - detail::replay_origin, content) ) {
+                char* next = content.data();
+                info.capacity = std::strtoull(next, &next, 10);
+                info.free = std::strtoull(next, &next, 10);
+                info.available = std::strtoull(next, &next, 10);
+            }
+            return info;
+        }
+
+        // statvfs as std::filesystem::space does, without building a path
+        struct statvfs st{};
+        bool found = ::statvfs(detail::resolve(p), &st) == 0;
+        if ( found ) {
+            info.capacity = static_cast<std::uintmax_t>(st.f_blocks) * st.f_frsize;
+            info.free = static_cast<std::uintmax_t>(st.f_bfree) * st.f_frsize;
+            info.available = static_cast<std::uintmax_t>(st.f_bavail) * st.f_frsize;
+        }
+        if ( detail::recorder )
+            detail::recorder->write(key, found,
+                std::to_string(info.capacity) + " " + std::to_string(info.free) + " " + std::to_string(info.available));
+        return info;
+    }
+
+    // Flushes the capture, i.e., before exiting
+    inline void flush() {
+        if ( detail::recorder ) detail::recorder->flush();
+    }
+
+}
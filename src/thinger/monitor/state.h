@@ -0,0 +1,152 @@
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <system_error>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
+
+#include "probes.h"
+#include "rates.h"
+#include "source.h"
+
+namespace thinger::monitor::state {
+
+    // A state saved longer ago is not restored
+    constexpr std::chrono::hours max_age{24};
+
+    // Counter baselines older than this would turn the first rates into averages over the downtime
+    constexpr std::chrono::minutes max_gap{10};
+
+    namespace detail {
+
+        // Integer member of a saved object, the fallback when it is missing or of another type, as
+        // a state edited by hand or by another version must not throw
+        inline long long integer(nlohmann::json const& j, const char* key, long long fallback = 0) {
+            auto it = j.find(key);
+            return it != j.end() && it->is_number_integer() ? it->get<long long>() : fallback;
+        }
+
+    }
+
+    // Identifies the running kernel, monotonic timestamps only compare within a boot
+    inline std::string boot_id() {
+        std::string content;
+        if ( !source::read("/proc/sys/kernel/random/boot_id", content) ) return {};
+        while ( !content.empty() && (content.back() == '\n' || content.back() == ' ') )
+            content.pop_back();
+        return content;
+    }
+
+    template <std::size_t N>
+    nlohmann::json dump(rates::counters<N> const& c) {
+        if ( !c.primed() ) return nullptr;
+        return {{"monotonic", c.at().monotonic.count()}, {"boottime", c.at().boottime.count()}, {"values", c.values()}};
+    }
+
+    template <std::size_t N>
+    bool load(nlohmann::json const& j, rates::counters<N>& c) {
+        if ( !j.is_object() || !j.contains("values") || !j["values"].is_array() || j["values"].size() != N ) return false;
+        rates::stamp at{std::chrono::nanoseconds(detail::integer(j, "monotonic")), std::chrono::nanoseconds(detail::integer(j, "boottime"))};
+        std::array<unsigned long long, N> values{};
+        for (std::size_t i = 0; i < N; i++) {
+            if ( !j["values"][i].is_number_unsigned() ) return false;
+            values[i] = j["values"][i].template get<unsigned long long>();
+        }
+        c.restore(at, values);
+        return true;
+    }
+
+    inline nlohmann::json dump(probes::result<std::string> const& r) {
+        if ( !r.valid ) return nullptr;
+        return {{"value", r.value}, {"age", r.age.count()}};
+    }
+
+    inline std::optional<probes::result<std::string>> load(nlohmann::json const& j) {
+        if ( !j.is_object() || !j.contains("value") || !j["value"].is_string() ) return std::nullopt;
+        probes::result<std::string> r;
+        r.value = j["value"].get<std::string>();
+        r.valid = true;
+        r.age = std::chrono::seconds(detail::integer(j, "age"));
+        return r;
+    }
+
+    // Writes the state through a temporary file synced before it replaces the previous one, so a
+    // crash or a power loss while writing leaves either of them but never an empty file
+    inline bool write(std::filesystem::path const& path, nlohmann::json state) {
+        state["boot_id"] = boot_id();
+        state["saved"] = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        std::error_code ec;
+        if ( path.has_parent_path() )
+            std::filesystem::create_directories(path.parent_path(), ec);
+
+        auto tmp = path;
+        tmp += ".tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if ( fd < 0 ) return false;
+
+        auto content = state.dump();
+        bool written = true;
+        for (std::size_t offset = 0; written && offset < content.size(); ) {
+            ssize_t w = ::write(fd, content.data() + offset, content.size() - offset);
+            if ( w < 0 && errno == EINTR ) continue;
+            written = w > 0;
+            if ( written ) offset += static_cast<std::size_t>(w);
+        }
+        written = ::fsync(fd) == 0 && written;
+        written = ::close(fd) == 0 && written;
+        if ( !written ) {
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+
+        std::filesystem::rename(tmp, path, ec);
+        if ( ec ) return false;
+
+        // the rename itself is only durable once the directory is synced
+        int dir = ::open(path.has_parent_path() ? path.parent_path().c_str() : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if ( dir >= 0 ) {
+            ::fsync(dir);
+            ::close(dir);
+        }
+        return true;
+    }
+
+    // Reads the saved state keeping what is still valid: nothing saved over max_age ago nor in the
+    // future, and counter baselines only when saved within max_gap in this boot. Probe ages are
+    // brought up to date.
+    inline std::optional<nlohmann::json> read(std::filesystem::path const& path) {
+        std::ifstream in(path);
+        if ( !in ) return std::nullopt;
+        auto state = nlohmann::json::parse(in, nullptr, false);
+        if ( state.is_discarded() || !state.is_object() ) return std::nullopt;
+
+        auto now = std::chrono::system_clock::now().time_since_epoch();
+        auto elapsed = now - std::chrono::milliseconds(detail::integer(state, "saved"));
+        if ( elapsed < std::chrono::seconds(0) || elapsed > max_age ) return std::nullopt;
+
+        auto boot = boot_id();
+        auto saved_boot = state.find("boot_id");
+        if ( elapsed > max_gap || boot.empty() || saved_boot == state.end() || !saved_boot->is_string() || *saved_boot != boot )
+            state.erase("counters");
+
+        if ( state.contains("probes") && state["probes"].is_object() ) {
+            for (auto& probe : state["probes"]) {
+                if ( probe.is_object() )
+                    probe["age"] = detail::integer(probe, "age") + std::chrono::duration_cast<std::chrono::seconds>(elapsed).count();
+            }
+        }
+
+        return state;
+    }
+
+}
@@ -3,9 +3,12 @@
 
 #include <filesystem>
 #include <fstream>
+#include <future>
+#include <set>
 
 #include "../../utils/aws.h"
 #include "../../utils/docker.h"
+#include "../../utils/pipeline.h"
 #include "../../utils/tar.h"
 
 #include "./utils.h"
@@ -19,15 +22,17 @@ public:
   PlatformBackup(thinger::monitor::Config& config, const std::string& hostname, const std::string& tag)
       : ThingerMonitorBackup(config,hostname, tag) {
 
-    backups_folder = this->config().get_data_path()+"/backups";
-    storage = this->config().get_storage();
-    bucket = this->config().get_bucket(storage);
-    region = this->config().get_region(storage);
-    access_key = this->config().get_access_key(storage);
-    secret_key = this->config().get_secret_key(storage);
+    backups_folder = this->config().data_path+"/backups";
+    storage = this->config().storage;
+    bucket = this->config().find_storage(storage).bucket;
+    region = this->config().find_storage(storage).region;
+    access_key = this->config().find_storage(storage).access_key;
+    secret_key = this->config().find_storage(storage).secret_key;
 
     file_to_upload = this->name()+"_"+this->tag()+".tar";
 
+    stream = storage == "S3" && this->config().backup_stream;
+
   }
 
   json backup() override {
@@ -41,11 +46,63 @@ public:
       return data;
     }
 
-    archive = utils::tar::write::create_archive(backups_folder + "/" + name() + "_" + tag() + ".tar");
+    // When streaming, the archive goes to S3 in parts as it is written instead of to a file, so
+    // no disk space is needed for it and upload has nothing left to do
+    std::unique_ptr<S3::MultipartUpload> multipart;
+    std::unique_ptr<utils::part_pipeline> parts;
+    if ( stream ) {
+      multipart = std::make_unique<S3::MultipartUpload>(bucket, region, access_key, secret_key, backups_folder + "/" + file_to_upload,
+          S3::MultipartUpload::options{.concurrency = config().backup_concurrency});
+      if ( !multipart->begin() ) {
+        uploaded["operation"]["upload_s3"]["status"] = false;
+        uploaded["operation"]["upload_s3"]["error"].push_back("Failed initiating upload to S3");
+        data["status"] = false;
+        return data;
+      }
+      // one buffer more than the parts in flight, to fill the next part while they upload
+      parts = std::make_unique<utils::part_pipeline>(S3::MultipartUpload::part_size, config().backup_concurrency + 1,
+          [&multipart](unsigned int part, const std::string& content) { return multipart->upload_part(part, content.data(), content.size()); },
+          config().backup_concurrency);
+      archive = utils::tar::write::create_archive([&parts](const char* block, size_t length) { return parts->write(block, length); });
+    } else {
+      archive = utils::tar::write::create_archive(backups_folder + "/" + file_to_upload);
+    }
+
+    {
+      // Components are backed up concurrently, each one pushing its entries to a single writer
+      // that owns the global archive. At most a few entries wait to be written, so memory stays
+      // bounded while the slowest component sets the duration.
+      utils::tar::write::serializer writer(archive, writer_queue_size);
+
+      auto thinger  = std::async(std::launch::async, [this, &writer] { return backup_thinger(writer); });
+      auto mongodb  = std::async(std::launch::async, [this, &writer] { return backup_mongodb(writer); });
+      auto influxdb = std::async(std::launch::async, [this, &writer] { return backup_influxdb(writer); });
+
+      data["operation"]["backup_thinger"]   = thinger.get();
+      data["operation"]["backup_mongodb"]   = mongodb.get();
+      data["operation"]["backup_influxdb"]  = influxdb.get();
 
-    data["operation"]["backup_thinger"]   = backup_thinger();
-    data["operation"]["backup_mongodb"]   = backup_mongodb();
-    data["operation"]["backup_influxdb"]  = backup_influxdb();
+      data["operation"]["write_archive"]["status"] = writer.close();
+    }
+
+    // Close global archive
+    try {
+      utils::tar::write::close_archive( archive );
+    } catch (const utils::tar::error&) {
+      data["operation"]["write_archive"]["status"] = false;
+    }
+    if ( !data["operation"]["write_archive"]["status"].get<bool>() )
+      data["operation"]["write_archive"]["error"].push_back("Failed writing the backup archive");
+
+    if ( stream ) {
+      // an archive missing a component is not completed, i.e., after a failed dump
+      bool streamed = parts->close();
+      for (auto& element : data["operation"])
+        streamed = streamed && element["status"].get<bool>();
+      uploaded["operation"]["upload_s3"]["status"] = multipart->finish(streamed);
+      if ( !uploaded["operation"]["upload_s3"]["status"].get<bool>() )
+        uploaded["operation"]["upload_s3"]["error"].push_back("Failed uploading to S3");
+    }
 
     // Set global status value
     data["status"] = true;
@@ -56,9 +113,6 @@ public:
       }
     }
 
-    // Close global archive
-    utils::tar::write::close_archive( archive );
-
     return data;
   }
 
@@ -66,10 +120,18 @@ public:
 
     json data;
 
+    // Uploads interrupted by a previous run go first, so their parts are not left behind
     if ( storage == "S3" ) {
+      data["operation"]["resume_s3"] = resume_uploads();
+    }
+
+    if ( stream ) {
+      // Already uploaded while the archive was written, next to the resumed uploads
+      data["operation"]["upload_s3"] = uploaded["operation"]["upload_s3"];
+    } else if ( storage == "S3" ) {
       data["operation"]["upload_s3"] = {};
       if (AWS::multipart_upload_to_s3(backups_folder + "/" + file_to_upload, bucket, region, access_key,
-                                      secret_key)) {
+                                      secret_key, config().backup_concurrency)) {
         data["operation"]["upload_s3"]["status"] = true;
       } else {
         data["operation"]["upload_s3"]["status"] = false;
@@ -77,6 +139,10 @@ public:
       }
     }
 
+    if ( storage == "S3" ) {
+      sweep_uploads();
+    }
+
     data["status"] = true;
     for (auto& element : data["operation"]) {
       if (!element["status"].get<bool>()) {
@@ -108,8 +174,14 @@ private:
 
   struct archive *archive;
 
+  // Entries waiting for the archive writer, up to a dump part of 16 MB each
+  static constexpr std::size_t writer_queue_size = 4;
+
   std::string file_to_upload;
 
+  bool stream;
+  json uploaded = {{"operation", {{"upload_s3", {{"status", false}}}}}};
+
   [[nodiscard]] json create_backups_folder() const {
     json data;
 
@@ -123,27 +195,27 @@ private:
     return data;
   }
 
-  [[nodiscard]] json backup_thinger() {
+  [[nodiscard]] json backup_thinger(utils::tar::write::serializer& writer) const {
     json data;
 
     // Create archive
     auto thinger_archive_filename = "thinger_" + tag() + ".tar.gz";
-    auto thinger_archive = utils::tar::write::create_archive(backups_folder + "/" + tag() + "/" + thinger_archive_filename);
+    auto thinger_archive_path = backups_folder + "/" + tag() + "/" + thinger_archive_filename;
+    auto thinger_archive = utils::tar::write::create_archive(thinger_archive_path);
 
-    // Change path to thinger folder
-    auto initial = std::filesystem::current_path(); //getting path
-    std::filesystem::current_path(config().get_data_path() + "/thinger/");
+    // Paths are absolute, as the working directory is shared with the other components
+    auto thinger_path = config().data_path + "/thinger";
 
     // With tar creation instead of copying to folder we maintain ownership and permissions
     data["status"] = true;
-    if (std::filesystem::exists("users")) {
+    if (std::filesystem::exists(thinger_path + "/users")) {
 
       // Add users
-      utils::tar::write::add_directory(thinger_archive, "users");
+      utils::tar::write::add_directory(thinger_archive, thinger_path + "/users", "users");
     }
 
     // Add certificates
-    utils::tar::write::add_directory(thinger_archive, "certificates");
+    utils::tar::write::add_directory(thinger_archive, thinger_path + "/certificates", "certificates");
 
     // Get plugins
     data["plugins"]  = backup_plugins();
@@ -151,31 +223,33 @@ private:
       data["status"] = data["status"] && data["plugins"]["status"];
 
     // Add plugins to thinger archive
-    std::filesystem::current_path( backups_folder + "/" + tag() );
-    if ( std::filesystem::exists("plugins") ) {
-      utils::tar::write::add_directory(thinger_archive, "plugins");
-      std::filesystem::remove_all("plugins");
+    auto plugins_path = backups_folder + "/" + tag() + "/plugins";
+    if ( std::filesystem::exists(plugins_path) ) {
+      utils::tar::write::add_directory(thinger_archive, plugins_path, "plugins");
+      std::filesystem::remove_all(plugins_path);
     }
 
     utils::tar::write::close_archive(thinger_archive);
 
     // Add backup to main archive and remove file
-    std::filesystem::current_path( backups_folder + "/" + tag() );
-    utils::tar::write::add_entry( archive, thinger_archive_filename);
-    std::filesystem::remove(thinger_archive_filename);
-
-    // Go to initial to current dir
-    std::filesystem::current_path( initial );
+    if ( !writer.push([thinger_archive_path, thinger_archive_filename](struct archive* a) {
+      bool added = utils::tar::write::add_entry(a, thinger_archive_path, thinger_archive_filename) == ARCHIVE_OK;
+      std::filesystem::remove(thinger_archive_path);
+      return added;
+    }) ) {
+      data["status"] = false;
+      data["error"].push_back("Failed adding thinger backup to the archive");
+    }
 
     return data;
   }
 
-  [[nodiscard]] json backup_mongodb() const {
+  [[nodiscard]] json backup_mongodb(utils::tar::write::serializer& writer) const {
 
     json data;
 
     // get mongodb root password
-    std::ifstream compose (config().get_compose_path()+"/docker-compose.yml", std::ifstream::in);
+    std::ifstream compose (config().compose_path+"/docker-compose.yml", std::ifstream::in);
     std::string line;
 
     std::string mongo_password;
@@ -188,63 +262,42 @@ private:
       }
     }
 
-    /* For future reference: pipe mongodbdump to a tar
-    auto entry = utils::tar::write::create_entry(archive, "mongodbdump_"+tag());
-    std::function<void(const char*, size_t, uint64_t, uint64_t)> stdf_write_data_block_to_entry = [this, &entry](const char* data, size_t data_length, uint64_t offset, uint64_t total_length) {
-      archive* a = archive;
-      archive_entry* e = entry;
-      utils::tar::write::write_data_block_to_entry(a, e, data, data_length, offset, total_length);
-    };
-    if ( ! Docker::Container::exec("mongodb", "mongodump -u thinger -p "+mongo_password+" --archive --gzip", true, stdf_write_data_block_to_entry) ) {
-    */
-
-    /* For future reference: how to save the mongodb dump into a file
-     Execute backup in mongodb container with the shared volume as output
-    std::ofstream backup_file(backups_folder+"/"+tag()+"/mongodbdump-"+tag()+".gz", std::ios::binary);
-    if ( ! Docker::Container::exec("mongodb", "mongodump -u thinger -p "+mongo_password+" --archive --gzip", true, backup_file) ) {
-    */
-
     auto mongodbdump_filename = "mongodbdump_" + tag() + ".gz";
 
-    // Execute backup in mongodb container directly into the global archive
-    if ( ! Docker::Container::exec("mongodb",
-                                   "mongodump -u thinger -p "+mongo_password+" --archive=/data/db/"+mongodbdump_filename+" --gzip" ) ) {
+    // Stream the dump from the mongodb container straight into the global archive, without
+    // writing it to the database volume. Its size is not known beforehand, so it goes in parts,
+    // each one handed over to the archive writer once filled. The parts of a failed dump are
+    // already in the archive, only a whole one is marked complete to be restored.
+    utils::tar::write::parts dump(mongodbdump_filename, [&writer](std::string part, std::string content) {
+      return writer.push([part = std::move(part), content = std::move(content)](struct archive* a) {
+        return utils::tar::write::add_data(a, part, content);
+      });
+    });
+    bool executed = Docker::Container::exec("mongodb", "mongodump -u thinger -p "+mongo_password+" --archive --gzip",
+                                            [&dump](const char* block, size_t length) { return dump.write(block, length); });
+    bool closed = dump.close();
+    if ( ! executed || ! closed || ! dump.complete() ) {
       data["status"]  = false;
       data["error"].push_back("Failed executing mongodb backup");
       return data;
     }
 
-    // Change path to mongodb data folder
-    auto initial = std::filesystem::current_path(); //getting path
-    std::filesystem::current_path(config().get_data_path() + "/mongodb/");
-
-    // Add backup to main archive and remove file
-    utils::tar::write::add_entry( archive, mongodbdump_filename);
-    // Removing file in docker container to avoid permission issues
-    if ( ! Docker::Container::exec("mongodb", "rm -f /data/db/"+mongodbdump_filename ) ) {
-      data["status"]  = false;
-      data["error"].push_back("Failed removing mongodb backup");
-      return data;
-    }
-
-    // Go to initial to current dir
-    std::filesystem::current_path( initial );
-
     data["status"] = true;
 
     return data;
   }
 
-  [[nodiscard]] json backup_influxdb() const {
+  [[nodiscard]] json backup_influxdb(utils::tar::write::serializer& writer) const {
     json data;
 
     // Create archive
     auto influxdb2dump_filename = "influxdb2dump_" + tag();
     auto influxdb2dump_archive_filename = influxdb2dump_filename + ".tar";
-    auto influxdb2dump_archive = utils::tar::write::create_archive(backups_folder + "/" + tag() + "/" + influxdb2dump_archive_filename);
+    auto influxdb2dump_archive_path = backups_folder + "/" + tag() + "/" + influxdb2dump_archive_filename;
+    auto influxdb2dump_archive = utils::tar::write::create_archive(influxdb2dump_archive_path);
 
     // get influx token
-    std::ifstream compose(config().get_compose_path() + "/docker-compose.yml", std::ifstream::in);
+    std::ifstream compose(config().compose_path + "/docker-compose.yml", std::ifstream::in);
     std::string line;
 
     std::string influx_token;
@@ -272,12 +325,8 @@ private:
       return data;
     }
 
-    // Change path to influxdb2 data folder
-    auto initial = std::filesystem::current_path(); //getting path
-    std::filesystem::current_path(config().get_data_path() + "/influxdb2/");
-
     // Add backup to influxdb2 archive and remove file
-    utils::tar::write::add_directory( influxdb2dump_archive, influxdb2dump_filename );
+    utils::tar::write::add_directory( influxdb2dump_archive, config().data_path + "/influxdb2/" + influxdb2dump_filename, influxdb2dump_filename );
     utils::tar::write::close_archive( influxdb2dump_archive );
 
     // Removing file in docker container to avoid permission issues
@@ -288,12 +337,15 @@ private:
     }
 
     // Add influxdb2 archive to main archive and remove file
-    std::filesystem::current_path( backups_folder + "/" + tag() );
-    utils::tar::write::add_entry( archive, influxdb2dump_archive_filename );
-    std::filesystem::remove( influxdb2dump_archive_filename );
-
-    // Go to initial to current dir
-    std::filesystem::current_path( initial );
+    if ( !writer.push([influxdb2dump_archive_path, influxdb2dump_archive_filename](struct archive* a) {
+      bool added = utils::tar::write::add_entry( a, influxdb2dump_archive_path, influxdb2dump_archive_filename ) == ARCHIVE_OK;
+      std::filesystem::remove( influxdb2dump_archive_path );
+      return added;
+    }) ) {
+      data["status"] = false;
+      data["error"].push_back("Failed adding influxdb2 backup to the archive");
+      return data;
+    }
 
     data["status"] = true;
 
@@ -305,12 +357,10 @@ private:
 
     json data;
 
-    // Change path to thinger folder
-    auto initial = std::filesystem::current_path(); //getting path
-    std::filesystem::current_path( config().get_data_path() + "/thinger" );
+    auto users_path = config().data_path + "/thinger/users";
 
     // Users folders exists when there are plugins installed
-    if ( ! std::filesystem::exists("users") ) {
+    if ( ! std::filesystem::exists(users_path) ) {
       data["status"] = true;
       data["msg"].push_back("Platform has no users folder");
       return data;
@@ -326,7 +376,7 @@ private:
     }
 
     // Iterate over uses
-    for (const auto & p1 : fs::directory_iterator( "users" ) ) { // users
+    for (const auto & p1 : fs::directory_iterator( users_path ) ) { // users
 
       if (! std::filesystem::exists(p1.path().string()+"/plugins/")) continue; // user has no plugins
 
@@ -371,15 +421,68 @@ private:
     else
       data["status"] = true;
 
-    // set current path to initial
-    std::filesystem::current_path( initial );
+    return data;
+  }
+
+  // Resumes the uploads of archives left by previous runs with their journal, and aborts the
+  // ones that can not be resumed, as streamed uploads or journals without their archive. Those
+  // failing again are kept for the next run, so they do not fail this one.
+  json resume_uploads() {
+    json data;
+    data["status"] = true;
+
+    std::error_code ec;
+    const std::string suffix(S3::MultipartUpload::journal_suffix);
+    for (auto const& entry : fs::directory_iterator(backups_folder, ec)) {
+      auto journal_path = entry.path().string();
+      if ( !journal_path.ends_with(suffix) ) continue;
+
+      auto archive_path = journal_path.substr(0, journal_path.size() - suffix.size());
+      if ( fs::path(archive_path).filename() == file_to_upload ) continue;
+
+      auto journal = S3::MultipartUpload::read_journal(archive_path);
+      if ( journal && journal->contains("size") && fs::exists(archive_path) ) {
+        LOG_INFO(fmt::format("[_BACKUP] Resuming upload of {0}", archive_path));
+        if ( AWS::multipart_upload_to_s3(archive_path, bucket, region, access_key, secret_key, config().backup_concurrency) ) {
+          fs::remove(archive_path, ec);
+          data["resumed"].push_back(fs::path(archive_path).filename().string());
+        } else {
+          data["error"].push_back("Failed resuming upload of " + fs::path(archive_path).filename().string());
+        }
+        continue;
+      }
+
+      if ( journal ) {
+        AWS::abort_upload_to_s3(journal->value("key", std::string()), (*journal)["upload_id"].get<std::string>(), bucket, region, access_key, secret_key);
+      }
+      fs::remove(journal_path, ec);
+    }
 
     return data;
   }
 
+  // Aborts the uploads of this platform's backups left unfinished for longer than configured,
+  // but the ones journaled to be resumed
+  void sweep_uploads() {
+    std::set<std::string> keep;
+    std::error_code ec;
+    const std::string suffix(S3::MultipartUpload::journal_suffix);
+    for (auto const& entry : fs::directory_iterator(backups_folder, ec)) {
+      auto journal_path = entry.path().string();
+      if ( !journal_path.ends_with(suffix) ) continue;
+      if ( auto journal = S3::MultipartUpload::read_journal(journal_path.substr(0, journal_path.size() - suffix.size())) )
+        keep.insert((*journal)["upload_id"].get<std::string>());
+    }
+
+    auto swept = AWS::sweep_uploads_from_s3(name() + "_", config().backup_stale_uploads, keep, bucket, region, access_key, secret_key);
+    if ( swept > 0 )
+      LOG_INFO(fmt::format("[_BACKUP] Aborted {0} stale uploads to S3", swept));
+  }
+
   [[nodiscard]] bool clean_backup() const {
     std::filesystem::remove_all(backups_folder+"/"+tag());
     std::filesystem::remove_all(backups_folder+"/"+file_to_upload);
+    std::filesystem::remove_all(S3::MultipartUpload::journal_path(backups_folder+"/"+file_to_upload));
 
     return true;
   }
@@ -1,6 +1,7 @@
 
 #include "../restore.h"
 
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 
@@ -21,12 +22,12 @@ public:
     PlatformRestore(thinger::monitor::Config& config, const std::string& hostname, const std::string& tag)
       : ThingerMonitorRestore(config,hostname,tag) {
 
-        backups_folder = this->config().get_data_path()+"/backups";
-        storage = this->config().get_storage();
-        bucket = this->config().get_bucket(storage);
-        region = this->config().get_region(storage);
-        access_key = this->config().get_access_key(storage);
-        secret_key = this->config().get_secret_key(storage);
+        backups_folder = this->config().data_path+"/backups";
+        storage = this->config().storage;
+        bucket = this->config().find_storage(storage).bucket;
+        region = this->config().find_storage(storage).region;
+        access_key = this->config().find_storage(storage).access_key;
+        secret_key = this->config().find_storage(storage).secret_key;
 
         archive_name = this->name()+"_"+this->tag();
         if ( utils::version::is_current_version_newer("1.0.0") )
@@ -74,10 +75,16 @@ public:
 
         // Loop over files and do what needs to be done with each of them, extracting them as neccesary
         for(const std::string& file : files) {
+          // a dump written in parts is restored once, from its first part
+          if ( file.find(".part") != std::string::npos && !file.ends_with(utils::tar::part_name("", 0)) )
+            continue;
+          if ( file.ends_with(utils::tar::complete_name("")) )
+            continue;
+
           if ( file.starts_with("thinger") )
             data["operation"]["restore_thinger"] = restore_thinger(file);
           else if ( file.starts_with("mongodb") )
-            data["operation"]["restore_mongodb"] = restore_mongodb(file);
+            data["operation"]["restore_mongodb"] = restore_mongodb(file, files);
           else if ( file.starts_with("influxdb") )
             data["operation"]["restore_influxdb"] = restore_influxdb(file);
 
@@ -111,7 +118,8 @@ public:
 
         if ( storage == "S3" ) {
             data["operation"]["download_s3"] = {};
-            if (AWS::download_from_s3(backups_folder + "/" + archive_name, bucket, region, access_key, secret_key)) {
+            if (AWS::download_from_s3(backups_folder + "/" + archive_name, bucket, region, access_key, secret_key,
+                                    config().backup_concurrency)) {
                 data["operation"]["download_s3"]["status"] = true;
             } else {
                 data["operation"]["download_s3"]["status"] = false;
@@ -198,7 +206,7 @@ private:
       // Extract contents of thinger archive
       auto thinger_archive = utils::tar::read::create_archive( file );
 
-      std::filesystem::current_path(config().get_data_path() + "/thinger/");
+      std::filesystem::current_path(config().data_path + "/thinger/");
 
       if ( ! utils::tar::read::extract( thinger_archive ) ) {
         data["status"] = false;
@@ -223,10 +231,19 @@ private:
       return data;
     }
 
-    [[nodiscard]] json restore_mongodb(std::string_view file) const {
+    [[nodiscard]] json restore_mongodb(std::string_view file, std::vector<std::string> const& files) const {
 
       json data;
 
+      // a dump written in parts that failed midway has no completion marker
+      auto parts = file.find(".part");
+      if ( parts != std::string_view::npos &&
+           std::find(files.begin(), files.end(), utils::tar::complete_name(file.substr(0, parts))) == files.end() ) {
+        data["status"] = false;
+        data["error"].push_back("Incomplete mongodb backup, its dump failed while being archived");
+        return data;
+      }
+
       // Give mongodb directories permission within docker
       if ( getuid() != 0 && ! Docker::Container::exec("mongodb", "chown 1000:1000 /data/db" ) ) {
         data["status"] = false;
@@ -236,18 +253,25 @@ private:
 
       // Change path to mongodb data dir
       auto initial = std::filesystem::current_path(); //getting path
-      std::filesystem::current_path( config().get_data_path() + "/mongodb/" );
+      std::filesystem::current_path( config().data_path + "/mongodb/" );
 
-      // Extract mongodb dump from main archive
+      // Extract mongodb dump from main archive, streamed dumps are joined from their parts
       // TODO: differentiate between tar (old) and gzip (new)
-      if ( ! utils::tar::read::extract_file(archive, file) ) {
+      if ( parts != std::string_view::npos ) {
+        file = file.substr(0, parts);
+        if ( utils::tar::read::extract_parts(archive, file, std::string(file)) == 0 ) {
+          data["status"]  = false;
+          data["error"].push_back("Failed extracting mongodb backup from main archive");
+          return data;
+        }
+      } else if ( ! utils::tar::read::extract_file(archive, file) ) {
         data["status"]  = false;
         data["error"].push_back("Failed extracting mongodb backup from main archive");
         return data;
       }
 
       // get mongodb root password
-      std::ifstream compose (config().get_compose_path()+"/docker-compose.yml", std::ifstream::in);
+      std::ifstream compose (config().compose_path+"/docker-compose.yml", std::ifstream::in);
       std::string line;
 
       std::string mongo_password;
@@ -262,7 +286,7 @@ private:
 
       Docker::Container::exec("mongodb", "chown 999:999 /data/db/");
 
-      if ( !Docker::Container::exec("mongodb", "mongorestore --gzip --archive=/data/db/" + std::string(file.data()) + " -u thinger -p " + mongo_password) ) {
+      if ( !Docker::Container::exec("mongodb", "mongorestore --gzip --archive=/data/db/" + std::string(file) + " -u thinger -p " + mongo_password) ) {
         data["status"] = false;
         data["error"].push_back("Failed restoring mongodb backup");
         return data;
@@ -314,7 +338,7 @@ private:
       // Extract contents of influxdb archive
       auto influxdb_archive = utils::tar::read::create_archive( file );
 
-      std::filesystem::current_path( config().get_data_path() + "/influxdb2/" );
+      std::filesystem::current_path( config().data_path + "/influxdb2/" );
 
       if ( ! utils::tar::read::extract( influxdb_archive ) ) {
         data["status"] = false;
@@ -359,19 +383,19 @@ private:
         json data;
 
         // Executed after restore_thinger
-        if ( ! std::filesystem::exists( config().get_data_path() + "/thinger/plugins/" ) ) {
+        if ( ! std::filesystem::exists( config().data_path + "/thinger/plugins/" ) ) {
             data["status"] = true;
             data["msg"].push_back("Platform has no users folder");
             return data;
         }
 
-        for (const auto & p1 : fs::directory_iterator(config().get_data_path()+"/thinger/users/")) { // users
+        for (const auto & p1 : fs::directory_iterator(config().data_path+"/thinger/users/")) { // users
             if (! std::filesystem::exists(p1.path().string()+"/plugins/")) continue;
 
             std::string user = p1.path().filename().string();
 
             // restore networks
-            std::string network_id = Docker::Network::create_from_inspect(config().get_data_path()+"/thinger/plugins/"+user+"-network.json");
+            std::string network_id = Docker::Network::create_from_inspect(config().data_path+"/thinger/plugins/"+user+"-network.json");
             if (network_id.empty()) {
                 data["error"].push_back("Failed restoring "+user+" docker network");
             } else {
@@ -393,7 +417,7 @@ private:
 
                 if ( thinger::monitor::config::get(j, "/task/type"_json_pointer, std::string("")) == "docker" ) {
 
-                    if (Docker::Container::create_from_inspect(config().get_data_path()+"/thinger/plugins/"+container_name+".json", network_id))
+                    if (Docker::Container::create_from_inspect(config().data_path+"/thinger/plugins/"+container_name+".json", network_id))
                         data["msg"].push_back("Restored "+container_name+" docker container");
                     else
                         data["error"].push_back("Failed restoring "+container_name+" docker container");
@@ -410,7 +434,7 @@ private:
         }
 
         // Remove plugins restore folder
-        std::filesystem::remove_all(config().get_data_path()+"/thinger/plugins/");
+        std::filesystem::remove_all(config().data_path+"/thinger/plugins/");
 
         if (data.contains("error"))
             data["status"] = false;
@@ -8,7 +8,7 @@
 
 namespace platform::utils::influxdb {
 
-    std::string get_version() { // I could always execute a command in the docker container¿?
+    inline std::string get_version() { // I could always execute a command in the docker container¿?
         httplib::Client cli("http://localhost:8086");
 
         // Wait for influxdb to be up for up to 1 min
@@ -5,16 +5,17 @@ class ThingerMonitorRestore {
 protected:
 
     ThingerMonitorRestore(thinger::monitor::Config& config, const std::string& name, const std::string& tag)
-      : config_(config), name_(name), tag_(tag)
+      : config_(config.snapshot()), name_(name), tag_(tag)
     {}
 
-    thinger::monitor::Config config() const { return config_; }
+    // configuration when the task was created, not affected by later updates
+    thinger::monitor::config::snapshot const& config() const { return *config_; }
     std::string name() const { return name_; }
     std::string tag() const { return tag_; }
 
 private:
 
-    thinger::monitor::Config config_;
+    std::shared_ptr<const thinger::monitor::config::snapshot> config_;
     std::string name_;
     std::string tag_;
 
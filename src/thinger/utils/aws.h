@@ -2,6 +2,7 @@
 
 #include <chrono>
 #include <filesystem>
+#include <set>
 #include <spdlog/spdlog.h>
 
 #include <httplib.h>
@@ -19,14 +20,29 @@
 
 namespace AWS {
 
-    bool multipart_upload_to_s3(const std::string& file_path, std::string& bucket, std::string& region, std::string& access_key, std::string& secret_key) {
+    inline bool multipart_upload_to_s3(const std::string& file_path, std::string& bucket, std::string& region, std::string& access_key, std::string& secret_key, unsigned int concurrency = 4) {
 
-        auto mpu = S3::MultipartUpload(bucket, region, access_key, secret_key, file_path);
+        auto mpu = S3::MultipartUpload(bucket, region, access_key, secret_key, file_path, {.concurrency = concurrency});
 
         return mpu.upload();
     }
 
-    bool upload_to_s3(const std::string& file_path, const std::string& bucket, const std::string& region, const std::string& access_key, const std::string& secret_key) {
+    inline bool abort_upload_to_s3(const std::string& key, const std::string& upload_id, const std::string& bucket, const std::string& region, const std::string& access_key, const std::string& secret_key) {
+
+        S3::Connection connection(bucket, region, access_key, secret_key);
+
+        return S3::abort_multipart_upload(connection, key, upload_id);
+    }
+
+    // Aborts the unfinished multipart uploads of keys starting with prefix older than max_age, but the ones to keep
+    inline size_t sweep_uploads_from_s3(const std::string& prefix, std::chrono::seconds max_age, const std::set<std::string>& keep, const std::string& bucket, const std::string& region, const std::string& access_key, const std::string& secret_key) {
+
+        S3::Connection connection(bucket, region, access_key, secret_key);
+
+        return S3::sweep_uploads(connection, prefix, max_age, keep);
+    }
+
+    inline bool upload_to_s3(const std::string& file_path, const std::string& bucket, const std::string& region, const std::string& access_key, const std::string& secret_key) {
 
         const std::string content_type = "application/x-compressed-tar";
 
@@ -60,41 +76,11 @@ namespace AWS {
 
     }
 
-    bool download_from_s3(const std::string& file_path, const std::string& bucket, const std::string& region, const std::string& access_key, const std::string& secret_key) {
-
-        const std::string content_type = "application/x-compressed-tar";
-
-        httplib::Client cli("https://"+bucket+".s3-"+region+".amazonaws.com");
-
-        auto date = Date();
-        auto date_string = date.to_rfc5322();
-        std::string filename = std::filesystem::path(file_path).filename();
-
-        const std::string signature_string = "GET\n\n"+content_type+"\n"+date_string+"\n/"+bucket+"/"+filename;
-
-        const std::string signature_hash = Crypto::base64::encode(Crypto::hash::hmac_sha1(
-            const_cast<std::string &>(secret_key), const_cast<std::string &>(signature_string)));
-
-        httplib::Headers headers = {
-            { "Host", bucket+".s3.amazonaws.com" },
-            { "Date", date_string}, // Ex: Mon, 03 Jan 2022 12:46:34 +0100
-            { "Content-Type", content_type},
-            { "Authorization", "AWS "+access_key+":"+signature_hash}
-        };
-
-        std::ofstream file(file_path);
-
-        LOG_INFO(fmt::format("[____AWS] Downloading file {0} from {1} bucket", filename, bucket));
+    inline bool download_from_s3(const std::string& file_path, const std::string& bucket, const std::string& region, const std::string& access_key, const std::string& secret_key, unsigned int concurrency = 4) {
 
-        cli.set_default_headers(headers);
-        auto res = cli.Get("/"+filename,
-          [&file](const char *data, size_t data_length) {
-            file.write(data, static_cast<int>(data_length));
-            file.flush(); // synchronize with underlying storage
-            return true;
-          });
+        auto download = S3::Download(bucket, region, access_key, secret_key, file_path, {.concurrency = concurrency});
 
-        return HttpStatus::isSuccessful(res->status);
+        return download.download();
     }
 
 }
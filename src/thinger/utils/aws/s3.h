@@ -2,11 +2,36 @@
 #include <httplib.h>
 #include <spdlog/spdlog.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <sstream>
+#include <thread>
 #include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
 
 #include "../date.h"
 #include "../crypto.h"
 #include "../http_status.h"
+#include "../pipeline.h"
+#include "../queue.h"
+#include "../xml.h"
 
 class S3 {
 
@@ -76,57 +101,268 @@ public:
 
     };
 
-    class MultipartUpload {
+    /**
+        Signed requests to a bucket over a pool of keep-alive connections, one for each request in
+        flight, so requests reuse a connection instead of paying a new handshake. Requests wait
+        for a free connection.
+    */
+    class Connection {
 
         public:
 
-        MultipartUpload(std::string& bucket, std::string& region, std::string& access_key, std::string& secret_key, std::string  file_path) :
-            bucket_(bucket),
-            region_(region),
-            access_key_(access_key),
-            secret_key_(secret_key),
-            file_path_(std::move(file_path))
+        Connection(std::string const& bucket, std::string const& region, std::string const& access_key, std::string const& secret_key,
+                   std::string const& endpoint = "", unsigned int connections = 1) :
+            url(bucket+".s3-"+region+".amazonaws.com"),
+            awsv4(access_key, secret_key, region, "s3"),
+            clients(std::max(connections, 1u))
         {
-            url = bucket+".s3-"+region+".amazonaws.com";
-            awsv4 = std::make_unique<AWSV4>(access_key, secret_key, region, "s3");
-
-            // Initialize http client
-            cli = std::make_unique<httplib::Client>("https://"+url);
             httplib::Headers headers = {
-                { "Host", bucket_+".s3-"+region_+".amazonaws.com" },
+                { "Host", url },
             };
-            cli->set_default_headers(headers);
-            cli->set_write_timeout(30, 0); // 30 seconds
-            cli->set_read_timeout(30, 0); // 30 seconds
-            cli->set_keep_alive(true);
+            for (size_t i = 0; i < clients.capacity(); i++) {
+                auto cli = std::make_unique<httplib::Client>(endpoint.empty() ? "https://"+url : endpoint);
+                cli->set_default_headers(headers);
+                cli->set_write_timeout(30, 0); // 30 seconds
+                cli->set_read_timeout(30, 0); // 30 seconds
+                cli->set_keep_alive(true);
+                clients.push(std::move(cli));
+            }
+        }
+
+        httplib::Result request(
+          const std::string& method,
+          const std::string& path,
+          const std::string& query_parameters,
+          std::string const& payload,
+          const std::string& c_type)
+        {
+            return request(method,path,query_parameters,payload.c_str(),payload.size(),c_type);
+        }
+
+        httplib::Result request(
+          const std::string& method,
+          const std::string& path,
+          const std::string& query_parameters,
+          const char *buffer,
+          const size_t buffer_size_req,
+          const std::string& c_type)
+        {
+            auto headers = sign(method, path, query_parameters, Crypto::hash::sha256(buffer, buffer_size_req));
+
+            auto target = query_parameters.empty() ? path : path+"?"+query_parameters;
+
+            // Waits for a client of the pool, given back once the response is read
+            auto cli = clients.pop();
+            if ( !cli ) return httplib::Result{nullptr, httplib::Error::Unknown};
+
+            httplib::Result res{nullptr, httplib::Error::Unknown};
+            if (method == "POST") {
+                res = (*cli)->Post(target, headers, buffer, buffer_size_req, c_type);
+            } else if (method == "PUT") {
+                res = (*cli)->Put(target, headers, buffer, buffer_size_req, c_type);
+            } else if (method == "DELETE") {
+                res = (*cli)->Delete(target, headers, buffer, buffer_size_req, c_type);
+            } else if (method == "GET") {
+                res = (*cli)->Get(target, headers);
+            } else if (method == "HEAD") {
+                res = (*cli)->Head(target, headers);
+            }
+
+            clients.push(std::move(*cli));
+
+            return res;
+
+        }
+
+        /**
+            GET of an object handing its body to receiver as it arrives, i.e., to write it in place.
+            The extra headers, as Range or If-Match, are sent unsigned. The response handler sees
+            the status and headers before the body, and cancels the request returning false.
+        */
+        httplib::Result get(
+          const std::string& path,
+          const httplib::Headers& extra_headers,
+          httplib::ResponseHandler response_handler,
+          httplib::ContentReceiver receiver)
+        {
+            auto headers = sign("GET", path, "", Crypto::hash::sha256("", 0));
+            headers.insert(extra_headers.begin(), extra_headers.end());
+
+            auto cli = clients.pop();
+            if ( !cli ) return httplib::Result{nullptr, httplib::Error::Unknown};
+
+            auto res = (*cli)->Get(path, headers, std::move(response_handler), std::move(receiver));
+
+            clients.push(std::move(*cli));
+
+            return res;
+        }
+
+        private:
+
+        std::string url;
+        AWSV4 awsv4;
+        utils::bounded_queue<std::unique_ptr<httplib::Client>> clients;
+
+        [[nodiscard]] httplib::Headers sign(
+          const std::string& method,
+          const std::string& path,
+          const std::string& query_parameters,
+          std::string const& payload_hash)
+        {
+            auto date = Date();
+            auto canonical_request = generate_canonical_request(method,path,query_parameters,payload_hash,date);
+
+            return {
+                { "x-amz-content-sha256", payload_hash },
+                { "x-amz-date", date.to_iso8601('\0',true,"utc") },
+                { "Authorization", awsv4.get_auth_header(date, canonical_request) }
+            };
+        }
+
+        [[nodiscard]] std::string generate_canonical_request(
+          const std::string& method,
+          const std::string& path,
+          const std::string& query_parameters,
+          std::string const& payload_hash,
+          Date date) const
+        {
+
+            std::string canonical_request =
+                method+"\n"+
+                path+"\n"+
+                query_parameters+"\n"+
+                "host:"+url+"\n"+
+                "x-amz-content-sha256:"+payload_hash+"\n"+
+                "x-amz-date:"+date.to_iso8601('\0',true,"utc")+"\n\n"+
+                "host;x-amz-content-sha256;x-amz-date\n"+
+                payload_hash;
+
+            return canonical_request;
+        }
+
+    };
+
+    /**
+        Aborts a multipart upload, S3 keeps and bills its parts until then.
+        @return Boolean indicating if the upload was aborted
+    */
+    static bool abort_multipart_upload(Connection& connection, std::string const& key, std::string const& upload_id) {
+
+        LOG_WARNING(fmt::format("[____AWS] Aborting multipart upload of {0}; upload id: {1}", key, upload_id));
+
+        std::string payload;
+        auto res = connection.request("DELETE", "/"+key,"uploadId="+uri_encode(upload_id),payload,"text/plain");
+
+        if ( res.error() != httplib::Error::Success || !HttpStatus::isSuccessful(res->status) ) {
+            LOG_ERROR(fmt::format("[____AWS] Failed aborting upload id {0}", upload_id));
+            return false;
+        }
+
+        return true;
+    }
+
+    /**
+        Aborts the multipart uploads whose key starts with prefix initiated over max_age ago, but
+        the ones to keep. They are left behind by an agent that died or lost the network while
+        uploading, and are billed for their parts until aborted.
+        @return Number of uploads aborted
+    */
+    static size_t sweep_uploads(Connection& connection, std::string const& prefix, std::chrono::seconds max_age, std::set<std::string> const& keep) {
+
+        size_t aborted = 0;
+        // in seconds, as nanoseconds since the epoch overflow past 2262
+        auto now = std::chrono::time_point_cast<std::chrono::seconds>(std::chrono::system_clock::now());
+        std::string key_marker;
+        std::string upload_id_marker;
+
+        for (;;) {
+
+            // query parameters sorted by name, as signed
+            std::string query;
+            if ( !key_marker.empty() ) query += "key-marker="+uri_encode(key_marker)+"&";
+            query += "prefix="+uri_encode(prefix)+"&";
+            if ( !upload_id_marker.empty() ) query += "upload-id-marker="+uri_encode(upload_id_marker)+"&";
+            query += "uploads=";
+
+            auto res = connection.request("GET", "/", query, "", "text/plain");
+            if ( res.error() != httplib::Error::Success || !HttpStatus::isSuccessful(res->status) ) {
+                LOG_ERROR(fmt::format("[____AWS] Failed listing multipart uploads of {0}", prefix));
+                return aborted;
+            }
+
+            for (auto const& upload : XML::get_elements(res->body, "Upload")) {
+                auto key = element(upload, "Key");
+                auto upload_id = element(upload, "UploadId");
+                auto initiated = parse_time(element(upload, "Initiated"));
+                if ( keep.contains(upload_id) || !initiated || now - *initiated < max_age ) continue;
+
+                LOG_INFO(fmt::format("[____AWS] Sweeping stale upload of {0} initiated {1}", key, element(upload, "Initiated")));
+                if ( abort_multipart_upload(connection, key, upload_id) ) aborted++;
+            }
+
+            if ( element(res->body, "IsTruncated") != "true" ) break;
+            key_marker = element(res->body, "NextKeyMarker");
+            upload_id_marker = element(res->body, "NextUploadIdMarker");
+            if ( key_marker.empty() ) break;
+        }
+
+        return aborted;
+    }
+
+    class MultipartUpload {
 
-            // Set class attributes
-            // open file and calculate number of parts
-            std::ifstream file(file_path_);
-            auto file_size = std::filesystem::file_size(file_path_);
-            parts = file_size / buffer_size;
-            if (file_size % buffer_size != 0) parts = parts+1;
+        public:
 
-            // TODO: request list of parts to S3 and form XML body to complete from the response
-            parts_list = std::unique_ptr<MPUPart[]>{new MPUPart[parts+1]};
+        // Tuning of the part uploads
+        struct options {
+            unsigned int concurrency = 4; // parts uploaded at once, each one over its own keep-alive connection
+            unsigned int retries = 4; // attempts of a part after the first one failed
+            std::chrono::milliseconds backoff{1000}; // before the first retry of a part, doubled on every retry
+            std::string endpoint; // overrides https://<bucket>.s3-<region>.amazonaws.com, i.e., with a local stand-in
+        };
 
+        MultipartUpload(std::string& bucket, std::string& region, std::string& access_key, std::string& secret_key, std::string  file_path) :
+            MultipartUpload(bucket, region, access_key, secret_key, std::move(file_path), options{})
+        {}
+
+        MultipartUpload(std::string& bucket, std::string& region, std::string& access_key, std::string& secret_key, std::string  file_path, options opts) :
+            file_path_(std::move(file_path)),
+            options_(std::move(opts)),
+            connection(bucket, region, access_key, secret_key, options_.endpoint, std::max(options_.concurrency, 1u))
+        {
+            options_.concurrency = std::max(options_.concurrency, 1u);
+
+            // The object is named after the file, which is only read by upload
             filename = std::filesystem::path(file_path_).filename();
 
         }
 
         /**
             Handles the full lifecycle of the multipart upload. Initiate Upload, Upload Part, Complete Upload, Abort Upload, List Parts.
+            Uploaded parts are journaled next to the file, and an upload interrupted while sending
+            parts is resumed by the next upload of the same file, which only sends the parts S3
+            does not have.
             @return Boolean indicating if the upload operation was successful
         */
         bool upload() {
 
-            if (!initiate_upload()) {
+            std::error_code ec;
+            file_size = std::filesystem::file_size(file_path_, ec);
+            if ( !ec ) file_time = std::filesystem::last_write_time(file_path_, ec).time_since_epoch().count();
+            if ( ec ) {
+                LOG_ERROR(fmt::format("[____AWS] Failed opening {0}", file_path_));
                 return false;
             }
+            resumable = true;
 
-            // Upload parts
+            if (!resume() && !initiate_upload()) {
+                return false;
+            }
+
+            // Upload parts, an interrupted upload is kept with its journal to be resumed
             if (!upload_parts()) {
-                abort_upload();
+                LOG_WARNING(fmt::format("[____AWS] Upload of {0} interrupted, it may be resumed from its journal", filename));
                 return false;
             }
 
@@ -139,203 +375,596 @@ public:
 
         }
 
+        /**
+            Streaming alternative to upload, for objects whose size is not known beforehand: begin,
+            then upload_part with each part as it is produced, and finish. Streamed uploads can not
+            be resumed, their journal only lets a later run abort them.
+        */
+        bool begin() {
+            resumable = false;
+            return initiate_upload();
+        }
+
+        /**
+            Uploads a part, numbered from 1, retrying with exponential backoff on connection errors,
+            throttling and server errors. Every part but the last must be at least 5 MB. Parts may
+            be uploaded from several threads at once, up to the concurrency.
+            @return Boolean indicating if the part was uploaded
+        */
+        bool upload_part(unsigned int part, const char* data, size_t size) {
+
+            auto backoff = options_.backoff;
+
+            for (unsigned int attempt = 0; ; attempt++) {
+
+                LOG_INFO(fmt::format("[____AWS] Multipart upload of {0}; Uploading part {1}", filename, part));
+
+                auto res = connection.request("PUT","/"+filename,
+                    "partNumber="+std::to_string(part)+"&uploadId="+uri_encode(upload_id),data,size,content_type);
+
+                if ( res.error() == httplib::Error::Success && HttpStatus::isSuccessful(res->status) ) {
+                    std::scoped_lock lock(parts_mutex);
+                    if ( parts_list.size() < part ) parts_list.resize(part);
+                    parts_list[part-1] = MPUPart{part, res->get_header_value("ETag")};
+                    journal_part(parts_list[part-1]);
+                    return true;
+                }
+
+                bool retriable = res.error() != httplib::Error::Success || res->status == 429 || res->status >= 500;
+                if ( !retriable || attempt >= options_.retries ) {
+                    LOG_ERROR(fmt::format("[____AWS] Failed Multipart upload {0}; Part {1} after {2} attempts", filename, part, attempt + 1));
+                    return false;
+                }
+
+                LOG_WARNING(fmt::format("[____AWS] Multipart upload of {0}; Retrying part {1} in {2} ms", filename, part, backoff.count()));
+                std::this_thread::sleep_for(backoff);
+                backoff *= 2;
+            }
+        }
+
+        /**
+            Completes a streamed upload, or aborts it when the parts could not be produced or uploaded.
+            @return Boolean indicating if the object was created
+        */
+        bool finish(bool parts_uploaded) {
+
+            if ( parts_uploaded && complete_upload() ) {
+                return true;
+            }
+
+            abort_upload();
+            return false;
+        }
+
+        // Size of the parts of an upload, the file is split in parts of this size
+        static constexpr size_t part_size = 10<<20; // 10 Megabytes -> with a max of 10.000 parts allows a file of up to 100GiB
+
+        // The journal of the upload of a file is the file path followed by this suffix
+        static constexpr std::string_view journal_suffix = ".upload.json";
+
+        static std::string journal_path(std::string const& file_path) {
+            return file_path + std::string(journal_suffix);
+        }
+
+        /**
+            Reads the journal of the upload of a file: a json line with the key, the upload id,
+            the part size and, for files, their size and modification time, followed by a json
+            line with the part number and ETag of every part uploaded.
+            @return The journal as an object with its parts by number, empty without a valid one
+        */
+        static std::optional<nlohmann::json> read_journal(std::string const& file_path) {
+
+            std::ifstream in(journal_path(file_path));
+            std::string line;
+            if ( !in || !std::getline(in, line) ) return std::nullopt;
+
+            auto journal = nlohmann::json::parse(line, nullptr, false);
+            if ( journal.is_discarded() || !journal.is_object() || !journal.contains("upload_id") || !journal["upload_id"].is_string() )
+                return std::nullopt;
+
+            // a line cut by a crash while writing is ignored
+            journal["parts"] = nlohmann::json::object();
+            while ( std::getline(in, line) ) {
+                auto part = nlohmann::json::parse(line, nullptr, false);
+                if ( part.is_discarded() || !part.is_object() || !part.contains("part") || !part["part"].is_number_unsigned() ||
+                     !part.contains("etag") || !part["etag"].is_string() ) continue;
+                journal["parts"][std::to_string(part["part"].get<unsigned int>())] = part["etag"];
+            }
+
+            return journal;
+        }
+
         ~MultipartUpload() = default;
 
         private:
-        std::string bucket_;
-        std::string region_;
-        std::string access_key_;
-        std::string secret_key_;
         std::string file_path_;
         std::string filename;
-        unsigned int parts;
+        options options_;
 
         const std::string content_type = "application/x-compressed-tar";
-        const size_t buffer_size = 10<<20; // 10 Megabytes -> with a max of 10.000 parts allows a file of up to 100GiB
+        const size_t buffer_size = part_size;
 
         std::string upload_id;
 
-        std::string url;
-        std::unique_ptr<AWSV4> awsv4{};
-        std::unique_ptr<httplib::Client> cli{};
+        Connection connection;
+
+        // the file uploaded, to resume only uploads of the same file
+        bool resumable = false;
+        unsigned long long file_size = 0;
+        long long file_time = 0;
 
         struct MPUPart {
             unsigned int part_id{};
             std::string ETag;
         };
-        std::unique_ptr<MPUPart[]> parts_list; // TODO: request list of parts to S3 and form XML body to complete from the response
+        std::vector<MPUPart> parts_list; // indexed by part number, so the ETags are in part order whatever order parts complete in
+        std::mutex parts_mutex; // guards the parts and the journal
 
         bool initiate_upload() {
 
             LOG_INFO(fmt::format("[____AWS] Inititiating upload of {0}", file_path_));
 
             std::string payload;
-            auto res = request("POST", "/"+filename,"uploads=",payload, content_type);
+            auto res = connection.request("POST", "/"+filename,"uploads=",payload, content_type);
 
             if ( res.error() != httplib::Error::Success || !HttpStatus::isSuccessful(res->status) ) {
                 LOG_ERROR(fmt::format("[____AWS] Failed initiating upload {0}", filename));
-                return HttpStatus::isSuccessful(res->status);
+                return false;
             }
 
-            upload_id = XML::get_element_value(res->body, "UploadId");
+            upload_id = element(res->body, "UploadId");
+
+            std::scoped_lock lock(parts_mutex);
+            parts_list.clear();
+            write_journal();
 
             LOG_INFO(fmt::format("[____AWS] Upload initiated with upload id {0}", upload_id));
-            return HttpStatus::isSuccessful(res->status);
+            return true;
         }
 
         bool abort_upload() {
-
-            LOG_WARNING(fmt::format("[____AWS] Aborting multipart upload for file: {0}; and upload id: {1}", file_path_, upload_id));
-
-            std::string payload;
-            auto res = request("DELETE", "/"+filename,"uploadId="+upload_id,payload,"text/plain");
-
-            if ( res.error() != httplib::Error::Success || !HttpStatus::isSuccessful(res->status) ) {
-                LOG_ERROR(fmt::format("[____AWS] Failed aborting upload id {0}", upload_id));
-            }
-
-            return HttpStatus::isSuccessful(res->status);
+            bool aborted = abort_multipart_upload(connection, filename, upload_id);
+            remove_journal();
+            return aborted;
         }
 
-        bool upload_parts() {
-            std::string payload_hash;
-            std::string canonical_request;
-            std::string auth_header;
-            httplib::Headers headers;
-            Date date;
+        // Takes over the upload of a previous run from the journal of the file, when it is for the
+        // same file and S3 still has it. Parts come from ListParts, as the journal may miss the last
+        // ones uploaded, and are kept when they have the expected size and the journaled ETag.
+        bool resume() {
 
-            auto *buffer = new char[buffer_size];
+            auto journal = read_journal(file_path_);
+            if ( !journal ) return false;
 
-            // Open and calculate part size
-            std::ifstream file(file_path_);
-            auto file_size = std::filesystem::file_size(file_path_);
-            auto last_part_size = file_size % buffer_size;
+            auto journaled_id = (*journal)["upload_id"].get<std::string>();
+            if ( journal->value("key", std::string()) != filename || journal->value("part_size", 0ULL) != part_size ||
+                 journal->value("size", 0ULL) != file_size || journal->value("mtime", 0LL) != file_time ) {
+                LOG_WARNING(fmt::format("[____AWS] Discarding upload {0} of {1} as the file changed", journaled_id, filename));
+                abort_multipart_upload(connection, journal->value("key", filename), journaled_id);
+                remove_journal();
+                return false;
+            }
 
-            for (unsigned int i = 1; i < parts; i++) { // send part by part
+            upload_id = journaled_id;
+            auto listed = list_parts();
+            if ( !listed ) {
+                LOG_WARNING(fmt::format("[____AWS] Upload {0} of {1} can not be resumed", upload_id, filename));
+                remove_journal();
+                upload_id.clear();
+                return false;
+            }
 
-                file.read(buffer, buffer_size);
+            unsigned int parts = std::max<unsigned long long>((file_size + part_size - 1) / part_size, 1);
+            unsigned int resumed = 0;
+
+            std::scoped_lock lock(parts_mutex);
+            parts_list.assign(parts, MPUPart{});
+            for (auto const& [number, part] : *listed) {
+                if ( number == 0 || number > parts ) continue;
+                auto expected = number < parts ? part_size : file_size - (unsigned long long)(parts - 1) * part_size;
+                auto journaled = (*journal)["parts"].value(std::to_string(number), std::string());
+                if ( part.second != expected || ( !journaled.empty() && journaled != part.first ) ) continue;
+                parts_list[number-1] = MPUPart{number, part.first};
+                resumed++;
+            }
+            write_journal();
 
-                date = Date();
+            LOG_INFO(fmt::format("[____AWS] Resuming upload {0} of {1} with {2} out of {3} parts uploaded", upload_id, filename, resumed, parts));
+            return true;
+        }
 
-                LOG_INFO(fmt::format("[____AWS] Multipart upload of {0}; Uploading part {1} out of {2}", filename, std::to_string(i), std::to_string(parts)));
+        // Parts S3 has for the upload by number, with their ETag and size, empty when the upload
+        // is no longer there
+        std::optional<std::map<unsigned int, std::pair<std::string, unsigned long long>>> list_parts() {
 
-                auto res = request("PUT","/"+filename,
-                    "partNumber="+std::to_string(i)+"&uploadId="+upload_id,buffer,buffer_size,content_type);
+            std::map<unsigned int, std::pair<std::string, unsigned long long>> parts;
+            std::string marker = "0";
 
+            for (;;) {
+                auto res = connection.request("GET", "/"+filename, "part-number-marker="+marker+"&uploadId="+uri_encode(upload_id), "", "text/plain");
                 if ( res.error() != httplib::Error::Success || !HttpStatus::isSuccessful(res->status) ) {
-                    LOG_ERROR(fmt::format("[____AWS] Failed Multipart upload {0}; Part {1} out of {2}", filename, std::to_string(i), std::to_string(parts)));
-                    return HttpStatus::isSuccessful(res->status);
+                    return std::nullopt;
                 }
 
-                parts_list[i-1] = MPUPart{i, res->get_header_value("ETag")};
+                for (auto const& part : XML::get_elements(res->body, "Part")) {
+                    auto number = (unsigned int)std::strtoul(element(part, "PartNumber").c_str(), nullptr, 10);
+                    auto etag = element(part, "ETag");
+                    for (auto quot = etag.find("&quot;"); quot != std::string::npos; quot = etag.find("&quot;"))
+                        etag.replace(quot, 6, "\"");
+                    parts[number] = {etag, std::strtoull(element(part, "Size").c_str(), nullptr, 10)};
+                }
 
+                if ( element(res->body, "IsTruncated") != "true" ) break;
+                marker = element(res->body, "NextPartNumberMarker");
+                if ( marker.empty() ) break;
             }
 
-            // Upload last part
-            LOG_INFO(fmt::format("[____AWS] Multipart upload of {0}; Uploading part {1} out of {2}", filename, std::to_string(parts), std::to_string(parts)));
+            return parts;
+        }
 
-            file.read(buffer, buffer_size);
+        bool uploaded(unsigned int part) {
+            std::scoped_lock lock(parts_mutex);
+            return part <= parts_list.size() && !parts_list[part-1].ETag.empty();
+        }
 
-            auto res = request("PUT","/"+filename,
-                "partNumber="+std::to_string(parts)+"&uploadId="+upload_id,buffer,last_part_size,content_type);
+        bool upload_parts() {
 
-            if ( res.error() != httplib::Error::Success || !HttpStatus::isSuccessful(res->status) ) {
-                LOG_ERROR(fmt::format("[____AWS] Failed Multipart upload {0}; Part {1} out of {2}", filename, std::to_string(parts), std::to_string(parts)));
-                return HttpStatus::isSuccessful(res->status);
+            std::ifstream file(file_path_, std::ios::binary);
+            if ( !file ) {
+                LOG_ERROR(fmt::format("[____AWS] Failed opening {0}", file_path_));
+                return false;
             }
 
-            parts_list[parts-1] = MPUPart{parts, res->get_header_value("ETag")};
-            return HttpStatus::isSuccessful(res->status);
+            // The next part is read while the previous ones upload, so one buffer more than the
+            // parts in flight. Parts of a resumed upload that S3 has are read but not sent.
+            utils::part_pipeline pipeline(buffer_size, options_.concurrency + 1,
+                [this](unsigned int part, const std::string& data) { return uploaded(part) || upload_part(part, data.data(), data.size()); },
+                options_.concurrency);
+
+            std::vector<char> chunk(1 << 20);
+            while ( file.read(chunk.data(), (std::streamsize)chunk.size()) || file.gcount() > 0 ) {
+                if ( !pipeline.write(chunk.data(), (size_t)file.gcount()) ) break;
+            }
+
+            return pipeline.close() && !file.bad();
         }
 
         bool complete_upload() {
-            // TODO: complete_upload: request list of parts to S3 and form last request with this response
+            // A part missing its ETag could not be uploaded
+            if ( parts_list.empty() || std::any_of(parts_list.begin(), parts_list.end(), [](const MPUPart& part) { return part.ETag.empty(); }) ) {
+                LOG_ERROR(fmt::format("[____AWS] Failed completing upload of {0}; Missing parts", filename));
+                return false;
+            }
 
             std::string complete_xml = generate_xml_complete_mpu();
 
             LOG_INFO(fmt::format("[____AWS] Finishing upload of {0}", file_path_));
 
-            return request("POST","/"+filename,"uploadId="+upload_id,complete_xml, "text/xml");
+            auto res = connection.request("POST","/"+filename,"uploadId="+uri_encode(upload_id),complete_xml, "text/xml");
+
+            // A complete request may fail after a 200 status, with the error in the body
+            if ( res.error() != httplib::Error::Success || !HttpStatus::isSuccessful(res->status) || res->body.find("<Error>") != std::string::npos ) {
+                LOG_ERROR(fmt::format("[____AWS] Failed completing upload of {0}", filename));
+                return false;
+            }
+
+            remove_journal();
+            return true;
         }
 
-        httplib::Result request(
-          const std::string& method,
-          const std::string& path,
-          const std::string& query_parameters,
-          std::string const& payload,
-          const std::string& c_type)
-        {
-            return request(method,path,query_parameters,payload.c_str(),payload.size(),c_type);
+        // Starts the journal over with the parts uploaded so far, with the parts lock held
+        void write_journal() {
+            nlohmann::json header = {{"key", filename}, {"upload_id", upload_id}, {"part_size", part_size}};
+            if ( resumable ) {
+                header["size"] = file_size;
+                header["mtime"] = file_time;
+            }
+
+            std::ofstream journal(journal_path(file_path_), std::ios::trunc);
+            journal << header.dump() << '\n';
+            for (auto const& part : parts_list) {
+                if ( !part.ETag.empty() ) journal << nlohmann::json{{"part", part.part_id}, {"etag", part.ETag}}.dump() << '\n';
+            }
         }
 
-        httplib::Result request(
-          const std::string& method,
-          const std::string& path,
-          const std::string& query_parameters,
-          const char *buffer,
-          const size_t buffer_size_req,
-          const std::string& c_type)
+        // Appends a part to the journal, with the parts lock held
+        void journal_part(MPUPart const& part) {
+            std::ofstream journal(journal_path(file_path_), std::ios::app);
+            journal << nlohmann::json{{"part", part.part_id}, {"etag", part.ETag}}.dump() << '\n';
+        }
+
+        void remove_journal() {
+            std::error_code ec;
+            std::filesystem::remove(journal_path(file_path_), ec);
+        }
+
+        [[nodiscard]] std::string generate_xml_complete_mpu() const {
+
+            std::string xml_res = "<CompleteMultipartUpload>\n";
+            for (auto const& part : parts_list) {
+                xml_res += "<Part>\n<PartNumber>"+std::to_string(part.part_id)+"</PartNumber>\n";
+                xml_res += "<ETag>"+part.ETag+"</ETag>\n</Part>";
+            }
+            xml_res += "\n</CompleteMultipartUpload>";
+
+            return xml_res;
+        }
+
+    };
+
+    /**
+        Downloads an object in ranges fetched at once over a pool of keep-alive connections, each
+        one written in place into a file preallocated to the object size. Ranges are retried on
+        their own, and the file is verified against the length and ETag of the object.
+    */
+    class Download {
+
+        public:
+
+        using options = MultipartUpload::options;
+
+        Download(std::string const& bucket, std::string const& region, std::string const& access_key, std::string const& secret_key, std::string file_path) :
+            Download(bucket, region, access_key, secret_key, std::move(file_path), options{})
+        {}
+
+        Download(std::string const& bucket, std::string const& region, std::string const& access_key, std::string const& secret_key, std::string file_path, options opts) :
+            file_path_(std::move(file_path)),
+            options_(std::move(opts)),
+            connection(bucket, region, access_key, secret_key, options_.endpoint, std::max(options_.concurrency, 1u))
         {
-            std::string payload_hash;
-            std::string canonical_request;
-            std::string auth_header;
-            httplib::Headers headers;
-            auto date = Date();
+            options_.concurrency = std::max(options_.concurrency, 1u);
 
-            payload_hash = Crypto::hash::sha256(buffer, buffer_size_req);
+            // The object is named after the file
+            key = std::filesystem::path(file_path_).filename();
+        }
 
-            canonical_request = generate_canonical_request(method,path,query_parameters,payload_hash,date);
-            auth_header = awsv4->get_auth_header(date, canonical_request);
+        /**
+            HEAD of the object for its size and ETag, then its ranges, at most concurrency at once.
+            A failed download removes the file.
+            @return Boolean indicating if the object was downloaded and verified
+        */
+        bool download() {
 
-            headers = {
-                { "x-amz-content-sha256", payload_hash },
-                { "x-amz-date", date.to_iso8601('\0',true,"utc") },
-                { "Authorization", auth_header }
-            };
+            LOG_INFO(fmt::format("[____AWS] Downloading {0} to {1}", key, file_path_));
 
-            if (method == "POST") {
-                return cli->Post(path+"?"+query_parameters, headers, buffer, buffer_size_req, c_type);
-            } else if (method == "PUT") {
-                return cli->Put(path+"?"+query_parameters, headers, buffer, buffer_size_req, c_type);
+            auto head = connection.request("HEAD", "/"+key, "", "", "");
+            if ( head.error() != httplib::Error::Success || !HttpStatus::isSuccessful(head->status) || !head->has_header("Content-Length") ) {
+                LOG_ERROR(fmt::format("[____AWS] Failed requesting {0}", key));
+                return false;
+            }
+            size = std::strtoull(head->get_header_value("Content-Length").c_str(), nullptr, 10);
+            etag = head->get_header_value("ETag");
+            // the ETag of objects encrypted with KMS keys is not the MD5 of their content
+            encrypted = head->get_header_value("x-amz-server-side-encryption") == "aws:kms";
+
+            fd = ::open(file_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if ( fd < 0 ) {
+                LOG_ERROR(fmt::format("[____AWS] Failed opening {0}: {1}", file_path_, std::strerror(errno)));
+                return false;
             }
 
-            return httplib::Result{nullptr, httplib::Error::Unknown};;
+            bool downloaded = preallocate() && download_ranges();
+            downloaded = ::fsync(fd) == 0 && downloaded;
+            downloaded = ::close(fd) == 0 && downloaded;
+            downloaded = downloaded && verify();
 
+            if ( !downloaded ) {
+                std::error_code ec;
+                std::filesystem::remove(file_path_, ec);
+                return false;
+            }
+
+            LOG_INFO(fmt::format("[____AWS] Downloaded {0}; {1} bytes in {2} ranges", key, size, digests.size()));
+            return true;
         }
 
-        [[nodiscard]] std::string generate_canonical_request(
-          const std::string& method,
-          const std::string& path,
-          const std::string& query_parameters,
-          std::string const& payload_hash,
-          Date date) const
-        {
+        // Ranges are as long as the parts of uploads, so the ETag of objects uploaded by parts
+        // is verified from the MD5 of each range
+        static constexpr size_t range_size = MultipartUpload::part_size;
 
-            std::string canonical_request =
-                method+"\n"+
-                path+"\n"+
-                query_parameters+"\n"+
-                "host:"+url+"\n"+
-                "x-amz-content-sha256:"+payload_hash+"\n"+
-                "x-amz-date:"+date.to_iso8601('\0',true,"utc")+"\n\n"+
-                "host;x-amz-content-sha256;x-amz-date\n"+
-                payload_hash;
+        private:
 
-            return canonical_request;
+        std::string file_path_;
+        std::string key;
+        options options_;
+
+        Connection connection;
+
+        int fd = -1;
+        unsigned long long size = 0;
+        std::string etag;
+        bool encrypted = false;
+        std::vector<std::string> digests; // MD5 of every range, by range
+
+        // The whole file is allocated beforehand, so ranges written in any order neither leave
+        // it sparse nor run out of space halfway
+        bool preallocate() {
+            if ( size == 0 ) return true;
+            if ( ::fallocate(fd, 0, 0, (off_t)size) == 0 ) return true;
+            // filesystems without fallocate just get the size
+            if ( errno == EOPNOTSUPP && ::ftruncate(fd, (off_t)size) == 0 ) return true;
+            LOG_ERROR(fmt::format("[____AWS] Failed allocating {0} bytes for {1}: {2}", size, file_path_, std::strerror(errno)));
+            return false;
         }
 
-        [[nodiscard]] std::string generate_xml_complete_mpu() const {
+        bool download_ranges() {
+
+            auto ranges = (size_t)((size + range_size - 1) / range_size);
+            digests.assign(ranges, std::string());
+
+            std::atomic<size_t> next = 0;
+            std::atomic<bool> failed = false;
+            {
+                std::vector<std::jthread> workers;
+                for (size_t i = 0; i < std::min<size_t>(options_.concurrency, ranges); i++) {
+                    workers.emplace_back([this, &next, &failed, ranges] {
+                        for (auto range = next++; range < ranges && !failed; range = next++) {
+                            if ( !download_range(range) ) failed = true;
+                        }
+                    });
+                }
+            }
 
-            std::string xml_res = "<CompleteMultipartUpload>\n";
-            for (int i=0; i < parts; i++) {
-                xml_res += "<Part>\n<PartNumber>"+std::to_string(parts_list[i].part_id)+"</PartNumber>\n";
-                xml_res += "<ETag>"+parts_list[i].ETag+"</ETag>\n</Part>";
+            return !failed;
+        }
+
+        // Fetches a range, retrying with exponential backoff on connection errors, throttling,
+        // server errors and truncated bodies. The object changing meanwhile is not retried.
+        bool download_range(size_t range) {
+
+            unsigned long long first = range * range_size;
+            unsigned long long length = std::min<unsigned long long>(range_size, size - first);
+
+            httplib::Headers headers = {
+                { "Range", fmt::format("bytes={0}-{1}", first, first + length - 1) }
+            };
+            if ( !etag.empty() ) headers.emplace("If-Match", etag);
+
+            auto backoff = options_.backoff;
+
+            for (unsigned int attempt = 0; ; attempt++) {
+
+                Crypto::hash::md5 md5;
+                unsigned long long received = 0;
+                int status = 0;
+                bool written = true;
+
+                auto res = connection.get("/"+key, headers,
+                    [&status](const httplib::Response& response) {
+                        status = response.status;
+                        return status == 206;
+                    },
+                    [&](const char* data, size_t length_received) {
+                        if ( received + length_received > length ) return false;
+                        written = write_at(data, length_received, first + received);
+                        if ( !written ) return false;
+                        md5.update(data, length_received);
+                        received += length_received;
+                        return true;
+                    });
+
+                if ( !written ) {
+                    LOG_ERROR(fmt::format("[____AWS] Failed writing {0}: {1}", file_path_, std::strerror(errno)));
+                    return false;
+                }
+
+                if ( res.error() == httplib::Error::Success && status == 206 && received == length ) {
+                    digests[range] = md5.digest();
+                    return true;
+                }
+
+                if ( status == 412 ) {
+                    LOG_ERROR(fmt::format("[____AWS] {0} changed while downloading it", key));
+                    return false;
+                }
+
+                bool retriable = status == 0 || status == 206 || status == 429 || status >= 500;
+                if ( !retriable || attempt >= options_.retries ) {
+                    LOG_ERROR(fmt::format("[____AWS] Failed downloading {0}; Range {1} after {2} attempts", key, range + 1, attempt + 1));
+                    return false;
+                }
+
+                LOG_WARNING(fmt::format("[____AWS] Download of {0}; Retrying range {1} in {2} ms", key, range + 1, backoff.count()));
+                std::this_thread::sleep_for(backoff);
+                backoff *= 2;
             }
-            xml_res += "\n</CompleteMultipartUpload>";
+        }
 
-            return xml_res;
+        bool write_at(const char* data, size_t length, unsigned long long offset) const {
+            while ( length > 0 ) {
+                auto n = ::pwrite(fd, data, length, (off_t)offset);
+                if ( n < 0 ) {
+                    if ( errno == EINTR ) continue;
+                    return false;
+                }
+                data += n;
+                length -= (size_t)n;
+                offset += (unsigned long long)n;
+            }
+            return true;
+        }
+
+        // The ETag of an object uploaded at once is the MD5 of its content, the one of an object
+        // uploaded by parts is the MD5 of the MD5 of its parts followed by the number of parts.
+        // Objects uploaded with other part sizes, or encrypted with KMS keys, are only verified
+        // by their length.
+        bool verify() {
+
+            auto expected = etag;
+            std::erase(expected, '"');
+
+            std::string computed;
+            auto dash = expected.find('-');
+            if ( encrypted || expected.empty() ) {
+                // not an MD5
+            } else if ( dash == std::string::npos ) {
+                if ( digests.size() <= 1 ) {
+                    computed = Crypto::to_hex(digests.empty() ? Crypto::hash::md5().digest() : digests.front());
+                } else {
+                    computed = file_md5();
+                }
+            } else if ( expected.substr(dash + 1) == std::to_string(digests.size()) ) {
+                Crypto::hash::md5 md5;
+                for (auto const& digest : digests) md5.update(digest.data(), digest.size());
+                computed = Crypto::to_hex(md5.digest()) + "-" + std::to_string(digests.size());
+            }
+
+            if ( computed.empty() ) {
+                LOG_WARNING(fmt::format("[____AWS] ETag of {0} can not be verified, only its length", key));
+                return true;
+            }
+
+            if ( computed != expected ) {
+                LOG_ERROR(fmt::format("[____AWS] Downloaded {0} does not match its ETag; {1} != {2}", key, computed, expected));
+                return false;
+            }
+
+            return true;
+        }
+
+        [[nodiscard]] std::string file_md5() const {
+            Crypto::hash::md5 md5;
+            std::ifstream file(file_path_, std::ios::binary);
+            std::vector<char> chunk(1 << 20);
+            while ( file.read(chunk.data(), (std::streamsize)chunk.size()) || file.gcount() > 0 ) {
+                md5.update(chunk.data(), (size_t)file.gcount());
+            }
+            return file.bad() ? std::string() : Crypto::to_hex(md5.digest());
         }
 
     };
 
+    private:
+
+    // Encodes a query parameter value as SigV4 signs it, keeping only unreserved characters
+    static std::string uri_encode(std::string_view value) {
+        static const char hex[] = "0123456789ABCDEF";
+        std::string encoded;
+        for (unsigned char c : value) {
+            if ( std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' ) {
+                encoded += (char)c;
+            } else {
+                encoded += '%';
+                encoded += hex[c >> 4];
+                encoded += hex[c & 0xF];
+            }
+        }
+        return encoded;
+    }
+
+    // Content of the first element with the given name, empty when there is none
+    static std::string element(std::string const& xml, std::string const& name) {
+        auto values = XML::get_elements(xml, name);
+        return values.empty() ? std::string() : values.front();
+    }
+
+    // Timestamps of S3 listings, as 2024-01-31T12:00:00.000Z
+    static std::optional<std::chrono::sys_seconds> parse_time(std::string const& timestamp) {
+        std::tm tm{};
+        std::istringstream in(timestamp);
+        in >> std::get_time(&tm, "%Y-%m-%dT%H:%M:%S");
+        if ( in.fail() ) return std::nullopt;
+        return std::chrono::sys_seconds(std::chrono::seconds(timegm(&tm)));
+    }
+
 };
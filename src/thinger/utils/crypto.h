@@ -24,7 +24,7 @@
 
 namespace Crypto {
 
-    std::string to_hex(const std::string &string) {
+    inline std::string to_hex(const std::string &string) {
 
         auto len = string.length();
         auto hash = (const unsigned char*)string.c_str();
@@ -57,7 +57,7 @@ namespace Crypto {
             41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 64, 64, 64, 64, 64
         };
 
-        ::std::string encode(const ::std::string_view& bindata)
+        inline ::std::string encode(const ::std::string_view& bindata)
         {
             using ::std::string;
             using ::std::numeric_limits;
@@ -124,7 +124,7 @@ namespace Crypto {
 
     namespace hash {
 
-        std::string hmac(const std::string& key, const std::string& msg, const std::string& digest) {
+        inline std::string hmac(const std::string& key, const std::string& msg, const std::string& digest) {
 
             EVP_MAC *mac = EVP_MAC_fetch(nullptr, "HMAC", nullptr);
             EVP_MAC_CTX *ctx = nullptr;
@@ -159,20 +159,20 @@ namespace Crypto {
             return ss.str();
           }
 
-        std::string hmac_sha1(const std::string& key, const std::string& msg) {
+        inline std::string hmac_sha1(const std::string& key, const std::string& msg) {
 
             return hmac(key, msg, "SHA1");
 
         }
 
-        std::string hmac_sha256(std::basic_string<char> key, std::basic_string<char> msg) {
+        inline std::string hmac_sha256(std::basic_string<char> key, std::basic_string<char> msg) {
 
             return hmac(key, msg, "SHA256");
 
         }
 
 
-        std::string sha256(const char* str, const size_t length) {
+        inline std::string sha256(const char* str, const size_t length) {
 
             EVP_MD *sha256 = nullptr;
             EVP_MD_CTX *ctx = nullptr;
@@ -196,9 +196,42 @@ namespace Crypto {
             return ss.str();
         }
 
-        std::string sha256(const std::string& str) {
+        inline std::string sha256(const std::string& str) {
             return sha256(str.c_str(), str.length());
         }
+
+        // MD5 of data fed in chunks, as they arrive; digest returns the raw 16 bytes
+        class md5 {
+
+        public:
+
+            md5() : ctx(EVP_MD_CTX_new()) {
+                EVP_DigestInit_ex(ctx, EVP_md5(), nullptr);
+            }
+
+            md5(const md5&) = delete;
+            md5& operator=(const md5&) = delete;
+
+            ~md5() {
+                EVP_MD_CTX_free(ctx);
+            }
+
+            void update(const char* data, const size_t length) {
+                EVP_DigestUpdate(ctx, data, length);
+            }
+
+            std::string digest() {
+                unsigned char hash[EVP_MAX_MD_SIZE];
+                unsigned int hash_length = 0;
+                EVP_DigestFinal_ex(ctx, hash, &hash_length);
+                return {(const char*)hash, hash_length};
+            }
+
+        private:
+
+            EVP_MD_CTX *ctx;
+
+        };
     };
 
 };
@@ -1,11 +1,13 @@
 #pragma once
 
 #include <filesystem>
+#include <functional>
 #include <vector>
 #include <httplib.h>
 #include <spdlog/spdlog.h>
 
 #include "http_status.h"
+#include "docker/stream.h"
 
 #include <nlohmann/json.hpp>
 
@@ -14,7 +16,7 @@ namespace Docker {
 
     namespace Container {
 
-        bool inspect(const std::string& container_id, const std::string& dest_path) {
+        inline bool inspect(const std::string& container_id, const std::string& dest_path) {
 
             LOG_INFO(fmt::format("[_DOCKER] Inspecting container: '{0}' and saving result to: '{1}'", container_id, dest_path+"/"+container_id+".json"));
 
@@ -52,7 +54,7 @@ namespace Docker {
         }
 
         // Used only for plugins
-        bool create_from_inspect(const std::string& source_path, const std::string& network_id = "") {
+        inline bool create_from_inspect(const std::string& source_path, const std::string& network_id = "") {
 
             json inspect_json;
 
@@ -119,7 +121,7 @@ namespace Docker {
             return HttpStatus::isSuccessful(res->status);
         }
 
-        bool exec(const std::string container_id, const std::string command) {
+        inline bool exec(const std::string container_id, const std::string command) {
 
             std::string exec_id = "";
 
@@ -193,7 +195,98 @@ namespace Docker {
             return true;
         }
 
-        bool restart(const std::string container_id) {
+        // Executes a command handing its stdout to a callback as it is produced, i.e., to stream a
+        // dump without writing it to the container filesystem. Fails when the command does not exit
+        // with 0 or the callback refuses a block.
+        inline bool exec(const std::string& container_id, const std::string& command, const std::function<bool(const char*, size_t)>& on_stdout) {
+
+            LOG_INFO(fmt::format("[_DOCKER] Executing command: '{0}' in container '{1}' streaming its output", command, container_id));
+
+            httplib::Client cli("/var/run/docker.sock");
+            cli.set_address_family(AF_UNIX);
+            cli.set_default_headers({ { "Host", "localhost" } });
+            cli.set_read_timeout(600, 0); // 10 minutes without output
+
+            std::stringstream ss(command);
+
+            std::vector<std::string> cmd;
+            while(ss.good()) {
+                std::string word;
+                ss >> word;
+                cmd.push_back(word);
+            }
+
+            json body = {
+              {"AttachStdin", false},
+              {"AttachStdout", true},
+              {"AttachStderr", true},
+              {"Tty", false}, // without tty stdout and stderr come multiplexed
+              {"Cmd", cmd}
+            };
+
+            auto res = cli.Post(("/containers/"+container_id+"/exec").c_str(), body.dump(), "application/json");
+            if ( res.error() != httplib::Error::Success || !HttpStatus::isSuccessful(res->status) ) {
+                LOG_ERROR("[_DOCKER] Could not create exec instance");
+                return false;
+            }
+
+            auto exec_id = json::parse(res->body)["Id"].get<std::string>();
+
+            // stderr is kept for the log, only its tail
+            std::string errors;
+            bool accepted = true;
+            Stream::demuxer demuxer([&](Stream::type stream, const char* data, size_t length) {
+                if ( stream == Stream::stdout_stream )
+                    return accepted = on_stdout(data, length);
+                errors.append(data, length);
+                if ( errors.size() > 4096 )
+                    errors.erase(0, errors.size() - 4096);
+                return true;
+            });
+
+            httplib::Request req;
+            req.method = "POST";
+            req.path = "/exec/"+exec_id+"/start";
+            req.set_header("Content-Type", "application/json");
+            req.body = json({{"Detach", false}, {"Tty", false}}).dump();
+            req.content_receiver = [&demuxer](const char* data, size_t length, uint64_t, uint64_t) {
+                return demuxer.feed(data, length);
+            };
+
+            res = cli.send(req);
+
+            if ( !accepted ) {
+                LOG_ERROR("[_DOCKER] Output of the command could not be written");
+                return false;
+            } else if ( res.error() == httplib::Error::Read ) {
+                LOG_ERROR("[_DOCKER] Error: Timeout waiting for command output");
+                return false;
+            } else if ( res.error() != httplib::Error::Success ) {
+                LOG_ERROR(fmt::format("[_DOCKER] Request error: {0}", to_string(res.error())));
+                return false;
+            }
+
+            if ( !HttpStatus::isSuccessful(res->status) || !demuxer.complete() ) {
+                LOG_ERROR("[_DOCKER] An error occurred while executing");
+                return false;
+            }
+
+            // Inspect exec instance
+            res = cli.Get(("/exec/"+exec_id+"/json").c_str());
+            if ( res.error() != httplib::Error::Success || !HttpStatus::isSuccessful(res->status) ||
+                 json::parse(res->body)["ExitCode"].get<int>() != 0 ) {
+                LOG_ERROR("[_DOCKER] An error occurred while executing");
+                if ( !errors.empty() )
+                    LOG_LEVEL(1, "[_DOCKER] Error description: %s", errors);
+                return false;
+            }
+
+            LOG_INFO("[_DOCKER] Succesfully executed");
+
+            return true;
+        }
+
+        inline bool restart(const std::string container_id) {
 
             LOG_INFO(fmt::format("[_DOCKER] Restarting container: '{0}'", container_id));
 
@@ -217,7 +310,7 @@ namespace Docker {
             return HttpStatus::isSuccessful(res->status);
         }
 
-        bool start(const std::string container_id) {
+        inline bool start(const std::string container_id) {
 
             LOG_INFO(fmt::format("[_DOCKER] Starting container: '{0}'", container_id));
 
@@ -241,7 +334,7 @@ namespace Docker {
             return HttpStatus::isSuccessful(res->status);
         }
 
-        bool stop(const std::string container_id) {
+        inline bool stop(const std::string container_id) {
 
             LOG_INFO(fmt::format("[_DOCKER] Stopping container: '{0}'", container_id));
 
@@ -266,7 +359,7 @@ namespace Docker {
         }
 
         // It seems that the path has to be relative to the access point
-        bool copy_from_container(const std::string container_id, const std::string source_path, const std::string dest_path) {
+        inline bool copy_from_container(const std::string container_id, const std::string source_path, const std::string dest_path) {
 
             LOG_INFO(fmt::format("[_DOCKER] Copying from container: '{0}' path: '{1}' to host path: '{2}'", container_id, source_path, dest_path));
 
@@ -296,7 +389,7 @@ namespace Docker {
             return HttpStatus::isSuccessful(res->status);
         }
 
-        bool copy_to_container(const std::string container_id, const std::string source_path, const std::string dest_path) {
+        inline bool copy_to_container(const std::string container_id, const std::string source_path, const std::string dest_path) {
 
             LOG_INFO(fmt::format("[_DOCKER] Copying from host path: '{0}' to container '{1}' path: '{2}'", source_path, container_id, dest_path));
 
@@ -352,7 +445,7 @@ namespace Docker {
 
     namespace Network { // TODO: could this be done with abstract classes?
 
-        bool inspect(const std::string& network_id, const std::string& dest_path) {
+        inline bool inspect(const std::string& network_id, const std::string& dest_path) {
 
             LOG_INFO(fmt::format("[_DOCKER] Inspecting network: '{0}' and saving result to: '{1}'", network_id, dest_path+"/"+network_id+"-network.json"));
 
@@ -389,7 +482,7 @@ namespace Docker {
             return HttpStatus::isSuccessful(res->status);
         }
 
-        std::string create_from_inspect(const std::string source_path) {
+        inline std::string create_from_inspect(const std::string source_path) {
 
             json inspect_json;
 
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+namespace Docker::Stream {
+
+    enum type : unsigned char {
+        stdin_stream = 0,
+        stdout_stream = 1,
+        stderr_stream = 2
+    };
+
+    // Splits the multiplexed stream of an exec or attach without tty into its streams. Frames are
+    // an 8 bytes header, with the stream type and the big endian payload size, and the payload.
+    // Bytes may be fed as they arrive, split anywhere.
+    class demuxer {
+
+    public:
+
+        using callback = std::function<bool(type stream, const char* data, std::size_t length)>;
+
+        explicit demuxer(callback cb) : callback_(std::move(cb)) {}
+
+        // False once the callback refuses a payload
+        bool feed(const char* data, std::size_t length) {
+            while ( length > 0 ) {
+                if ( remaining_ == 0 ) {
+                    auto n = std::min(length, sizeof(header_) - header_size_);
+                    std::memcpy(header_ + header_size_, data, n);
+                    header_size_ += n;
+                    data += n;
+                    length -= n;
+                    if ( header_size_ < sizeof(header_) ) return true;
+
+                    stream_ = static_cast<type>(header_[0]);
+                    remaining_ = (std::uint32_t(header_[4]) << 24) | (std::uint32_t(header_[5]) << 16) |
+                                 (std::uint32_t(header_[6]) << 8) | std::uint32_t(header_[7]);
+                    header_size_ = 0;
+                    continue;
+                }
+
+                auto n = std::min<std::size_t>(length, remaining_);
+                if ( !callback_(stream_, data, n) ) return false;
+                data += n;
+                length -= n;
+                remaining_ -= n;
+            }
+            return true;
+        }
+
+        // Whether the stream ended on a frame boundary
+        [[nodiscard]] bool complete() const { return remaining_ == 0 && header_size_ == 0; }
+
+    private:
+
+        callback callback_;
+        unsigned char header_[8]{};
+        std::size_t header_size_ = 0;
+        type stream_ = stdout_stream;
+        std::uint32_t remaining_ = 0;
+
+    };
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace utils::file {
+
+    // Reads a whole file reusing the buffer capacity, so procfs and sysfs reads in steady state
+    // cost an open, a couple of reads and a close without any allocation.
+    inline bool read(const char* path, std::string& buffer) {
+
+        buffer.clear();
+
+        int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if ( fd < 0 ) return false;
+
+        if ( buffer.capacity() < 4096 )
+            buffer.reserve(4096);
+
+        std::size_t size = 0;
+        for (;;) {
+            if ( size == buffer.capacity() )
+                buffer.reserve(buffer.capacity() * 2);
+            buffer.resize(buffer.capacity());
+            ssize_t r = ::read(fd, buffer.data() + size, buffer.size() - size);
+            if ( r <= 0 ) break;
+            size += static_cast<std::size_t>(r);
+        }
+        buffer.resize(size);
+
+        ::close(fd);
+        return true;
+    }
+
+    // Keeps a file open to read it again from the start, sysfs regenerates attributes on each
+    // pread at offset 0, so polling them costs a single syscall.
+    class descriptor {
+
+    public:
+
+        descriptor() = default;
+
+        explicit descriptor(const char* path) : fd_(::open(path, O_RDONLY | O_CLOEXEC)) {}
+
+        descriptor(descriptor const&) = delete;
+        descriptor& operator=(descriptor const&) = delete;
+
+        descriptor(descriptor&& other) noexcept : fd_(std::exchange(other.fd_, -1)) {}
+
+        descriptor& operator=(descriptor&& other) noexcept {
+            if ( this != &other ) {
+                close();
+                fd_ = std::exchange(other.fd_, -1);
+            }
+            return *this;
+        }
+
+        ~descriptor() {
+            close();
+        }
+
+        [[nodiscard]] bool valid() const { return fd_ >= 0; }
+
+        // Reads a decimal value, i.e., "45000\n" from a temperature input
+        [[nodiscard]] std::optional<long long> read_integer() const {
+            if ( fd_ < 0 ) return std::nullopt;
+
+            char buffer[32];
+            ssize_t r = ::pread(fd_, buffer, sizeof(buffer), 0);
+            if ( r <= 0 ) return std::nullopt;
+
+            long long value = 0;
+            bool negative = buffer[0] == '-';
+            ssize_t i = negative ? 1 : 0;
+            if ( i == r || buffer[i] < '0' || buffer[i] > '9' ) return std::nullopt;
+            for (; i < r && buffer[i] >= '0' && buffer[i] <= '9'; i++)
+                value = value * 10 + (buffer[i] - '0');
+            return negative ? -value : value;
+        }
+
+    private:
+
+        int fd_ = -1;
+
+        void close() {
+            if ( fd_ >= 0 ) ::close(fd_);
+            fd_ = -1;
+        }
+
+    };
+
+}
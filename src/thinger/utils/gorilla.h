@@ -0,0 +1,296 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Time series compression from "Gorilla: A Fast, Scalable, In-Memory Time Series Database":
+// timestamps are stored as deltas of deltas and values as the xor with the previous one, so
+// regular intervals and repeated values cost a single bit per sample.
+namespace utils::gorilla {
+
+    class bit_writer {
+
+    public:
+
+        // Appends the lower count bits of value, most significant first
+        void write(std::uint64_t value, unsigned int count) {
+            while ( count > 0 ) {
+                if ( used_ == 0 ) bytes_.push_back('\0');
+                unsigned int free = 8 - used_;
+                unsigned int n = count < free ? count : free;
+                auto chunk = static_cast<unsigned char>((value >> (count - n)) & ((1u << n) - 1));
+                bytes_.back() = static_cast<char>(static_cast<unsigned char>(bytes_.back()) | (chunk << (free - n)));
+                used_ = (used_ + n) % 8;
+                count -= n;
+            }
+        }
+
+        void write_bit(bool bit) {
+            write(bit ? 1 : 0, 1);
+        }
+
+        [[nodiscard]] std::string const& bytes() const { return bytes_; }
+
+        void clear() {
+            bytes_.clear();
+            used_ = 0;
+        }
+
+    private:
+
+        std::string bytes_;
+        unsigned int used_ = 0; // bits used of the last byte
+
+    };
+
+    class bit_reader {
+
+    public:
+
+        explicit bit_reader(std::string_view bytes) : bytes_(bytes) {}
+
+        // Reads count bits, false past the end
+        bool read(unsigned int count, std::uint64_t& value) {
+            value = 0;
+            while ( count > 0 ) {
+                if ( position_ / 8 >= bytes_.size() ) return false;
+                unsigned int offset = position_ % 8;
+                unsigned int available = 8 - offset;
+                unsigned int n = count < available ? count : available;
+                auto byte = static_cast<unsigned char>(bytes_[position_ / 8]);
+                value = (value << n) | ((byte >> (available - n)) & ((1u << n) - 1));
+                position_ += n;
+                count -= n;
+            }
+            return true;
+        }
+
+        bool read_bit(bool& bit) {
+            std::uint64_t value;
+            if ( !read(1, value) ) return false;
+            bit = value != 0;
+            return true;
+        }
+
+    private:
+
+        std::string_view bytes_;
+        std::size_t position_ = 0;
+
+    };
+
+    namespace detail {
+
+        // Delta of delta buckets: '0', '10' + 7 bits, '110' + 9 bits, '1110' + 12 bits, '1111' + 64 bits
+        struct bucket {
+            std::uint64_t prefix;
+            unsigned int prefix_bits;
+            unsigned int value_bits;
+        };
+
+        constexpr bucket buckets[] = {{0b10, 2, 7}, {0b110, 3, 9}, {0b1110, 4, 12}, {0b1111, 4, 64}};
+
+        inline std::int64_t sign_extend(std::uint64_t value, unsigned int bits) {
+            if ( bits == 64 ) return static_cast<std::int64_t>(value);
+            auto sign = std::uint64_t(1) << (bits - 1);
+            return static_cast<std::int64_t>((value ^ sign) - sign);
+        }
+
+    }
+
+    class timestamp_encoder {
+
+    public:
+
+        void append(std::int64_t timestamp) {
+            if ( count_++ == 0 ) {
+                writer_.write(static_cast<std::uint64_t>(timestamp), 64);
+            } else {
+                std::int64_t delta = timestamp - previous_;
+                std::int64_t dod = delta - delta_;
+                delta_ = delta;
+                if ( dod == 0 ) {
+                    writer_.write_bit(false);
+                } else {
+                    for (auto const& b : detail::buckets) {
+                        auto limit = b.value_bits == 64 ? INT64_MAX : (std::int64_t(1) << (b.value_bits - 1)) - 1;
+                        if ( b.value_bits == 64 || (dod >= -limit - 1 && dod <= limit) ) {
+                            writer_.write(b.prefix, b.prefix_bits);
+                            writer_.write(static_cast<std::uint64_t>(dod), b.value_bits);
+                            break;
+                        }
+                    }
+                }
+            }
+            previous_ = timestamp;
+        }
+
+        [[nodiscard]] std::string const& bytes() const { return writer_.bytes(); }
+
+        [[nodiscard]] std::size_t size() const { return count_; }
+
+        // Starts over keeping the bytes allocated so far
+        void clear() {
+            writer_.clear();
+            count_ = 0;
+            previous_ = 0;
+            delta_ = 0;
+        }
+
+    private:
+
+        bit_writer writer_;
+        std::size_t count_ = 0;
+        std::int64_t previous_ = 0;
+        std::int64_t delta_ = 0;
+
+    };
+
+    class timestamp_decoder {
+
+    public:
+
+        explicit timestamp_decoder(std::string_view bytes) : reader_(bytes) {}
+
+        bool next(std::int64_t& timestamp) {
+            std::uint64_t value;
+            if ( first_ ) {
+                if ( !reader_.read(64, value) ) return false;
+                first_ = false;
+                previous_ = static_cast<std::int64_t>(value);
+            } else {
+                // count the leading ones of the prefix
+                unsigned int ones = 0;
+                bool bit = true;
+                while ( ones < 4 && bit ) {
+                    if ( !reader_.read_bit(bit) ) return false;
+                    if ( bit ) ones++;
+                }
+                std::int64_t dod = 0;
+                if ( ones > 0 ) {
+                    auto bits = detail::buckets[ones - 1].value_bits;
+                    if ( !reader_.read(bits, value) ) return false;
+                    dod = detail::sign_extend(value, bits);
+                }
+                delta_ += dod;
+                previous_ += delta_;
+            }
+            timestamp = previous_;
+            return true;
+        }
+
+    private:
+
+        bit_reader reader_;
+        bool first_ = true;
+        std::int64_t previous_ = 0;
+        std::int64_t delta_ = 0;
+
+    };
+
+    class value_encoder {
+
+    public:
+
+        void append(double value) {
+            auto bits = std::bit_cast<std::uint64_t>(value);
+            if ( count_++ == 0 ) {
+                writer_.write(bits, 64);
+            } else {
+                auto x = bits ^ previous_;
+                if ( x == 0 ) {
+                    writer_.write_bit(false);
+                } else {
+                    writer_.write_bit(true);
+                    unsigned int leading = std::min(std::countl_zero(x), 31);
+                    unsigned int trailing = std::countr_zero(x);
+                    if ( window_ && leading_ <= leading && trailing_ <= trailing ) {
+                        // fits in the meaningful bits of the previous value
+                        writer_.write_bit(false);
+                        writer_.write(x >> trailing_, 64 - leading_ - trailing_);
+                    } else {
+                        unsigned int meaningful = 64 - leading - trailing;
+                        writer_.write_bit(true);
+                        writer_.write(leading, 5);
+                        writer_.write(meaningful == 64 ? 0 : meaningful, 6);
+                        writer_.write(x >> trailing, meaningful);
+                        leading_ = leading;
+                        trailing_ = trailing;
+                        window_ = true;
+                    }
+                }
+            }
+            previous_ = bits;
+        }
+
+        [[nodiscard]] std::string const& bytes() const { return writer_.bytes(); }
+
+        [[nodiscard]] std::size_t size() const { return count_; }
+
+        // Starts over keeping the bytes allocated so far
+        void clear() {
+            writer_.clear();
+            count_ = 0;
+            previous_ = 0;
+            leading_ = 0;
+            trailing_ = 0;
+            window_ = false;
+        }
+
+    private:
+
+        bit_writer writer_;
+        std::size_t count_ = 0;
+        std::uint64_t previous_ = 0;
+        unsigned int leading_ = 0;
+        unsigned int trailing_ = 0;
+        bool window_ = false;
+
+    };
+
+    class value_decoder {
+
+    public:
+
+        explicit value_decoder(std::string_view bytes) : reader_(bytes) {}
+
+        bool next(double& value) {
+            std::uint64_t bits;
+            if ( first_ ) {
+                if ( !reader_.read(64, bits) ) return false;
+                first_ = false;
+                previous_ = bits;
+            } else {
+                bool changed, window;
+                if ( !reader_.read_bit(changed) ) return false;
+                if ( changed ) {
+                    if ( !reader_.read_bit(window) ) return false;
+                    if ( window ) {
+                        std::uint64_t leading, meaningful;
+                        if ( !reader_.read(5, leading) || !reader_.read(6, meaningful) ) return false;
+                        if ( meaningful == 0 ) meaningful = 64;
+                        leading_ = static_cast<unsigned int>(leading);
+                        trailing_ = static_cast<unsigned int>(64 - leading - meaningful);
+                    }
+                    if ( !reader_.read(64 - leading_ - trailing_, bits) ) return false;
+                    previous_ ^= bits << trailing_;
+                }
+            }
+            value = std::bit_cast<double>(previous_);
+            return true;
+        }
+
+    private:
+
+        bit_reader reader_;
+        bool first_ = true;
+        std::uint64_t previous_ = 0;
+        unsigned int leading_ = 0;
+        unsigned int trailing_ = 0;
+
+    };
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace utils {
+
+    // Collision free hash over a fixed set of keys, found at compile time. Lookups hash the
+    // candidate once and confirm it with a single comparison against the key in its slot.
+    template <std::size_t N, std::size_t S = 64>
+    class perfect_hash {
+
+        static_assert((S & (S - 1)) == 0, "table size must be a power of two");
+        static_assert(N <= S, "table size must fit all keys");
+
+    public:
+
+        static constexpr int npos = -1;
+
+        constexpr explicit perfect_hash(std::array<std::string_view, N> const& keys) : keys_(keys) {
+            for (seed_ = 1; ; seed_++) {
+                slots_.fill(npos);
+                bool collision = false;
+                for (std::size_t i = 0; i < N && !collision; i++) {
+                    auto& slot = slots_[hash(keys_[i], seed_) & (S - 1)];
+                    collision = slot != npos;
+                    slot = static_cast<int>(i);
+                }
+                if ( !collision ) break;
+            }
+        }
+
+        // Returns the index of the key in the constructor set, or npos
+        [[nodiscard]] constexpr int find(std::string_view key) const {
+            int i = slots_[hash(key, seed_) & (S - 1)];
+            return i != npos && keys_[i] == key ? i : npos;
+        }
+
+        [[nodiscard]] constexpr std::uint32_t seed() const { return seed_; }
+
+    private:
+
+        std::array<std::string_view, N> keys_;
+        std::array<int, S> slots_{};
+        std::uint32_t seed_ = 0;
+
+        // FNV-1a with the seed mixed into the offset basis
+        static constexpr std::uint32_t hash(std::string_view key, std::uint32_t seed) {
+            std::uint32_t h = 2166136261u ^ (seed * 16777619u);
+            for (char c : key) {
+                h ^= static_cast<unsigned char>(c);
+                h *= 16777619u;
+            }
+            return h;
+        }
+
+    };
+
+}
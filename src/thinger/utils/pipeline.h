@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "queue.h"
+
+namespace utils {
+
+    // Cuts a byte stream into parts of part_size bytes, handed to consumer threads as soon as each
+    // one fills up, i.e., to upload an archive while it is being written. Parts are filled in a
+    // pool of buffers that the consumers give back, so the writer waits while the consumers are
+    // behind and memory stays at buffers parts. With several workers, parts are consumed at once
+    // and may complete out of order, their numbers tell their position. Once a part fails,
+    // writes are refused.
+    class part_pipeline {
+
+    public:
+
+        // Parts are numbered from 1
+        using consumer = std::function<bool(unsigned int part, std::string const& data)>;
+
+        part_pipeline(std::size_t part_size, std::size_t buffers, consumer c, std::size_t workers = 1) :
+            part_size_(std::max<std::size_t>(part_size, 1)),
+            free_(buffers),
+            ready_(buffers),
+            consumer_(std::move(c))
+        {
+            for (std::size_t i = 0; i < free_.capacity(); i++) free_.push(std::string());
+            for (std::size_t i = 0; i < std::max<std::size_t>(workers, 1); i++)
+                threads_.emplace_back([this] { run(); });
+        }
+
+        part_pipeline(part_pipeline const&) = delete;
+        part_pipeline& operator=(part_pipeline const&) = delete;
+
+        ~part_pipeline() { close(); }
+
+        bool write(const char* data, std::size_t length) {
+            while ( length > 0 ) {
+                if ( failed_ ) return false;
+                if ( !current_ ) {
+                    current_ = free_.pop();
+                    if ( !current_ ) return false;
+                    current_->reserve(part_size_);
+                }
+                auto n = std::min(length, part_size_ - current_->size());
+                current_->append(data, n);
+                data += n;
+                length -= n;
+                size_ += n;
+                if ( current_->size() == part_size_ && !send() ) return false;
+            }
+            return !failed_;
+        }
+
+        // Sends the last part, there is always at least one, and waits for the consumers to take
+        // every part. Returns whether all of them were consumed.
+        bool close() {
+            if ( threads_.empty() ) return !failed_;
+            if ( !current_ && count_ == 0 ) current_ = free_.pop();
+            if ( current_ ) send();
+            ready_.close();
+            for (auto& thread : threads_) thread.join();
+            threads_.clear();
+            return !failed_;
+        }
+
+        // Parts handed to the consumer
+        [[nodiscard]] unsigned int count() const { return count_; }
+
+        // Bytes written so far
+        [[nodiscard]] std::uint64_t size() const { return size_; }
+
+    private:
+
+        bool send() {
+            bool sent = ready_.push({++count_, std::move(*current_)});
+            current_.reset();
+            return sent;
+        }
+
+        void run() {
+            while ( auto part = ready_.pop() ) {
+                if ( !failed_ ) {
+                    bool consumed = false;
+                    try {
+                        consumed = consumer_(part->first, part->second);
+                    } catch (...) {}
+                    if ( !consumed ) {
+                        // wakes up a writer waiting for a buffer
+                        failed_ = true;
+                        free_.close();
+                    }
+                }
+                part->second.clear();
+                free_.push(std::move(part->second));
+            }
+        }
+
+        std::size_t part_size_;
+        bounded_queue<std::string> free_;
+        bounded_queue<std::pair<unsigned int, std::string>> ready_;
+        consumer consumer_;
+        std::optional<std::string> current_;
+        unsigned int count_ = 0;
+        std::uint64_t size_ = 0;
+        std::atomic<bool> failed_ = false;
+        std::vector<std::jthread> threads_;
+
+    };
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace utils {
+
+    // A queue between threads holding at most capacity items: push blocks while it is full, so
+    // producers faster than the consumer wait instead of piling up memory, and pop blocks while
+    // it is empty. Once closed, pushes are refused and pops drain what is left.
+    template <typename T>
+    class bounded_queue {
+
+    public:
+
+        explicit bounded_queue(std::size_t capacity) : capacity_(capacity > 0 ? capacity : 1) {}
+
+        bounded_queue(bounded_queue const&) = delete;
+        bounded_queue& operator=(bounded_queue const&) = delete;
+
+        // False when the queue is closed, the item is then dropped
+        bool push(T item) {
+            std::unique_lock lock(mutex_);
+            not_full_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+            if ( closed_ ) return false;
+            items_.push_back(std::move(item));
+            not_empty_.notify_one();
+            return true;
+        }
+
+        // Empty once the queue is closed and drained
+        std::optional<T> pop() {
+            std::unique_lock lock(mutex_);
+            not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+            if ( items_.empty() ) return std::nullopt;
+            T item = std::move(items_.front());
+            items_.pop_front();
+            not_full_.notify_one();
+            return item;
+        }
+
+        void close() {
+            std::scoped_lock lock(mutex_);
+            closed_ = true;
+            not_full_.notify_all();
+            not_empty_.notify_all();
+        }
+
+        [[nodiscard]] std::size_t size() const {
+            std::scoped_lock lock(mutex_);
+            return items_.size();
+        }
+
+        [[nodiscard]] std::size_t capacity() const { return capacity_; }
+
+    private:
+
+        std::size_t capacity_;
+        mutable std::mutex mutex_;
+        std::condition_variable not_full_;
+        std::condition_variable not_empty_;
+        std::deque<T> items_;
+        bool closed_ = false;
+
+    };
+
+}
@@ -1,13 +1,27 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <ctime>
 #include <filesystem>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include <archive.h>
 #include <archive_entry.h>
 
+#include <fcntl.h>
 #include <pwd.h>
 #include <grp.h>
+#include <unistd.h>
+
+#include "queue.h"
 
 namespace fs = std::filesystem;
 
@@ -29,11 +43,23 @@ namespace utils::tar {
     std::string error_string_;
   };
 
+  // Name of the i-th part of an entry written in parts, i.e., "dump.gz.part0003"
+  inline std::string part_name(std::string_view name, std::size_t i) {
+    auto index = std::to_string(i);
+    return std::string(name) + ".part" + std::string(index.size() < 4 ? 4 - index.size() : 0, '0') + index;
+  }
+
+  // Empty entry following the parts of an entry once it is whole, i.e., "dump.gz.complete", so the
+  // parts left by a producer that failed midway are not taken for the entry
+  inline std::string complete_name(std::string_view name) {
+    return std::string(name) + ".complete";
+  }
+
 }
 
 namespace utils::tar::write {
 
-  struct archive* create_archive(const std::string_view& dest_file) {
+  inline struct archive* create_archive(const std::string_view& dest_file) {
 
     struct archive *a;
 
@@ -52,8 +78,40 @@ namespace utils::tar::write {
 
   }
 
-  // Adds a single file to an archive
-  ssize_t add_entry(archive* a, const std::string_view& filename) {
+  // Bytes of an archive written to a sink instead of a file
+  using sink = std::function<bool(const char* data, std::size_t length)>;
+
+  // Creates an uncompressed archive whose bytes go to a sink as they are written, i.e., to upload
+  // it without storing it. A sink returning false fails the write.
+  inline struct archive* create_archive(sink output) {
+
+    struct archive *a;
+
+    // Creating archive
+    a = archive_write_new();
+
+    archive_write_set_format_pax_restricted(a);
+
+    // The sink belongs to the archive, which frees it when closed
+    archive_write_open(a, new sink(std::move(output)), nullptr,
+        [](struct archive* a, void* client, const void* buffer, size_t length) -> la_ssize_t {
+          if ( !(*static_cast<sink*>(client))(static_cast<const char*>(buffer), length) ) {
+            archive_set_error(a, EIO, "Failed writing archive to its sink");
+            return -1;
+          }
+          return (la_ssize_t)length;
+        },
+        [](struct archive*, void* client) -> int {
+          delete static_cast<sink*>(client);
+          return ARCHIVE_OK;
+        });
+
+    return a;
+
+  }
+
+  // Adds a single file to an archive under the given name, i.e., a path relative to the archive root
+  inline ssize_t add_entry(archive* a, const std::string_view& filename, const std::string_view& name) {
 
     struct archive_entry *entry;
 
@@ -63,23 +121,26 @@ namespace utils::tar::write {
     ssize_t len;
     ssize_t r;
 
-    // Clear the entry
-    //archive_entry_clear(entry);
+    std::string file(filename);
+    std::string pathname(name);
 
-    stat(filename.data(), &st);
+    stat(file.c_str(), &st);
     entry = archive_entry_new();
-    archive_entry_set_pathname_utf8(entry, filename.data());
+    archive_entry_set_pathname_utf8(entry, pathname.c_str());
     archive_entry_copy_stat(entry, &st); // copies all file attributes
 
     // Add entry to the archive
     archive_write_header(a, entry);
 
-    fd = open(filename.data(), O_RDONLY);
+    fd = open(file.c_str(), O_RDONLY);
     len = read(fd, buff, sizeof(buff));
     while ( len > 0 ) {
       r = archive_write_data(a, buff, len);
-      if ( r < 0 )
+      if ( r < 0 ) {
+        archive_entry_free(entry);
+        ::close(fd);
         return r;
+      }
       len = read(fd, buff, sizeof(buff));
     }
 
@@ -90,20 +151,27 @@ namespace utils::tar::write {
 
   }
 
-  // Adds a directory to an existing archive
-  ssize_t add_directory(archive* a, const std::string_view& directory_path) {
+  // Adds a single file to an archive
+  inline ssize_t add_entry(archive* a, const std::string_view& filename) {
+    return add_entry(a, filename, filename);
+  }
+
+  // Adds a directory to an existing archive under the given name, entries keep their paths
+  // relative to the directory
+  inline ssize_t add_directory(archive* a, const std::string_view& directory_path, const std::string_view& name) {
 
     // Add file or recursive directory file given a full path
-    std::vector<std::string> filenames;
+    std::vector<fs::path> filenames;
     if ( fs::is_directory(directory_path) ) {
       for(auto& p: fs::recursive_directory_iterator(directory_path)) {
         filenames.push_back(p.path()); // add directories and regular files
       }
     }
 
-    for (const std::string& filename : filenames) {
+    for (const auto& filename : filenames) {
 
-      ssize_t r = add_entry(a, filename);
+      auto pathname = fs::path(name) / filename.lexically_relative(directory_path);
+      ssize_t r = add_entry(a, filename.string(), pathname.string());
 
       if ( r < 0 ) return r;
 
@@ -113,7 +181,149 @@ namespace utils::tar::write {
 
   }
 
-  void close_archive(struct archive* a) {
+  // Adds a directory to an existing archive
+  inline ssize_t add_directory(archive* a, const std::string_view& directory_path) {
+    return add_directory(a, directory_path, directory_path);
+  }
+
+  // Adds a regular file entry with the given content
+  inline bool add_data(archive* a, const std::string& name, std::string_view data) {
+    struct archive_entry *entry = archive_entry_new();
+    archive_entry_set_pathname_utf8(entry, name.c_str());
+    archive_entry_set_filetype(entry, AE_IFREG);
+    archive_entry_set_perm(entry, 0644);
+    archive_entry_set_size(entry, (la_int64_t)data.size());
+    archive_entry_set_mtime(entry, std::time(nullptr), 0);
+
+    bool ok = archive_write_header(a, entry) == ARCHIVE_OK &&
+              ( data.empty() || archive_write_data(a, data.data(), data.size()) == (la_ssize_t)data.size() );
+    archive_entry_free(entry);
+    return ok;
+  }
+
+  // Writes data of unknown length, i.e., the output of a command as it runs, as consecutive entries
+  // of up to part_size bytes, since the header of an entry carries the size of its data. Only the
+  // part being filled is held in memory. Parts go to the archive, or to an emitter taking the
+  // name and content of each part, i.e., to hand them over to another thread.
+  class parts {
+
+  public:
+
+    using emitter = std::function<bool(std::string name, std::string data)>;
+
+    parts(archive* a, std::string name, std::size_t part_size = 16 << 20) :
+        parts(std::move(name), [a](std::string part, std::string data) { return add_data(a, part, data); }, part_size)
+    {}
+
+    parts(std::string name, emitter emit, std::size_t part_size = 16 << 20) :
+        emit_(std::move(emit)),
+        name_(std::move(name)),
+        part_size_(part_size)
+    {
+      buffer_.reserve(part_size_);
+    }
+
+    bool write(const char* data, std::size_t length) {
+      while ( length > 0 ) {
+        auto n = std::min(length, part_size_ - buffer_.size());
+        buffer_.append(data, n);
+        data += n;
+        length -= n;
+        if ( buffer_.size() == part_size_ && !flush() ) return false;
+      }
+      return true;
+    }
+
+    // Writes the last part, there is always at least one
+    bool close() {
+      return ( buffer_.empty() && count_ > 0 ) || flush();
+    }
+
+    // Marks the closed entry as whole, parts already handed over can not be taken back when the
+    // producer fails, so readers only join the parts of a completed entry
+    bool complete() {
+      return emit_(complete_name(name_), {});
+    }
+
+    [[nodiscard]] std::size_t count() const { return count_; }
+
+    // Bytes written so far
+    [[nodiscard]] std::uint64_t size() const { return size_ + buffer_.size(); }
+
+  private:
+
+    bool flush() {
+      size_ += buffer_.size();
+      bool ok = emit_(part_name(name_, count_), std::exchange(buffer_, {}));
+      buffer_.reserve(part_size_);
+      count_++;
+      return ok;
+    }
+
+    emitter emit_;
+    std::string name_;
+    std::size_t part_size_;
+    std::string buffer_;
+    std::size_t count_ = 0;
+    std::uint64_t size_ = 0;
+
+  };
+
+  // Writes into an archive the entries pushed by several producers from a single thread, as the
+  // archive can only be written sequentially. Jobs run in the order they are pushed, so the parts
+  // of an entry pushed by the same producer stay in order. Pushing blocks while capacity jobs are
+  // waiting, which bounds the memory held by the entries in flight. Once a job fails the rest are
+  // dropped and pushes are refused, so producers can stop early.
+  class serializer {
+
+  public:
+
+    using job = std::function<bool(archive*)>;
+
+    explicit serializer(archive* a, std::size_t capacity = 4) :
+        archive_(a),
+        queue_(capacity)
+    {
+      thread_ = std::jthread([this] { run(); });
+    }
+
+    serializer(serializer const&) = delete;
+    serializer& operator=(serializer const&) = delete;
+
+    ~serializer() { close(); }
+
+    bool push(job j) {
+      return !failed_ && queue_.push(std::move(j));
+    }
+
+    // Waits for the jobs pushed so far, returns whether all of them succeeded
+    bool close() {
+      queue_.close();
+      if ( thread_.joinable() ) thread_.join();
+      return !failed_;
+    }
+
+  private:
+
+    void run() {
+      while ( auto j = queue_.pop() ) {
+        if ( failed_ ) continue;
+        try {
+          if ( !(*j)(archive_) ) failed_ = true;
+        } catch (...) {
+          failed_ = true;
+        }
+      }
+    }
+
+    archive* archive_;
+    utils::bounded_queue<job> queue_;
+    std::atomic<bool> failed_ = false;
+    std::jthread thread_;
+
+  };
+
+  inline void close_archive(struct archive* a) {
     int r;
     r = archive_write_close(a);
     if ( r != ARCHIVE_OK )
@@ -127,7 +337,7 @@ namespace utils::tar::write {
 
 namespace utils::tar::read {
 
-  struct archive* create_archive(std::string_view filename) {
+  inline struct archive* create_archive(std::string_view filename) {
 
     struct archive *a;
     int r;
@@ -146,7 +356,7 @@ namespace utils::tar::read {
 
   }
 
-  void close_archive(archive* a) {
+  inline void close_archive(archive* a) {
     int r;
     r = archive_read_close(a);
     if ( r != ARCHIVE_OK )
@@ -156,7 +366,7 @@ namespace utils::tar::read {
       throw error( a );
   }
 
-  std::vector<std::string> list_files(archive* a) {
+  inline std::vector<std::string> list_files(archive* a) {
 
     struct archive_entry *entry;
 
@@ -170,7 +380,7 @@ namespace utils::tar::read {
   }
 
   // Returns the number of bytes written
-  bool copy_data(struct archive *ar, struct archive *aw) {
+  inline bool copy_data(struct archive *ar, struct archive *aw) {
     la_ssize_t  r;
     const void *buff;
     size_t size;
@@ -189,7 +399,7 @@ namespace utils::tar::read {
     }
   }
 
-  bool extract_one(struct archive* a, struct archive* ext, struct archive_entry* entry) {
+  inline bool extract_one(struct archive* a, struct archive* ext, struct archive_entry* entry) {
 
     int flags;
     la_ssize_t r;
@@ -229,8 +439,41 @@ namespace utils::tar::read {
 
   }
 
+  // Joins the entries written by write::parts for name into a single file, returns the number of
+  // parts found
+  inline std::size_t extract_parts(struct archive* a, std::string_view name, const std::string& dest_file) {
+
+    struct archive_entry *entry;
+    const void *buff;
+    size_t size;
+    la_int64_t offset;
+
+    std::ofstream file(dest_file, std::ios::binary | std::ios::trunc);
+    std::string prefix = std::string(name) + ".part";
+    std::size_t count = 0;
+
+    while ( archive_read_next_header(a, &entry) == ARCHIVE_OK ) {
+
+      if ( !std::string_view( archive_entry_pathname(entry) ).starts_with(prefix) ) continue;
+
+      la_ssize_t r;
+      while ( (r = archive_read_data_block(a, &buff, &size, &offset)) == ARCHIVE_OK )
+        file.write(static_cast<const char*>(buff), (std::streamsize)size);
+      if ( r != ARCHIVE_EOF )
+        throw error( a );
+
+      count++;
+    }
+
+    if ( !file.flush() )
+      return 0;
+
+    return count;
+
+  }
+
   // Extracts only the indicated file
-  bool extract_file(struct archive* a, std::string_view file) {
+  inline bool extract_file(struct archive* a, std::string_view file) {
 
     struct archive *ext;
     struct archive_entry *entry;
@@ -251,7 +494,7 @@ namespace utils::tar::read {
 
   }
 
-  bool extract(struct archive *a) {
+  inline bool extract(struct archive *a) {
 
     struct archive *ext;
     struct archive_entry *entry;
@@ -7,7 +7,7 @@ using json = nlohmann::json;
 
 namespace Thinger {
 
-    bool device_exists(const std::string &token, const std::string &user, const std::string &device, const std::string &server = THINGER_SERVER, const bool secure = true) {
+    inline bool device_exists(const std::string &token, const std::string &user, const std::string &device, const std::string &server = THINGER_SERVER, const bool secure = true) {
         // For on premise and private instances set secure to false with option -k
         std::string protocol = secure ? "https://" : "http://";
         httplib::Client cli(protocol+server);
@@ -26,7 +26,7 @@ namespace Thinger {
         return res->status == 200;
     }
 
-    int update_device_credentials(const std::string &token, const std::string &user, const std::string &device, const std::string &credentials, const std::string &server = THINGER_SERVER, const bool secure = true) {
+    inline int update_device_credentials(const std::string &token, const std::string &user, const std::string &device, const std::string &credentials, const std::string &server = THINGER_SERVER, const bool secure = true) {
         std::string protocol = secure ? "https://" : "http://";
         httplib::Client cli(protocol+server);
         #if OPEN_SSL
@@ -47,7 +47,7 @@ namespace Thinger {
         return res->status;
     }
 
-    int create_device(const std::string &token, const std::string &user, const std::string &device, const std::string &credentials, const std::string &name, const std::string &server = THINGER_SERVER, const bool secure = true) {
+    inline int create_device(const std::string &token, const std::string &user, const std::string &device, const std::string &credentials, const std::string &name, const std::string &server = THINGER_SERVER, const bool secure = true) {
         // For on premise and private instances set secure to false with option -k
         std::string protocol = secure ? "https://" : "http://";
         httplib::Client cli(protocol+server);
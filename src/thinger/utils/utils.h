@@ -13,7 +13,7 @@
 
 namespace utils::version {
 
-  bool is_current_version_newer(std::string_view version) {
+  inline bool is_current_version_newer(std::string_view version) {
 
     std::vector<int> v1, v2;
     std::stringstream ss1(VERSION), ss2(version.data());
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace utils::watch {
+
+    // Calls back once the writes to a file settle for the debounce time, so a burst of writes, or an
+    // editor saving in several steps, is seen as a single change. The directory is watched instead
+    // of the file to follow editors and tools replacing the file through a rename.
+    class file {
+
+    public:
+
+        file(std::filesystem::path const& path, std::chrono::milliseconds debounce, std::function<void()> callback) :
+            name_(path.filename().string()),
+            debounce_(debounce),
+            callback_(std::move(callback))
+        {
+            fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if ( fd_ < 0 ) return;
+
+            auto directory = path.has_parent_path() ? path.parent_path().string() : std::string(".");
+            if ( ::inotify_add_watch(fd_, directory.c_str(), IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE) < 0 ) {
+                ::close(fd_);
+                fd_ = -1;
+                return;
+            }
+
+            thread_ = std::jthread([this](const std::stop_token& stoken) { run(stoken); });
+        }
+
+        file(file const&) = delete;
+        file& operator=(file const&) = delete;
+
+        ~file() {
+            if ( thread_.joinable() ) {
+                thread_.request_stop();
+                thread_.join();
+            }
+            if ( fd_ >= 0 ) ::close(fd_);
+        }
+
+        // False when inotify is not available or the directory can not be watched
+        [[nodiscard]] bool watching() const { return fd_ >= 0; }
+
+    private:
+
+        void run(const std::stop_token& stoken) {
+            alignas(inotify_event) char buffer[4096];
+            bool pending = false;
+            auto deadline = std::chrono::steady_clock::now();
+
+            while ( !stoken.stop_requested() ) {
+                // wakes up often enough to stop and to fire a pending change in time
+                pollfd pfd{fd_, POLLIN, 0};
+                if ( ::poll(&pfd, 1, 50) > 0 && (pfd.revents & POLLIN) ) {
+                    ssize_t r;
+                    while ( (r = ::read(fd_, buffer, sizeof(buffer))) > 0 ) {
+                        for (char* p = buffer; p < buffer + r; ) {
+                            auto* event = reinterpret_cast<inotify_event*>(p);
+                            if ( event->len > 0 && name_ == event->name ) {
+                                pending = true;
+                                deadline = std::chrono::steady_clock::now() + debounce_;
+                            }
+                            p += sizeof(inotify_event) + event->len;
+                        }
+                    }
+                }
+
+                if ( pending && std::chrono::steady_clock::now() >= deadline ) {
+                    pending = false;
+                    callback_();
+                }
+            }
+        }
+
+        std::string name_;
+        std::chrono::milliseconds debounce_;
+        std::function<void()> callback_;
+        int fd_ = -1;
+        std::jthread thread_;
+
+    };
+
+}
@@ -1,11 +1,14 @@
+#pragma once
 
 #include <sstream>
 #include <iostream>
+#include <string>
+#include <vector>
 
 // This namespace does NOT use any xml library
 namespace XML {
 
-    std::string get_element_value(const std::string& xml, const std::string& element) {
+    inline std::string get_element_value(const std::string& xml, const std::string& element) {
         std::istringstream f(xml);
         std::string line;
 
@@ -23,4 +26,23 @@ namespace XML {
         return value;
     }
 
+    // Content of every element with the given name, in order, i.e., the entries of a list
+    inline std::vector<std::string> get_elements(const std::string& xml, const std::string& element) {
+        std::vector<std::string> values;
+
+        const std::string open = "<"+element+">";
+        const std::string close = "</"+element+">";
+
+        auto first = xml.find(open);
+        while (first != std::string::npos) {
+            first += open.size();
+            auto last = xml.find(close, first);
+            if (last == std::string::npos) break;
+            values.push_back(xml.substr(first, last-first));
+            first = xml.find(open, last+close.size());
+        }
+
+        return values;
+    }
+
 }
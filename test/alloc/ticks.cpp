@@ -0,0 +1,218 @@
+// Runs steady state ticks of a client replaying a fixture host, sampling every collector and
+// publishing the monitor resource into a json as the sampler and the resource do, counting heap
+// allocations and read and write syscalls per tick. Exits with an error when a tick allocates
+// more than the budget.
+//
+// The allocator is replaced for the whole program, so it is built apart from the tests:
+//
+//   alloc_ticks [--root <fixture>] [--ticks <n>] [--budget <allocations per tick>]
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+namespace {
+    std::atomic<bool> counting{false};
+    std::atomic<unsigned long long> allocations{0};
+
+    inline void count() {
+        if ( counting.load(std::memory_order_relaxed) )
+            allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+#if defined(__GLIBC__)
+
+// every allocation, from operator new or C code, ends up in malloc
+extern "C" {
+    void* __libc_malloc(std::size_t);
+    void* __libc_calloc(std::size_t, std::size_t);
+    void* __libc_realloc(void*, std::size_t);
+    void* __libc_memalign(std::size_t, std::size_t);
+
+    void* malloc(std::size_t size) {
+        count();
+        return __libc_malloc(size);
+    }
+
+    void* calloc(std::size_t n, std::size_t size) {
+        count();
+        return __libc_calloc(n, size);
+    }
+
+    void* realloc(void* p, std::size_t size) {
+        count();
+        return __libc_realloc(p, size);
+    }
+
+    void* aligned_alloc(std::size_t alignment, std::size_t size) {
+        count();
+        return __libc_memalign(alignment, size);
+    }
+
+    int posix_memalign(void** p, std::size_t alignment, std::size_t size) {
+        count();
+        *p = __libc_memalign(alignment, size);
+        return *p ? 0 : ENOMEM;
+    }
+}
+
+#else
+
+void* operator new(std::size_t size) {
+    count();
+    if ( void* p = std::malloc(size ? size : 1) ) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+#endif
+
+#if OPEN_SSL
+  #define CPPHTTPLIB_OPENSSL_SUPPORT
+#endif
+
+#include <thinger/thinger.h>
+#include "../../src/thinger/client.h"
+
+#ifndef FIXTURES_DIR
+  #define FIXTURES_DIR "../test/fixtures"
+#endif
+
+namespace thinger::monitor::alloc {
+
+    // Exposes the sampler to drive it from the harness
+    class client : public Client {
+    public:
+        using Client::Client;
+        using Client::sample;
+    };
+
+    // Devices of the fixture host as configured from the resources, interfaces are the names
+    // before ':' in /proc/net/dev
+    inline nlohmann::json devices() {
+        nlohmann::json resources = {{"defaults", true}, {"filesystems", {"/"}}};
+
+        std::vector<std::string> names;
+        source::list("/sys/block", names);
+        resources["drives"] = names;
+
+        std::string content;
+        source::read("/proc/net/dev", content);
+        std::istringstream is(content);
+        for (std::string line; std::getline(is, line); ) {
+            auto colon = line.find(':');
+            if ( colon == std::string::npos ) continue;
+            auto first = line.find_first_not_of(' ');
+            resources["interfaces"].push_back(line.substr(first, colon - first));
+        }
+        return resources;
+    }
+
+    // Read and write syscalls of this process so far, from /proc/self/io
+    inline std::pair<unsigned long long, unsigned long long> syscalls() {
+        char buffer[512];
+        int fd = ::open("/proc/self/io", O_RDONLY | O_CLOEXEC);
+        if ( fd < 0 ) return {0, 0};
+        ssize_t r = ::read(fd, buffer, sizeof(buffer) - 1);
+        ::close(fd);
+        if ( r <= 0 ) return {0, 0};
+        buffer[r] = '\0';
+
+        auto field = [&buffer](const char* name) {
+            const char* p = std::strstr(buffer, name);
+            return p ? std::strtoull(p + std::strlen(name), nullptr, 10) : 0ULL;
+        };
+        return {field("syscr: "), field("syscw: ")};
+    }
+
+}
+
+int main(int argc, char* argv[]) {
+
+    using namespace thinger::monitor;
+
+    std::string root = FIXTURES_DIR "/large";
+    unsigned long ticks = 1000;
+    double budget = 0;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if ( std::strcmp(argv[i], "--root") == 0 ) root = argv[i + 1];
+        else if ( std::strcmp(argv[i], "--ticks") == 0 ) ticks = std::strtoul(argv[i + 1], nullptr, 10);
+        else if ( std::strcmp(argv[i], "--budget") == 0 ) budget = std::strtod(argv[i + 1], nullptr);
+    }
+
+    // the fixture tree as a capture, so the client is built in replay mode
+    auto capture = (std::filesystem::temp_directory_path() / "thinger_monitor_alloc.cap").string();
+    {
+        capture::recorder recorder(capture);
+        capture::snapshot(root, recorder);
+        recorder.write("@space:/", true, "1000000000000 400000000000 350000000000");
+    }
+    source::replay(capture);
+
+    auto config_path = (std::filesystem::temp_directory_path() / "thinger_monitor_alloc.json").string();
+    Config config(config_path);
+    thinger::iotmp::client iotmp_client("");
+    alloc::client c(iotmp_client, config);
+
+    // a short history, so its rings are full after the warm up
+    auto resources = alloc::devices();
+    resources["history"] = {{"raw", 60}, {"minutes", 60}, {"hours", 2}};
+    config.update("resources", resources);
+    c.reload_configuration("resources");
+
+    // a minute between ticks, every collector and the values refreshed on publish are due on each
+    nlohmann::json out;
+    auto tick = [&c, &out] {
+        source::advance(source::now() + std::chrono::minutes(1));
+        c.sample();
+        c.publish(out);
+    };
+
+    // the first ticks grow the reused buffers, the batch and the history to their steady state size
+    for (int i = 0; i < 700; i++)
+        tick();
+
+    // what reading /proc/self/io costs itself
+    auto overhead = alloc::syscalls();
+    auto before = alloc::syscalls();
+    auto measure = before.first - overhead.first;
+
+    counting = true;
+    for (unsigned long i = 0; i < ticks; i++)
+        tick();
+    counting = false;
+
+    auto after = alloc::syscalls();
+
+    source::reset();
+    std::filesystem::remove(capture);
+    std::filesystem::remove(config_path);
+
+    double per_tick = (double)allocations.load() / (double)ticks;
+    std::printf("root: %s\n", root.c_str());
+    std::printf("ticks: %lu\n", ticks);
+    std::printf("published values: %zu\n", out.size());
+    std::printf("allocations per tick: %.2f (budget %.2f)\n", per_tick, budget);
+    std::printf("read syscalls per tick: %.2f\n", (double)(after.first - before.first - measure) / (double)ticks);
+    std::printf("write syscalls per tick: %.2f\n", (double)(after.second - before.second) / (double)ticks);
+
+    if ( per_tick > budget ) {
+        std::printf("FAILED: steady state ticks allocate over the budget\n");
+        return 1;
+    }
+    return 0;
+}
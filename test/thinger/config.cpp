@@ -114,6 +114,83 @@ namespace thinger::monitor {
 
         }
 
+        SECTION("Snapshots") {
+
+              auto before = config.snapshot();
+
+              nlohmann::json resources = {{"defaults", true}, {"drives", {"sda", "sdb"}}};
+              REQUIRE( config.update("resources", resources) );
+              REQUIRE( !config.update("resources", resources) );
+
+              REQUIRE( config.get_defaults() == true );
+              REQUIRE( config.get_drives() == std::vector<std::string>{"sda", "sdb"} );
+              REQUIRE( config.get_filesystems().empty() );
+
+              nlohmann::json storage = {{"S3", {{"bucket", "remote_s3"}, {"region", "region_s3"}}}};
+              config.update("storage", storage);
+              REQUIRE( config.get_bucket("S3") == "remote_s3" );
+              REQUIRE( config.get_region("S3") == "region_s3" );
+              REQUIRE( config.get_bucket("GC").empty() );
+
+              // readers holding a snapshot keep it
+              REQUIRE( before->drives == std::vector<std::string>{"nvme0n1"} );
+              REQUIRE( before->find_storage("S3").bucket == "monitor_s3" );
+              REQUIRE( before->find_storage("GC").bucket == "monitor_gc" );
+              REQUIRE( before->id == "test" );
+
+        }
+
+        SECTION("Changes") {
+
+              auto before = config.snapshot();
+              REQUIRE( monitor::config::diff(*before, *config.snapshot()) == 0 );
+
+              config.update("resources", nlohmann::json{{"defaults", true}, {"drives", {"nvme0n1"}}, {"filesystems", {"/"}}, {"interfaces", {"wlan0"}},
+                                                        {"alerts", {{{"name", "disk"}, {"rule", "st_/_usage > 90"}}}}});
+              REQUIRE( monitor::config::diff(*before, *config.snapshot()) == monitor::config::changed::alerts );
+
+              before = config.snapshot();
+              config.update("resources", nlohmann::json{{"drives", {"nvme0n1"}}, {"server", {{"port", 7891}}}});
+              auto changes = monitor::config::diff(*before, *config.snapshot());
+              REQUIRE( (changes & monitor::config::changed::devices) );
+              REQUIRE( (changes & monitor::config::changed::server) );
+              REQUIRE( !(changes & monitor::config::changed::backups) );
+              REQUIRE( !(changes & monitor::config::changed::connection) );
+
+              // resources from the local file until the remote ones are received
+              REQUIRE( empty.get_drives().empty() );
+              REQUIRE( Config("../test/thinger/config.json").get_interfaces() == std::vector<std::string>{"wlan0"} );
+
+        }
+
+        SECTION("Sampling floor") {
+
+              config.update("resources", nlohmann::json{{"sampling", {{"cpu", {{"floor", 0}}}, {"ram", {{"floor", -2}, {"ceiling", -1}}}}}});
+              REQUIRE( config.get_sampling("cpu", {}).floor == monitor::sampling::policy::min_floor );
+              REQUIRE( config.get_sampling("ram", {}).floor == monitor::sampling::policy::min_floor );
+              REQUIRE( config.get_sampling("ram", {}).ceiling == monitor::sampling::policy::min_floor );
+
+        }
+
+        SECTION("Streamed backups") {
+
+              // interrupted streamed uploads can not be resumed, streaming is opted in
+              REQUIRE( !config.snapshot()->backup_stream );
+              config.update("backups", nlohmann::json{{"stream", true}});
+              REQUIRE( config.snapshot()->backup_stream );
+
+        }
+
+        SECTION("Properties of the wrong type") {
+
+              REQUIRE_NOTHROW( config.update("backups", nlohmann::json{{"concurrency", "4"}, {"stream", 1}, {"stale_uploads", -3}}) );
+              REQUIRE( config.snapshot()->backup_concurrency == 4 );
+              REQUIRE( config.snapshot()->backup_stream == monitor::config::snapshot{}.backup_stream );
+              REQUIRE_NOTHROW( config.update("backups", nlohmann::json{{"concurrency", -1}}) );
+              REQUIRE( config.snapshot()->backup_concurrency == 4 );
+
+        }
+
         SECTION("pson") {
 
 
@@ -149,6 +226,12 @@ namespace thinger::monitor::config {
 
         REQUIRE( get(j, "/object"_json_pointer, nlohmann::json({})) == j["object"] );
         REQUIRE( get(j, "/object/test"_json_pointer, nlohmann::json({})) == nlohmann::json({}) );
+
+        // values of another type, or negative for unsigned fields, give the fallback
+        REQUIRE( get(j, "/string"_json_pointer, 4u) == 4u );
+        REQUIRE( get(j, "/object"_json_pointer, std::string("fallback")) == "fallback" );
+        REQUIRE( get(nlohmann::json{{"negative", -1}}, "/negative"_json_pointer, 4u) == 4u );
+        REQUIRE( get(nlohmann::json{{"negative", -1}}, "/negative"_json_pointer, 4) == -1 );
     }
 
 }
@@ -0,0 +1,66 @@
+#include "../../../src/thinger/monitor/agent.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <thread>
+
+namespace thinger::monitor::agent {
+
+    TEST_CASE("Agent self metrics", "[agent]") {
+
+        using namespace std::chrono_literals;
+
+        SECTION("Histogram quantiles are bucket upper bounds") {
+
+            histogram h;
+            REQUIRE( h.quantile(0.5) == 0 );
+
+            for (int i = 0; i < 98; i++)
+                h.record(100us); // [64, 128)
+            h.record(3ms);        // [2048, 4096)
+            h.record(40ms);
+
+            REQUIRE( h.count() == 100 );
+            REQUIRE( h.max() == 40000 );
+            REQUIRE( h.quantile(0.5) == 128 );
+            REQUIRE( h.quantile(0.985) == 4096 );
+            REQUIRE( h.quantile(1) == 40000 );
+            REQUIRE( h.mean() == (98 * 100 + 3000 + 40000) / 100.0 );
+        }
+
+        SECTION("Timer records its scope") {
+
+            histogram h;
+            {
+                timer t(h);
+                std::this_thread::sleep_for(2ms);
+            }
+            REQUIRE( h.count() == 1 );
+            REQUIRE( h.max() >= 2000 );
+        }
+
+        SECTION("Parse /proc/self/stat") {
+
+            usage u;
+            parse_stat("1234 (thinger monitor) S 1 1234 1234 0 -1 4194560 2301 0 0 0 250 150 0 0 20 0 7 0 "
+                       "123456 110000000 3000 18446744073709551615", u, 100, 4096);
+
+            REQUIRE( u.cpu_time == 4.0 );
+            REQUIRE( u.threads == 7 );
+            REQUIRE( u.rss == 12000 );
+        }
+
+        SECTION("Retrieve own usage") {
+
+            usage u;
+            std::string buffer;
+            retrieve_usage(u, buffer);
+
+            REQUIRE( u.rss > 0 );
+            REQUIRE( u.threads >= 1 );
+            REQUIRE( u.fds >= 3 );
+        }
+
+    }
+
+}
@@ -0,0 +1,191 @@
+#include "../../../src/thinger/monitor/alerts.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace thinger::monitor::alerts {
+
+    TEST_CASE("Alert rules parsing", "[alerts]") {
+
+        using namespace std::chrono_literals;
+
+        auto e = parse("st_/_usage > 90 for 2m");
+        REQUIRE( e.has_value() );
+        REQUIRE( e->metric == "st_/_usage" );
+        REQUIRE( e->op == comparison::greater );
+        REQUIRE( e->threshold == 90 );
+        REQUIRE( e->duration == 2min );
+        REQUIRE( !e->rate );
+
+        e = parse("nw_eth0 packetloss_incoming rate >= 10");
+        REQUIRE( e.has_value() );
+        REQUIRE( e->metric == "nw_eth0_packetloss_incoming" );
+        REQUIRE( e->rate );
+        REQUIRE( e->op == comparison::greater_equal );
+        REQUIRE( e->duration == 0ms );
+
+        REQUIRE( parse("ram_usage < 5 for 30")->duration == 30s );
+
+        REQUIRE( !parse("").has_value() );
+        REQUIRE( !parse("ram_usage >").has_value() );
+        REQUIRE( !parse("ram_usage > high").has_value() );
+        REQUIRE( !parse("ram_usage > 90 during 2m").has_value() );
+        REQUIRE( !parse("ram_usage > 90 for 2d").has_value() );
+    }
+
+    TEST_CASE("Alert rules evaluation", "[alerts]") {
+
+        using namespace std::chrono_literals;
+
+        double usage = 50;
+        double packets = 0;
+        catalog metrics = {
+            {"st_/_usage", {[&usage] { return usage; }}},
+            {"nw_eth0_packetloss_incoming", {[&packets] { return packets; }}},
+        };
+
+        engine rules;
+        auto failed = rules.compile({
+            {"disk", "st_/_usage > 90 for 2m", 85, "disk_alert"},
+            {"loss", "nw_eth0_packetloss_incoming rate > 10", std::nullopt, "loss_alert"},
+            {"unknown", "st_/data_usage > 90", std::nullopt, ""},
+        }, metrics);
+
+        REQUIRE( failed == std::vector<std::string>{"unknown"} );
+        REQUIRE( rules.size() == 2 );
+
+        auto now = clock::time_point{} + 1h;
+        std::vector<event> events;
+
+        SECTION("For duration and hysteresis") {
+
+            usage = 95;
+            rules.evaluate(now, events);
+            rules.evaluate(now + 1min, events);
+            REQUIRE( events.empty() );
+
+            rules.evaluate(now + 2min, events);
+            REQUIRE( events.size() == 1 );
+            REQUIRE( events[0].name == "disk" );
+            REQUIRE( events[0].endpoint == "disk_alert" );
+            REQUIRE( events[0].firing );
+            REQUIRE( rules.firing() == 1 );
+
+            // below threshold but above clear level keeps firing
+            usage = 88;
+            rules.evaluate(now + 3min, events);
+            REQUIRE( events.size() == 1 );
+
+            usage = 80;
+            rules.evaluate(now + 4min, events);
+            REQUIRE( events.size() == 2 );
+            REQUIRE( !events[1].firing );
+            REQUIRE( rules.firing() == 0 );
+        }
+
+        SECTION("Interrupted condition restarts the duration") {
+
+            usage = 95;
+            rules.evaluate(now, events);
+            usage = 50;
+            rules.evaluate(now + 1min, events);
+            usage = 95;
+            rules.evaluate(now + 2min, events);
+            rules.evaluate(now + 3min, events);
+            REQUIRE( events.empty() );
+            rules.evaluate(now + 4min, events);
+            REQUIRE( events.size() == 1 );
+        }
+
+        SECTION("Rate of change") {
+
+            rules.evaluate(now, events);
+            packets = 50; // 5 per second
+            rules.evaluate(now + 10s, events);
+            REQUIRE( events.empty() );
+
+            packets = 250; // 20 per second
+            rules.evaluate(now + 20s, events);
+            REQUIRE( events.size() == 1 );
+            REQUIRE( events[0].name == "loss" );
+            REQUIRE( events[0].value == 20 );
+        }
+
+        SECTION("Recompiling keeps the state of unchanged rules") {
+
+            usage = 95;
+            rules.evaluate(now, events);
+            rules.evaluate(now + 2min, events);
+            REQUIRE( rules.firing() == 1 );
+
+            rules.compile({{"disk", "st_/_usage > 90 for 2m", 85, "disk_alert"}}, metrics);
+            REQUIRE( rules.firing() == 1 );
+
+            rules.compile({{"disk", "st_/_usage > 80 for 2m", 75, "disk_alert"}}, metrics);
+            REQUIRE( rules.firing() == 0 );
+        }
+
+    }
+
+    TEST_CASE("Alert rules on collectors with different cadences", "[alerts]") {
+
+        using namespace std::chrono_literals;
+
+        // network sampled every second, memory every 10s
+        constexpr feeds network = 1 << 0;
+        constexpr feeds memory = 1 << 1;
+
+        double packets = 0;
+        double usage = 50;
+        catalog metrics = {
+            {"nw_eth0_packetloss_incoming", {[&packets] { return packets; }, network}},
+            {"ram_usage", {[&usage] { return usage; }, memory}},
+        };
+
+        engine rules;
+        auto failed = rules.compile({
+            {"loss", "nw_eth0_packetloss_incoming rate > 10", std::nullopt, ""},
+            {"leak", "ram_usage rate > 1", std::nullopt, ""},
+            {"growth", "ram_usage rate > 0.1 for 20s", std::nullopt, ""},
+        }, metrics);
+        REQUIRE( failed.empty() );
+
+        auto now = clock::time_point{} + 1h;
+        std::vector<event> events;
+
+        // 5 packets per second, memory usage grows 0.5 per second between its samples
+        auto run = [&](std::chrono::seconds until) {
+            for (auto at = 0s; at <= until; at += 1s) {
+                feeds sampled = network;
+                if ( at.count() > 0 ) packets += 5;
+                if ( at.count() % 10 == 0 ) {
+                    if ( at.count() > 0 ) usage += 5;
+                    sampled |= memory;
+                }
+                rules.evaluate(now + at, events, sampled);
+            }
+        };
+
+        SECTION("A rate spans the samples of its metric") {
+            run(20s);
+            REQUIRE( events.empty() );
+        }
+
+        SECTION("Passes of other collectors do not restart a duration") {
+            run(30s);
+            REQUIRE( events.size() == 1 );
+            REQUIRE( events[0].name == "growth" );
+            REQUIRE( events[0].firing );
+            REQUIRE( events[0].value == 0.5 );
+        }
+
+        SECTION("Rules are evaluated on every pass without feeds") {
+            rules.evaluate(now, events);
+            usage += 5;
+            rules.evaluate(now + 1s, events);
+            REQUIRE( events.size() == 1 );
+            REQUIRE( events[0].name == "leak" );
+        }
+
+    }
+
+}
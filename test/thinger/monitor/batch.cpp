@@ -0,0 +1,71 @@
+#include "../../../src/thinger/monitor/batch.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <nlohmann/json.hpp>
+
+namespace thinger::monitor::batch {
+
+    TEST_CASE("Columnar batches", "[batch]") {
+
+        columns c(100);
+        c.reset({"cpu_usage", "ram_usage", "st_default_usage"});
+
+        for (int i = 0; i < 60; i++)
+            c.append(1700000000000 + i * 5000, {(double)(i % 7), 42.25, 75.5 + (i / 20)});
+        REQUIRE( c.size() == 60 );
+
+        SECTION("Round trip") {
+            auto d = decode(c.encode());
+            REQUIRE( d.has_value() );
+            REQUIRE( d->names == c.names() );
+            REQUIRE( d->timestamps.size() == 60 );
+            REQUIRE( d->timestamps[59] == 1700000000000 + 59 * 5000 );
+            REQUIRE( d->values[0][13] == 6 );
+            REQUIRE( d->values[1][30] == 42.25 );
+            REQUIRE( d->values[2][59] == 77.5 );
+        }
+
+        SECTION("Smaller than the samples as json") {
+            nlohmann::json rows = nlohmann::json::array();
+            for (int i = 0; i < 60; i++)
+                rows.push_back({{"ts", 1700000000000 + i * 5000}, {"cpu_usage", i % 7}, {"ram_usage", 42.25}, {"st_default_usage", 75.5 + (i / 20)}});
+            REQUIRE( c.encode().size() * 10 < rows.dump().size() );
+        }
+
+        SECTION("Rows not matching the series are dropped") {
+            c.append(1700000300000, {1, 2});
+            REQUIRE( c.size() == 60 );
+        }
+
+        SECTION("A full batch starts over") {
+            for (int i = 60; i < 101; i++)
+                c.append(1700000000000 + i * 5000, {0, 0, 0});
+            REQUIRE( c.size() == 1 );
+
+            // the columns are encoded from scratch, as in a new batch
+            columns fresh(100);
+            fresh.reset(c.names());
+            fresh.append(1700000000000 + 100 * 5000, {0, 0, 0});
+            REQUIRE( c.encode() == fresh.encode() );
+            auto d = decode(c.encode());
+            REQUIRE( d.has_value() );
+            REQUIRE( d->timestamps == std::vector<std::int64_t>{1700000000000 + 100 * 5000} );
+        }
+
+        SECTION("Reset and truncated input") {
+            auto encoded = c.encode();
+            REQUIRE( !decode(std::string_view(encoded).substr(0, encoded.size() - 3)).has_value() );
+            REQUIRE( !decode("").has_value() );
+
+            c.reset({"cpu_usage"});
+            REQUIRE( c.size() == 0 );
+            auto d = decode(c.encode());
+            REQUIRE( d.has_value() );
+            REQUIRE( d->names.size() == 1 );
+            REQUIRE( d->timestamps.empty() );
+        }
+
+    }
+
+}
@@ -0,0 +1,132 @@
+#include "../../../src/thinger/monitor/source.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <fstream>
+#include <thread>
+
+namespace thinger::monitor::capture {
+
+    namespace {
+
+        struct temp_file {
+            std::filesystem::path path;
+            explicit temp_file(std::string const& name) : path(std::filesystem::temp_directory_path() / name) {}
+            ~temp_file() { std::filesystem::remove_all(path); }
+        };
+
+    }
+
+    TEST_CASE("Capture files", "[capture]") {
+
+        temp_file file("thinger_capture_test.cap");
+
+        SECTION("Round trip of contents, unchanged and missing files") {
+            {
+                recorder r(file.path.string());
+                REQUIRE( r.good() );
+                r.write("/proc/loadavg", true, "0.10 0.20 0.30 1/100 1234\n");
+                r.write("/proc/loadavg", true, "0.10 0.20 0.30 1/100 1234\n");
+                r.write("/proc/pressure/cpu", false, "");
+                r.write("/proc/loadavg", true, "");
+            }
+
+            replayer p;
+            REQUIRE( p.load(file.path.string()) );
+            REQUIRE( p.size() == 2 );
+
+            std::string buffer;
+            REQUIRE( p.read("/proc/loadavg", std::chrono::nanoseconds(0), buffer) );
+            REQUIRE( buffer == "0.10 0.20 0.30 1/100 1234\n" );
+            REQUIRE( !p.read("/proc/pressure/cpu", p.end(), buffer) );
+            REQUIRE( !p.read("/proc/unknown", p.end(), buffer) );
+
+            // the last read of an existing file was empty
+            REQUIRE( p.read("/proc/loadavg", p.end(), buffer) );
+            REQUIRE( buffer.empty() );
+        }
+
+        SECTION("Reads return the content at a time of the capture") {
+            {
+                recorder r(file.path.string());
+                r.write("/proc/stat", true, "first");
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                r.write("/proc/stat", true, "second");
+            }
+
+            replayer p;
+            REQUIRE( p.load(file.path.string()) );
+
+            std::string buffer;
+            REQUIRE( p.read("/proc/stat", std::chrono::milliseconds(1), buffer) );
+            REQUIRE( buffer == "first" );
+            REQUIRE( p.read("/proc/stat", p.end(), buffer) );
+            REQUIRE( buffer == "second" );
+            REQUIRE( p.read("/proc/stat", std::chrono::hours(1), buffer) );
+            REQUIRE( buffer == "second" );
+        }
+
+        SECTION("Truncated and foreign files are rejected") {
+            {
+                recorder r(file.path.string());
+                r.write("/proc/stat", true, "content");
+            }
+            std::filesystem::resize_file(file.path, std::filesystem::file_size(file.path) - 2);
+            REQUIRE( !replayer().load(file.path.string()) );
+
+            std::ofstream(file.path, std::ios::trunc) << "not a capture";
+            REQUIRE( !replayer().load(file.path.string()) );
+        }
+
+    }
+
+    TEST_CASE("Source record and replay", "[capture]") {
+
+        temp_file root("thinger_capture_root");
+        temp_file file("thinger_capture_source.cap");
+
+        std::filesystem::create_directories(root.path / "proc/1");
+        std::filesystem::create_directories(root.path / "proc/42");
+        std::ofstream(root.path / "proc/loadavg") << "1.50 1.00 0.50 2/200 4321\n";
+        source::set_root(root.path.string());
+
+        std::vector<std::string> names;
+        std::string buffer;
+
+        REQUIRE( source::record(file.path.string()) );
+        REQUIRE( source::recording() );
+        source::list("/proc", names);
+        source::read("/proc/loadavg", buffer);
+        source::annotate("#config/resources", R"({"drives":["sda"]})");
+        source::reset();
+
+        // the host changes after the recording
+        std::filesystem::remove_all(root.path / "proc");
+
+        REQUIRE( source::replay(file.path.string()) );
+        REQUIRE( source::replaying() );
+
+        REQUIRE( source::list("/proc", names) );
+        REQUIRE( names == std::vector<std::string>{"1", "42", "loadavg"} );
+        REQUIRE( source::read("/proc/loadavg", buffer) );
+        REQUIRE( buffer == "1.50 1.00 0.50 2/200 4321\n" );
+        REQUIRE( source::read("#config/resources", buffer) );
+        REQUIRE( buffer == R"({"drives":["sda"]})" );
+
+        std::string load;
+        source::stream("/proc/loadavg") >> load;
+        REQUIRE( load == "1.50" );
+
+        // time is virtual while replaying
+        auto start = source::now();
+        REQUIRE( source::now() == start );
+        source::advance(start + std::chrono::hours(1));
+        REQUIRE( source::now() - start == std::chrono::hours(1) );
+        REQUIRE( source::replay_finished() );
+
+        source::reset();
+        source::set_root("");
+        REQUIRE( !source::replaying() );
+    }
+
+}
@@ -0,0 +1,54 @@
+#include "../../../src/thinger/monitor/devices.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace thinger::monitor::devices {
+
+    struct counter {
+        std::string name;
+        unsigned long long before = 0;
+    };
+
+    TEST_CASE("Device reconciliation", "[devices]") {
+
+        std::vector<counter> devices;
+        REQUIRE( reconcile(devices, {"sda", "sdb"}, &counter::name) == std::vector<std::size_t>{0, 1} );
+        devices[0].before = 100;
+        devices[1].before = 200;
+
+        SECTION("Unchanged devices keep their baselines") {
+            REQUIRE( reconcile(devices, {"sda", "sdb"}, &counter::name).empty() );
+            REQUIRE( devices.size() == 2 );
+            REQUIRE( devices[0].before == 100 );
+            REQUIRE( devices[1].before == 200 );
+        }
+
+        SECTION("Only new devices are to be initialized") {
+            auto added = reconcile(devices, {"nvme0n1", "sdb", "sda"}, &counter::name);
+            REQUIRE( added == std::vector<std::size_t>{0} );
+            REQUIRE( devices[0].name == "nvme0n1" );
+            REQUIRE( devices[0].before == 0 );
+            REQUIRE( devices[1].name == "sdb" );
+            REQUIRE( devices[1].before == 200 );
+            REQUIRE( devices[2].before == 100 );
+        }
+
+        SECTION("Removed devices are retired") {
+            REQUIRE( reconcile(devices, {"sdb"}, &counter::name).empty() );
+            REQUIRE( devices.size() == 1 );
+            REQUIRE( devices[0].before == 200 );
+
+            // coming back is a new device
+            REQUIRE( reconcile(devices, {"sda", "sdb"}, &counter::name) == std::vector<std::size_t>{0} );
+            REQUIRE( devices[0].before == 0 );
+        }
+
+        SECTION("Devices configured twice are kept once") {
+            REQUIRE( reconcile(devices, {"sda", "sda", "sdc", "sdc"}, &counter::name) == std::vector<std::size_t>{1} );
+            REQUIRE( devices.size() == 2 );
+            REQUIRE( devices[0].before == 100 );
+        }
+
+    }
+
+}
@@ -0,0 +1,186 @@
+#include <nlohmann/json.hpp>
+
+#include "../../../src/thinger/monitor.h"
+#include "../../../src/thinger/monitor/memory.h"
+#include "../../../src/thinger/monitor/numa.h"
+#include "../../../src/thinger/monitor/sensors.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+
+namespace thinger::monitor {
+
+    namespace {
+
+        // Fixture trees mirror the files the collectors read below the root
+        struct fixture {
+            explicit fixture(std::string const& host) : root("../test/fixtures/" + host) {
+                source::set_root(root);
+            }
+            ~fixture() {
+                source::set_root("");
+            }
+            std::string root;
+        };
+
+    }
+
+    TEST_CASE("Collectors on fixture hosts", "[fixtures]") {
+
+        using Catch::Approx;
+
+        SECTION("Small host") {
+
+            fixture host("small");
+
+            std::string hostname, os_version, kernel_version, uptime;
+            system::retrieve_hostname(hostname);
+            system::retrieve_os_version(os_version);
+            system::retrieve_kernel_version(kernel_version);
+            system::retrieve_uptime(uptime);
+            REQUIRE( hostname == "edge-small" );
+            REQUIRE( os_version == "Ubuntu 22.04.3 LTS" );
+            REQUIRE( kernel_version == "Linux 5.15.0-88-generic" );
+            REQUIRE( uptime == "1 day, 2 hours, 3 minutes" );
+
+            std::array<float, 3> loads{};
+            unsigned int procs = 0;
+            cpu::retrieve_cpu_loads(loads);
+            cpu::retrieve_cpu_procs(procs);
+            REQUIRE( loads[0] == Approx(0.5) );
+            REQUIRE( loads[2] == Approx(0.3) );
+            REQUIRE( procs == 2 );
+
+            std::vector<network::interface> interfaces(1);
+            interfaces[0].name = "eth0";
+            network::retrieve_ifc_stats(interfaces);
+            REQUIRE( interfaces[0].total_transfer[0] == 123456789 );
+            REQUIRE( interfaces[0].total_transfer[1] == 987654321 );
+            REQUIRE( interfaces[0].total_packets[1] == 2 );
+            REQUIRE( interfaces[0].total_packets[3] == 1 );
+
+            std::vector<io::drive> drives(1);
+            drives[0].name = "sda";
+            io::retrieve_dv_stats(drives);
+            REQUIRE( drives[0].total_io[0] == 2000000 );
+            REQUIRE( drives[0].total_io[1] == 4000000 );
+            REQUIRE( drives[0].total_io[2] == 7000 );
+
+            pressure::stall psi;
+            pressure::retrieve_psi("cpu", psi);
+            REQUIRE( psi.some == Approx(1.5) );
+
+            system::updates updates;
+            system::retrieve_updates(updates);
+            REQUIRE( updates.normal == 3 );
+            REQUIRE( updates.security == 1 );
+            REQUIRE( updates.restart );
+
+            memory::stats mem;
+            std::string buffer;
+            REQUIRE( memory::retrieve(mem, buffer) );
+            REQUIRE( mem.meminfo[memory::mem_total] == 4000000 );
+            REQUIRE( mem.vmstat[memory::pgfault] == 1000 );
+
+            auto nodes = numa::discover(buffer);
+            REQUIRE( nodes.size() == 1 );
+            REQUIRE( nodes[0].cpus.size() == 4 );
+
+            sensors::collector sensors;
+            sensors.discover();
+            REQUIRE( sensors.temperatures().size() == 1 );
+            REQUIRE( sensors.max_temperature() == Approx(52) );
+            REQUIRE( sensors.cores().size() == 4 );
+            REQUIRE( sensors.cores()[0].max == 2400 );
+        }
+
+        SECTION("Large host") {
+
+            fixture host("large");
+            std::string buffer;
+
+            std::vector<network::interface> interfaces(2);
+            interfaces[0].name = "ens0f0";
+            interfaces[1].name = "ens7f1";
+            network::retrieve_ifc_stats(interfaces);
+            REQUIRE( interfaces[0].total_transfer[0] > 0 );
+            REQUIRE( interfaces[1].total_transfer[1] > 0 );
+
+            auto nodes = numa::discover(buffer);
+            REQUIRE( nodes.size() == 2 );
+            REQUIRE( nodes[1].cpus.front() == 32 );
+            numa::retrieve(nodes, buffer);
+            REQUIRE( nodes[0].mem_free == 100000000 );
+            REQUIRE( nodes[1].counters[numa::numa_miss] == 2000000 );
+            REQUIRE( nodes[1].counters[numa::cpu_total] > 0 );
+
+            sensors::collector sensors;
+            sensors.discover();
+            REQUIRE( sensors.temperatures().size() == 40 );
+            REQUIRE( sensors.temperatures()[0].name != sensors.temperatures()[1].name ); // both acpitz
+            REQUIRE( sensors.fans().size() == 6 );
+            REQUIRE( sensors.cores().size() == 64 );
+        }
+
+        SECTION("Pathological host") {
+
+            fixture host("pathological");
+            std::string buffer;
+
+            std::string os_version, uptime;
+            system::retrieve_os_version(os_version);
+            system::retrieve_uptime(uptime);
+            REQUIRE( os_version.empty() );
+            REQUIRE( uptime == "0 minutes" );
+
+            // missing MemAvailable, a key without value and no trailing newline
+            memory::stats mem;
+            REQUIRE( !memory::retrieve(mem, buffer) ); // no vmstat
+            REQUIRE( mem.meminfo[memory::mem_total] == 2000000 );
+            REQUIRE( mem.meminfo[memory::mem_available] == 0 );
+            REQUIRE( mem.meminfo[memory::dirty] == 0 );
+            REQUIRE( mem.meminfo[memory::cached] == 1000 );
+
+            std::vector<network::interface> interfaces(2);
+            interfaces[0].name = "wg0";
+            interfaces[1].name = "missing0";
+            network::retrieve_ifc_stats(interfaces);
+            REQUIRE( interfaces[0].total_transfer[0] == 18446744073709551615ULL );
+            REQUIRE( interfaces[1].total_transfer[0] == 0 );
+
+            std::vector<io::drive> drives(1);
+            drives[0].name = "sdz"; // truncated stat
+            io::retrieve_dv_stats(drives);
+            REQUIRE( drives[0].total_io[0] == 2 );
+            REQUIRE( drives[0].total_io[1] == 0 );
+
+            pressure::stall psi;
+            pressure::retrieve_psi("io", psi); // kernel without PSI
+            REQUIRE( psi.some == 0 );
+
+            system::updates updates;
+            system::retrieve_updates(updates);
+            REQUIRE( updates.normal == 0 );
+            REQUIRE( !updates.restart );
+
+            auto nodes = numa::discover(buffer);
+            REQUIRE( nodes.size() == 1 );
+            REQUIRE( nodes[0].cpus.empty() );
+            numa::retrieve(nodes, buffer);
+            numa::update(nodes, rates::now());
+            REQUIRE( nodes[0].mem_total == 0 );
+
+            // unreadable zone, zone without type and chip without name
+            sensors::collector sensors;
+            sensors.discover();
+            REQUIRE( sensors.temperatures().size() == 3 );
+            REQUIRE( sensors.temperatures()[0].value == 0 );
+            REQUIRE( sensors.temperatures()[1].name == "zone1" );
+            REQUIRE( sensors.temperatures()[1].value == Approx(-5) );
+            REQUIRE( sensors.temperatures()[2].name == "hwmon0_temp1" );
+            REQUIRE( sensors.cores().empty() );
+        }
+
+    }
+
+}
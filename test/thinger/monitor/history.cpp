@@ -0,0 +1,127 @@
+#include "../../../src/thinger/monitor/history.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace thinger::monitor::history {
+
+    namespace {
+
+        struct collected {
+            std::vector<point> points;
+            void operator()(point const& p) { points.push_back(p); }
+        };
+
+        constexpr std::int64_t t0 = 1700000000000 - 1700000000000 % hour_ms; // an hour boundary
+
+    }
+
+    TEST_CASE("History rollups", "[history]") {
+
+        series s({60, 120, 48});
+
+        // two hours and a half of one sample per second, the value is the minute of the hour
+        for (std::int64_t i = 0; i < 9000; i++)
+            s.add(t0 + i * 1000, (double)(i / 60 % 60));
+        REQUIRE( s.samples() == 9000 );
+
+        SECTION("Raw samples") {
+            collected c;
+            auto resume = s.query(t0 + 8990 * 1000, t0 + 9000 * 1000, 0, 100, std::ref(c));
+            REQUIRE( !resume );
+            REQUIRE( c.points.size() == 10 );
+            REQUIRE( c.points[0].ts == t0 + 8990 * 1000 );
+            REQUIRE( c.points[0].count == 1 );
+            REQUIRE( c.points[0].avg == 29 );
+        }
+
+        SECTION("Minutes once the raw samples are gone") {
+            REQUIRE( s.resolution(t0 + 8000 * 1000) == minute_ms );
+            REQUIRE( s.resolution(t0 + 8990 * 1000) == 1 );
+
+            collected c;
+            s.query(t0 + 2 * hour_ms, t0 + 2 * hour_ms + 5 * minute_ms, 0, 100, std::ref(c));
+            REQUIRE( c.points.size() == 5 );
+            REQUIRE( c.points[3].ts == t0 + 2 * hour_ms + 3 * minute_ms );
+            REQUIRE( c.points[3].min == 3 );
+            REQUIRE( c.points[3].max == 3 );
+            REQUIRE( c.points[3].count == 60 );
+        }
+
+        SECTION("Hours, including the open one") {
+            collected c;
+            s.query(t0, t0 + 3 * hour_ms, hour_ms, 100, std::ref(c));
+            REQUIRE( c.points.size() == 3 );
+            REQUIRE( c.points[0].count == 3600 );
+            REQUIRE( c.points[0].min == 0 );
+            REQUIRE( c.points[0].max == 59 );
+            REQUIRE( c.points[0].avg == 29.5f );
+            REQUIRE( c.points[2].count == 1800 ); // the half hour still open
+            REQUIRE( c.points[2].max == 29 );
+        }
+
+        SECTION("Steps over the resolution aggregate its points") {
+            collected c;
+            s.query(t0 + 2 * hour_ms, t0 + 2 * hour_ms + 30 * minute_ms, 10 * minute_ms, 100, std::ref(c));
+            REQUIRE( c.points.size() == 3 );
+            REQUIRE( c.points[1].min == 10 );
+            REQUIRE( c.points[1].max == 19 );
+            REQUIRE( c.points[1].count == 600 );
+        }
+
+        SECTION("Queries resume after the limit") {
+            collected all, paged;
+            s.query(t0 + 2 * hour_ms, t0 + 3 * hour_ms, minute_ms, 1000, std::ref(all));
+
+            std::optional<std::int64_t> from = t0 + 2 * hour_ms;
+            int pages = 0;
+            while ( from ) {
+                from = s.query(*from, t0 + 3 * hour_ms, minute_ms, 7, std::ref(paged));
+                pages++;
+            }
+            REQUIRE( pages == 5 );
+            REQUIRE( paged.points.size() == all.points.size() );
+            REQUIRE( paged.points.size() == 30 );
+            REQUIRE( paged.points.back().ts == all.points.back().ts );
+        }
+
+        SECTION("Older samples are dropped") {
+            s.add(t0, 100);
+            REQUIRE( s.samples() == 9000 );
+        }
+
+    }
+
+    TEST_CASE("History store", "[history]") {
+
+        store h;
+        h.reset({"cpu_usage", "ram_usage"}, {});
+        h.add(t0, {10, 20});
+        h.add(t0 + 1000, {1, 2, 3});
+
+        REQUIRE( h.find("cpu_usage")->samples() == 1 );
+        REQUIRE( h.find("disk") == nullptr );
+
+        // series still present are kept
+        h.reset({"ram_usage", "st_/_usage"}, {});
+        REQUIRE( h.find("cpu_usage") == nullptr );
+        REQUIRE( h.find("ram_usage")->samples() == 1 );
+        h.add(t0 + 2000, {30, 40});
+        REQUIRE( h.find("ram_usage")->samples() == 2 );
+        REQUIRE( h.find("st_/_usage")->samples() == 1 );
+
+        // a single series, i.e., the one of the only collector sampled
+        h.add(1, t0 + 3000, 50);
+        h.add(2, t0 + 3000, 60);
+        REQUIRE( h.find("ram_usage")->samples() == 2 );
+        REQUIRE( h.find("st_/_usage")->samples() == 2 );
+
+        // a new retention starts over
+        h.reset({"ram_usage"}, {10, 10, 10});
+        REQUIRE( h.find("ram_usage")->samples() == 0 );
+
+        std::string out;
+        format(out, {t0, 1, 3, 2, 3});
+        REQUIRE( out == R"({"ts":)" + std::to_string(t0) + R"(,"min":1,"max":3,"avg":2,"count":3})" );
+    }
+
+}
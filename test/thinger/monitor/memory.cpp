@@ -0,0 +1,82 @@
+#include "../../../src/thinger/monitor/memory.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace thinger::monitor::memory {
+
+    TEST_CASE("Memory collector", "[memory]") {
+
+        SECTION("Perfect hash finds every key and rejects unknown ones") {
+
+            REQUIRE( meminfo_keys.find("MemTotal") == mem_total );
+            REQUIRE( meminfo_keys.find("AnonHugePages") == anon_hugepages );
+            REQUIRE( meminfo_keys.find("HugePages_Free") == hugepages_free );
+            REQUIRE( meminfo_keys.find("MemFree") == utils::perfect_hash<meminfo_fields>::npos );
+            REQUIRE( meminfo_keys.find("") == utils::perfect_hash<meminfo_fields>::npos );
+
+            REQUIRE( vmstat_keys.find("oom_kill") == oom_kill );
+            REQUIRE( vmstat_keys.find("pgfree") == utils::perfect_hash<vmstat_fields>::npos );
+        }
+
+        SECTION("Parse /proc/meminfo") {
+
+            stats s;
+            parse_meminfo(
+                "MemTotal:        6158152 kB\n"
+                "MemFree:          362428 kB\n"
+                "MemAvailable:    4215684 kB\n"
+                "Buffers:          104560 kB\n"
+                "Cached:          3583444 kB\n"
+                "SwapCached:            0 kB\n"
+                "SwapTotal:       2097148 kB\n"
+                "SwapFree:        2097148 kB\n"
+                "Dirty:               812 kB\n"
+                "Writeback:             0 kB\n"
+                "AnonHugePages:     45056 kB\n"
+                "Slab:             312416 kB\n"
+                "SReclaimable:     239780 kB\n"
+                "HugePages_Total:       4\n"
+                "HugePages_Free:        3\n"
+                "Hugepagesize:       2048 kB", s);
+
+            REQUIRE( s.meminfo[mem_total] == 6158152 );
+            REQUIRE( s.meminfo[mem_available] == 4215684 );
+            REQUIRE( s.meminfo[cached] == 3583444 );
+            REQUIRE( s.meminfo[dirty] == 812 );
+            REQUIRE( s.meminfo[sreclaimable] == 239780 );
+            REQUIRE( s.meminfo[anon_hugepages] == 45056 );
+            REQUIRE( s.meminfo[hugepages_total] == 4 );
+            REQUIRE( s.meminfo[hugepages_free] == 3 );
+            REQUIRE( s.meminfo[hugepagesize] == 2048 );
+        }
+
+        SECTION("Parse /proc/vmstat") {
+
+            stats s;
+            parse_vmstat(
+                "nr_free_pages 90607\n"
+                "pgfault 1183093841\n"
+                "pgmajfault 27514\n"
+                "pswpin 12\n"
+                "pswpout 34\n"
+                "oom_kill 1\n", s);
+
+            REQUIRE( s.vmstat[pgfault] == 1183093841 );
+            REQUIRE( s.vmstat[pgmajfault] == 27514 );
+            REQUIRE( s.vmstat[pswpin] == 12 );
+            REQUIRE( s.vmstat[pswpout] == 34 );
+            REQUIRE( s.vmstat[oom_kill] == 1 );
+        }
+
+        SECTION("Retrieve from procfs") {
+
+            stats s;
+            std::string buffer;
+            REQUIRE( retrieve(s, buffer) );
+            REQUIRE( s.meminfo[mem_total] > 0 );
+            REQUIRE( s.meminfo[mem_available] <= s.meminfo[mem_total] );
+        }
+
+    }
+
+}
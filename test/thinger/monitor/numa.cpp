@@ -0,0 +1,139 @@
+#include "../../../src/thinger/monitor/numa.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <fstream>
+
+namespace thinger::monitor::numa {
+
+    namespace {
+
+        // Fake root with a dual socket sysfs tree and /proc/stat
+        struct fake_root {
+
+            std::filesystem::path path = std::filesystem::temp_directory_path() / "thinger_numa_test";
+
+            fake_root() {
+                std::filesystem::remove_all(path);
+                node(0, "0-1", 16000000, 4000000, 1000, 10, 20);
+                node(1, "2-3", 16000000, 12000000, 2000, 30, 40);
+                write(path / "sys/devices/system/node/possible", "0-1\n");
+                stat(100, 100);
+                source::set_root(path.string());
+            }
+
+            ~fake_root() {
+                source::set_root("");
+                std::filesystem::remove_all(path);
+            }
+
+            void node(int id, std::string const& cpus, int total, int free, int hit, int miss, int foreign) const {
+                auto dir = path / ("sys/devices/system/node/node" + std::to_string(id));
+                std::filesystem::create_directories(dir);
+                write(dir / "cpulist", cpus + "\n");
+                write(dir / "meminfo",
+                    "Node " + std::to_string(id) + " MemTotal:       " + std::to_string(total) + " kB\n"
+                    "Node " + std::to_string(id) + " MemFree:        " + std::to_string(free) + " kB\n"
+                    "Node " + std::to_string(id) + " MemUsed:        " + std::to_string(total - free) + " kB\n");
+                write(dir / "numastat",
+                    "numa_hit " + std::to_string(hit) + "\n"
+                    "numa_miss " + std::to_string(miss) + "\n"
+                    "numa_foreign " + std::to_string(foreign) + "\n"
+                    "interleave_hit 0\n");
+            }
+
+            // node 0 cpus accumulate busy jiffies, node 1 cpus idle ones
+            void stat(int busy, int idle) const {
+                std::string content = "cpu  0 0 0 0 0 0 0 0 0 0\n";
+                for (int cpu = 0; cpu < 4; cpu++) {
+                    content += "cpu" + std::to_string(cpu) + " " + std::to_string(cpu < 2 ? busy : 0) + " 0 0 " +
+                               std::to_string(cpu < 2 ? 0 : idle) + " 0 0 0 0 0 0\n";
+                }
+                content += "intr 12345\n";
+                std::filesystem::create_directories(path / "proc");
+                write(path / "proc/stat", content);
+            }
+
+            static void write(std::filesystem::path const& file, std::string const& content) {
+                std::ofstream(file) << content;
+            }
+
+        };
+
+    }
+
+    TEST_CASE("NUMA collector", "[numa]") {
+
+        SECTION("Parse cpu lists") {
+            REQUIRE( parse_cpulist("0-3,8-11\n") == std::vector<unsigned int>{0, 1, 2, 3, 8, 9, 10, 11} );
+            REQUIRE( parse_cpulist("5") == std::vector<unsigned int>{5} );
+            REQUIRE( parse_cpulist("\n").empty() );
+        }
+
+        SECTION("Collect from a fake sysfs tree") {
+
+            fake_root root;
+            std::string buffer;
+
+            auto nodes = discover(buffer);
+            REQUIRE( nodes.size() == 2 );
+            REQUIRE( nodes[0].id == 0 );
+            REQUIRE( nodes[1].cpus == std::vector<unsigned int>{2, 3} );
+
+            auto seconds = [](int n) { return rates::stamp{std::chrono::seconds(n), std::chrono::seconds(n)}; };
+
+            retrieve(nodes, buffer);
+            update(nodes, seconds(0));
+
+            REQUIRE( nodes[0].mem_total == 16000000 );
+            REQUIRE( nodes[0].mem_free == 4000000 );
+            REQUIRE( nodes[1].mem_free == 12000000 );
+
+            // one second later node 0 has been busy and it has missed 50 pages
+            root.node(0, "0-1", 16000000, 4000000, 1100, 60, 20);
+            root.node(1, "2-3", 16000000, 12000000, 2100, 30, 140);
+            root.stat(200, 200);
+
+            retrieve(nodes, buffer);
+            update(nodes, seconds(1));
+
+            REQUIRE( nodes[0].cpu_usage == 100 );
+            REQUIRE( nodes[1].cpu_usage == 0 );
+            REQUIRE( nodes[0].miss_rate == 50 );
+            REQUIRE( nodes[0].foreign_rate == 0 );
+            REQUIRE( nodes[1].miss_rate == 0 );
+            REQUIRE( nodes[1].foreign_rate == 100 );
+
+            // counters reset by a hotplug take a new baseline and keep their last rate
+            root.node(0, "0-1", 16000000, 4000000, 1200, 5, 20);
+            root.stat(300, 300);
+            retrieve(nodes, buffer);
+            update(nodes, seconds(2));
+            REQUIRE( nodes[0].miss_rate == 50 );
+            REQUIRE( nodes[0].counter_rates.resets() == 1 );
+            REQUIRE( nodes[0].cpu_usage == 100 );
+
+            // a suspend is a gap in the readings, not a burst of misses
+            root.node(0, "0-1", 16000000, 4000000, 1300, 1005, 20);
+            root.stat(400, 400);
+            retrieve(nodes, buffer);
+            update(nodes, {std::chrono::seconds(3), std::chrono::seconds(120)});
+            REQUIRE( nodes[0].miss_rate == 50 );
+            REQUIRE( nodes[0].counter_rates.gaps() == 1 );
+
+            root.node(0, "0-1", 16000000, 4000000, 1400, 1025, 20);
+            retrieve(nodes, buffer);
+            update(nodes, {std::chrono::seconds(4), std::chrono::seconds(121)});
+            REQUIRE( nodes[0].miss_rate == 20 );
+        }
+
+        SECTION("Non NUMA kernels have no nodes") {
+            std::string buffer;
+            source::set_root("/nonexistent");
+            REQUIRE( discover(buffer).empty() );
+            source::set_root("");
+        }
+
+    }
+
+}
@@ -0,0 +1,240 @@
+#include <thinger/thinger.h>
+#include <httplib.h>
+
+#include "../../../src/thinger/client.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <filesystem>
+
+namespace thinger::monitor::probes {
+
+    // Local HTTP server standing in for ifconfig.me and the platform console that may answer slowly
+    struct stand_in {
+
+        httplib::Server svr;
+        std::atomic<bool> slow = true;
+        std::chrono::milliseconds stall{std::chrono::seconds(2)}; // set before the first request
+        std::atomic<bool> upgraded = false;
+        std::thread thread;
+        int port;
+
+        stand_in() {
+            svr.Get("/ip", [this](const httplib::Request&, httplib::Response& res) {
+                if (slow)
+                    std::this_thread::sleep_for(stall);
+                res.set_content("203.0.113.1", "text/plain");
+            });
+            svr.Get("/v1/server/version", [this](const httplib::Request&, httplib::Response& res) {
+                if (slow)
+                    std::this_thread::sleep_for(stall);
+                res.set_content(nlohmann::json({{"version", upgraded ? "1.3.0" : "1.2.3"}}).dump(), "application/json");
+            });
+            port = svr.bind_to_any_port("127.0.0.1");
+            thread = std::thread([this] { svr.listen_after_bind(); });
+            while ( !svr.is_running() )
+                std::this_thread::sleep_for(std::chrono::milliseconds{10});
+        }
+
+        ~stand_in() {
+            svr.stop();
+            thread.join();
+        }
+    };
+
+    TEST_CASE("Slow probes", "[probes]") {
+
+        using namespace std::chrono_literals;
+
+        stand_in server;
+
+        executor executor;
+        auto probe = executor.add<std::string>([&server](std::chrono::milliseconds timeout) -> std::optional<std::string> {
+            httplib::Client cli("127.0.0.1", server.port);
+            cli.set_connection_timeout(timeout);
+            cli.set_read_timeout(timeout);
+            auto res = cli.Get("/ip");
+            if ( !res || res->status != 200 )
+                return std::nullopt;
+            return res->body;
+        }, {1h, 200ms, 100ms, 1s});
+
+        // readers never wait on the request in flight
+        auto start = clock::now();
+        auto r = probe->last();
+        REQUIRE( clock::now() - start < 50ms );
+        REQUIRE( !r.valid );
+
+        // the request times out and is retried with backoff
+        std::this_thread::sleep_for(500ms);
+        REQUIRE( probe->last().failures >= 1 );
+        REQUIRE( !probe->last().valid );
+
+        server.slow = false;
+        for (int i = 0; i < 50 && !probe->last().valid; i++)
+            std::this_thread::sleep_for(100ms);
+
+        r = probe->last();
+        REQUIRE( r.valid );
+        REQUIRE( r.value == "203.0.113.1" );
+        REQUIRE( r.failures == 0 );
+        REQUIRE( r.age < 5s );
+
+        // the cached value survives later failures
+        server.slow = true;
+        executor.trigger();
+        std::this_thread::sleep_for(500ms);
+        r = probe->last();
+        REQUIRE( r.valid );
+        REQUIRE( r.value == "203.0.113.1" );
+        REQUIRE( r.failures >= 1 );
+    }
+
+    TEST_CASE("Seeded probes", "[probes]") {
+
+        using namespace std::chrono_literals;
+
+        std::atomic<int> runs = 0;
+        auto fn = [&runs](std::chrono::milliseconds) -> std::optional<std::string> {
+            runs++;
+            return "198.51.100.7";
+        };
+
+        executor executor;
+
+        // a fresh seed is served until it is as old as the interval
+        result<std::string> fresh{"203.0.113.1", true, 10s};
+        auto seeded = executor.add<std::string>(fn, {1h, 1s, 1s, 1s}, fresh);
+        auto r = seeded->last();
+        REQUIRE( r.valid );
+        REQUIRE( r.value == "203.0.113.1" );
+        REQUIRE( r.age >= 10s );
+        std::this_thread::sleep_for(200ms);
+        REQUIRE( runs == 0 );
+
+        // a stale one is served while the probe runs right away
+        result<std::string> stale{"203.0.113.2", true, 2h};
+        auto refreshed = executor.add<std::string>(fn, {1h, 1s, 1s, 1s}, stale);
+        for (int i = 0; i < 50 && runs == 0; i++)
+            std::this_thread::sleep_for(10ms);
+        REQUIRE( runs == 1 );
+        REQUIRE( refreshed->last().value == "198.51.100.7" );
+
+        // triggering runs a seeded probe too
+        executor.trigger();
+        for (int i = 0; i < 50 && seeded->last().value != "198.51.100.7"; i++)
+            std::this_thread::sleep_for(10ms);
+        REQUIRE( seeded->last().value == "198.51.100.7" );
+    }
+
+    TEST_CASE("Probe requests", "[probes]") {
+
+        using namespace std::chrono_literals;
+
+        stand_in server;
+        server.stall = 1s;
+        auto host = fmt::format("http://127.0.0.1:{}", server.port);
+
+        SECTION("Answer with the value of the server") {
+            server.slow = false;
+            REQUIRE( network::getPublicIPAddress(1s, host) == "203.0.113.1" );
+            REQUIRE( platform::getConsoleVersion(1s, host) == "1.2.3" );
+        }
+
+        SECTION("Give up on a stalled server after the timeout") {
+            auto start = clock::now();
+            REQUIRE( !network::getPublicIPAddress(200ms, host) );
+            REQUIRE( clock::now() - start < 800ms );
+
+            start = clock::now();
+            REQUIRE( !platform::getConsoleVersion(200ms, host) );
+            REQUIRE( clock::now() - start < 800ms );
+        }
+    }
+
+    TEST_CASE("Probes of the client", "[probes]") {
+
+        using namespace std::chrono_literals;
+
+        // past the 2s timeout of the console probe, within the 10s one of the public address
+        stand_in server;
+        server.stall = 5s;
+        server.slow = false;
+        auto host = fmt::format("http://127.0.0.1:{}", server.port);
+
+        // a replaying client starts no probes by itself, they are started against the stand in
+        auto capture = (std::filesystem::temp_directory_path() / "thinger_monitor_probes.cap").string();
+        {
+            capture::recorder recorder(capture);
+            capture::snapshot("../test/fixtures/small", recorder);
+        }
+        REQUIRE( source::replay(capture) );
+
+        auto config_path = (std::filesystem::temp_directory_path() / "thinger_monitor_probes.json").string();
+        {
+            Config config(config_path);
+            config.update("backups", {{"system", "platform"}, {"storage", "first"}});
+            thinger::iotmp::client iotmp_client("");
+            Client client(iotmp_client, config);
+            client.reload_configuration("backups");
+            client.start_probes({host, host});
+
+            // what the monitor resource publishes
+            auto published = [&client] {
+                nlohmann::json out;
+                client.publish(out);
+                return out;
+            };
+
+            // a change of the backups runs the probes right away
+            auto trigger = [&client, &config](std::string const& storage) {
+                config.update("backups", {{"system", "platform"}, {"storage", storage}});
+                client.reload_configuration("backups");
+            };
+
+            for (int i = 0; i < 50 && (published()["nw_public_ip_age"] == -1 || published()["console_version_age"] == -1); i++)
+                std::this_thread::sleep_for(100ms);
+
+            auto out = published();
+            REQUIRE( out["nw_public_ip"] == "203.0.113.1" );
+            REQUIRE( out["nw_public_ip_age"] >= 0 );
+            REQUIRE( out["console_version"] == "1.2.3" );
+            REQUIRE( out["console_version_age"] >= 0 );
+
+            // the resource does not wait on the stalled requests, it publishes the cached values
+            server.slow = true;
+            trigger("second");
+            std::this_thread::sleep_for(200ms);
+
+            auto start = clock::now();
+            out = published();
+            REQUIRE( clock::now() - start < 50ms );
+            REQUIRE( out["nw_public_ip"] == "203.0.113.1" );
+            REQUIRE( out["console_version"] == "1.2.3" );
+
+            // the console probe gives up after its timeout and keeps its last good value
+            std::this_thread::sleep_for(2500ms);
+            out = published();
+            REQUIRE( out["console_version"] == "1.2.3" );
+            REQUIRE( out["console_version_age"] >= 2 );
+
+            // so it runs again before the stalled request would have been answered, while the
+            // public address is still in flight
+            server.slow = false;
+            server.upgraded = true;
+            trigger("third");
+            for (int i = 0; i < 15 && published()["console_version"] != "1.3.0"; i++)
+                std::this_thread::sleep_for(100ms);
+
+            out = published();
+            REQUIRE( out["console_version"] == "1.3.0" );
+            REQUIRE( out["nw_public_ip"] == "203.0.113.1" );
+            REQUIRE( out["nw_public_ip_age"] >= 2 );
+        }
+
+        source::reset();
+        std::filesystem::remove(capture);
+        std::filesystem::remove(config_path);
+    }
+
+}
@@ -0,0 +1,62 @@
+#include "../../../src/thinger/monitor/push.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace thinger::monitor::push {
+
+    TEST_CASE("Push schedule", "[push]") {
+
+        using namespace std::chrono_literals;
+
+        auto t0 = clock::time_point(std::chrono::duration_cast<clock::duration>(1700000010000ms)); // a 15 s boundary
+
+        SECTION("Pushes land on wall clock boundaries") {
+            REQUIRE( align(t0, 15s) == t0 + 15s );
+            REQUIRE( align(t0 + 1ms, 15s) == t0 + 15s );
+            REQUIRE( align(t0 + 14999ms, 15s) == t0 + 15s );
+            REQUIRE( align(t0 + 7s, 60s) == t0 + 30s ); // 1700000040000 is a minute
+        }
+
+        schedule s;
+        REQUIRE( !s.enabled() );
+        REQUIRE( !s.due(t0) );
+
+        s.set_policy({15s, "monitor_push", 60s}, t0 + 3s);
+        REQUIRE( s.enabled() );
+        REQUIRE( s.next() == t0 + 15s );
+        REQUIRE( !s.due(t0 + 14s) );
+        REQUIRE( s.due(t0 + 15s) );
+
+        SECTION("Delivered pushes go to the next boundary") {
+            s.feed(t0 + 15s, true, 20ms);
+            REQUIRE( s.next() == t0 + 30s );
+            REQUIRE( !s.paused() );
+        }
+
+        SECTION("Failures back off doubling up to the maximum") {
+            s.feed(t0 + 15s, false, 0ms);
+            REQUIRE( s.paused() );
+            REQUIRE( s.next() == t0 + 45s );
+            s.feed(t0 + 45s, false, 0ms);
+            REQUIRE( s.next() == t0 + 90s );
+            s.feed(t0 + 90s, false, 0ms);
+            REQUIRE( s.next() == t0 + 165s );
+            s.feed(t0 + 165s, false, 0ms);
+            REQUIRE( s.next() == t0 + 240s );
+            REQUIRE( s.failures() == 4 );
+
+            s.feed(t0 + 240s, true, 20ms);
+            REQUIRE( !s.paused() );
+            REQUIRE( s.failures() == 0 );
+            REQUIRE( s.next() == t0 + 255s );
+        }
+
+        SECTION("A congested push skips a boundary") {
+            s.feed(t0 + 15s, true, 9s);
+            REQUIRE( s.paused() );
+            REQUIRE( s.next() == t0 + 45s );
+        }
+
+    }
+
+}
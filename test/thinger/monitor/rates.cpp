@@ -0,0 +1,69 @@
+#include "../../../src/thinger/monitor/rates.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace thinger::monitor::rates {
+
+    TEST_CASE("Counter deltas", "[rates]") {
+
+        REQUIRE( delta(100, 250) == 150ULL );
+        REQUIRE( delta(7, 7) == 0ULL );
+
+        // 32 and 64 bits wraps
+        REQUIRE( delta(4294967000ULL, 100) == 396ULL );
+        REQUIRE( delta(18446744073709551615ULL, 9) == 10ULL );
+
+        // resets
+        REQUIRE( !delta(5000000, 100) );
+        REQUIRE( !delta(1ULL << 40, 100) );
+    }
+
+    TEST_CASE("Counter rates", "[rates]") {
+
+        using namespace std::chrono_literals;
+
+        auto at = [](std::chrono::nanoseconds monotonic, std::chrono::nanoseconds suspended = 0s) {
+            return stamp{monotonic, monotonic + suspended};
+        };
+
+        counters<2> c;
+        c.update(at(10s), {1000, 0});
+        REQUIRE( c.primed() );
+        REQUIRE( c.rate(0) == 0 );
+
+        c.update(at(12s), {3000, 500});
+        REQUIRE( c.rate(0) == 1000 );
+        REQUIRE( c.rate(1) == 250 );
+
+        SECTION("Readings without elapsed time are ignored") {
+            c.update(at(12s), {9000, 9000});
+            REQUIRE( c.rate(0) == 1000 );
+            c.update(at(13s), {4000, 500});
+            REQUIRE( c.rate(0) == 1000 );
+            REQUIRE( c.rate(1) == 0 );
+        }
+
+        SECTION("A reset counter keeps its rate and takes a new baseline") {
+            c.update(at(13s), {10, 750});
+            REQUIRE( c.resets() == 1 );
+            REQUIRE( c.rate(0) == 1000 );
+            REQUIRE( c.rate(1) == 250 );
+
+            c.update(at(14s), {510, 750});
+            REQUIRE( c.rate(0) == 500 );
+            REQUIRE( c.rate(1) == 0 );
+        }
+
+        SECTION("A suspend is a gap in the readings") {
+            c.update(at(13s, 3600s), {900000, 900000});
+            REQUIRE( c.gaps() == 1 );
+            REQUIRE( c.rate(0) == 1000 );
+
+            c.update(at(14s, 3600s), {902000, 900000});
+            REQUIRE( c.rate(0) == 2000 );
+            REQUIRE( c.rate(1) == 0 );
+        }
+
+    }
+
+}
@@ -0,0 +1,71 @@
+#include "../../../src/thinger/monitor/sampling.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace thinger::monitor::sampling {
+
+    TEST_CASE("Adaptive sampling", "[sampling]") {
+
+        using namespace std::chrono_literals;
+
+        policy p{1s, 16s, 4, 2};
+        adaptive schedule(p);
+
+        auto now = clock::time_point{} + 1h;
+
+        REQUIRE( schedule.due(now) );
+
+        SECTION("Flat signal slows down up to the ceiling") {
+
+            for (int i = 0; i < 10; i++) {
+                schedule.feed(50, now);
+                now += schedule.interval();
+            }
+
+            REQUIRE( schedule.interval() == 16s );
+            REQUIRE( !schedule.due(now - 1s) );
+            REQUIRE( schedule.due(now) );
+        }
+
+        SECTION("Rate of change drops to the floor") {
+
+            for (int i = 0; i < 10; i++) {
+                schedule.feed(50, now);
+                now += schedule.interval();
+            }
+
+            schedule.feed(90, now); // +40 in 16 seconds
+            REQUIRE( schedule.interval() == 1s );
+        }
+
+        SECTION("Contention drops to the floor") {
+
+            for (int i = 0; i < 10; i++) {
+                schedule.feed(50, now);
+                now += schedule.interval();
+            }
+
+            schedule.feed(50, now, true);
+            REQUIRE( schedule.interval() == 1s );
+        }
+
+        SECTION("Memory pressure stretches the next sample") {
+
+            schedule.feed(50, now, false, 4);
+            REQUIRE( schedule.next() == now + 4s );
+        }
+
+        SECTION("Policy update clamps the interval") {
+
+            for (int i = 0; i < 10; i++) {
+                schedule.feed(50, now);
+                now += schedule.interval();
+            }
+
+            schedule.set_policy({1s, 4s, 4, 2});
+            REQUIRE( schedule.interval() == 4s );
+        }
+
+    }
+
+}
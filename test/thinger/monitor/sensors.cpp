@@ -0,0 +1,114 @@
+#include "../../../src/thinger/monitor/sensors.h"
+
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/catch_approx.hpp>
+
+#include <fstream>
+
+namespace thinger::monitor::sensors {
+
+    namespace {
+
+        // Fake root with a thermal zone, a hwmon chip and two cores
+        struct fake_root {
+
+            std::filesystem::path path = std::filesystem::temp_directory_path() / "thinger_sensors_test";
+
+            fake_root() {
+                std::filesystem::remove_all(path);
+                write("sys/class/thermal/thermal_zone0/type", "x86_pkg_temp\n");
+                write("sys/class/thermal/thermal_zone0/temp", "52000\n");
+                write("sys/class/thermal/cooling_device0/type", "Processor\n");
+                write("sys/class/hwmon/hwmon0/name", "coretemp\n");
+                write("sys/class/hwmon/hwmon0/temp1_input", "48000\n");
+                write("sys/class/hwmon/hwmon0/temp1_label", "Core 0\n");
+                write("sys/class/hwmon/hwmon0/temp1_max", "100000\n");
+                write("sys/class/hwmon/hwmon1/name", "nct6775\n");
+                write("sys/class/hwmon/hwmon1/fan1_input", "1200\n");
+                for (int cpu = 0; cpu < 2; cpu++) {
+                    auto dir = "sys/devices/system/cpu/cpu" + std::to_string(cpu);
+                    write(dir + "/cpufreq/scaling_cur_freq", "2400000\n");
+                    write(dir + "/cpufreq/cpuinfo_max_freq", "3600000\n");
+                    write(dir + "/thermal_throttle/core_throttle_total_time_ms", "1000\n");
+                }
+                write("sys/devices/system/cpu/online", "0-1\n");
+                source::set_root(path.string());
+            }
+
+            ~fake_root() {
+                source::set_root("");
+                std::filesystem::remove_all(path);
+            }
+
+            void write(std::string const& file, std::string const& content) const {
+                std::filesystem::create_directories((path / file).parent_path());
+                std::ofstream(path / file, std::ios::trunc) << content;
+            }
+
+        };
+
+    }
+
+    TEST_CASE("Sensors collector", "[sensors]") {
+
+        using Catch::Approx;
+
+        fake_root root;
+        collector sensors;
+        sensors.discover({});
+
+        auto seconds = [](int n) { return rates::stamp{std::chrono::seconds(n), std::chrono::seconds(n)}; };
+
+        SECTION("Discover once and read through the open handles") {
+
+            REQUIRE( sensors.temperatures().size() == 2 );
+            REQUIRE( sensors.temperatures()[0].name == "x86_pkg_temp" );
+            REQUIRE( sensors.temperatures()[0].value == Approx(52) );
+            REQUIRE( sensors.temperatures()[1].name == "coretemp_core_0" );
+
+            REQUIRE( sensors.fans().size() == 1 );
+            REQUIRE( sensors.fans()[0].name == "nct6775_fan1" );
+            REQUIRE( sensors.fans()[0].value == 1200 );
+
+            REQUIRE( sensors.cores().size() == 2 );
+            REQUIRE( sensors.cores()[1].current == 2400 );
+            REQUIRE( sensors.cores()[1].max == 3600 );
+
+            // values are read again from the same open handles
+            root.write("sys/class/thermal/thermal_zone0/temp", "87500\n");
+            sensors.read(seconds(1));
+            REQUIRE( sensors.max_temperature() == Approx(87.5) );
+        }
+
+        SECTION("Throttled fraction") {
+
+            REQUIRE( sensors.throttled() == 0 );
+
+            // 500 ms throttled on each core over 2 seconds
+            for (int cpu = 0; cpu < 2; cpu++)
+                root.write("sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/thermal_throttle/core_throttle_total_time_ms", "1500\n");
+            sensors.read(seconds(2));
+            REQUIRE( sensors.throttled() == Approx(0.25) );
+
+            // a counter reset by a driver reload takes a new baseline and keeps the last fraction
+            for (int cpu = 0; cpu < 2; cpu++)
+                root.write("sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/thermal_throttle/core_throttle_total_time_ms", "100\n");
+            sensors.read(seconds(3));
+            REQUIRE( sensors.throttled() == Approx(0.25) );
+            REQUIRE( sensors.cores()[0].throttle_rates.resets() == 1 );
+
+            // nor does a suspend, where boot time advances without monotonic time
+            for (int cpu = 0; cpu < 2; cpu++)
+                root.write("sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/thermal_throttle/core_throttle_total_time_ms", "5100\n");
+            sensors.read({std::chrono::seconds(4), std::chrono::seconds(60)});
+            REQUIRE( sensors.throttled() == Approx(0.25) );
+
+            root.write("sys/devices/system/cpu/cpu0/thermal_throttle/core_throttle_total_time_ms", "5600\n");
+            root.write("sys/devices/system/cpu/cpu1/thermal_throttle/core_throttle_total_time_ms", "5100\n");
+            sensors.read({std::chrono::seconds(5), std::chrono::seconds(61)});
+            REQUIRE( sensors.throttled() == Approx(0.25) );
+        }
+
+    }
+
+}
@@ -0,0 +1,115 @@
+#include "../../../src/thinger/monitor/state.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace thinger::monitor::state {
+
+    TEST_CASE("Warm start state", "[state]") {
+
+        using namespace std::chrono_literals;
+
+        auto path = std::filesystem::temp_directory_path() / "thinger_monitor_state_test" / "state.json";
+        std::filesystem::remove_all(path.parent_path());
+
+        auto saved = [](std::chrono::system_clock::duration ago) {
+            return std::chrono::duration_cast<std::chrono::milliseconds>((std::chrono::system_clock::now() - ago).time_since_epoch()).count();
+        };
+
+        auto overwrite = [&path](nlohmann::json const& j) {
+            std::ofstream(path, std::ios::trunc) << j.dump();
+        };
+
+        rates::counters<2> io;
+        io.update({10s, 10s}, {1000, 2000});
+
+        probes::result<std::string> ip{"203.0.113.1", true, 30s};
+
+        REQUIRE( !read(path) );
+        REQUIRE( write(path, {{"counters", {{"dv", {{"sda", dump(io)}}}}}, {"probes", {{"public_ip", dump(ip)}}}}) );
+
+        SECTION("Round trip") {
+            auto state = read(path);
+            REQUIRE( state );
+
+            auto r = load((*state)["probes"]["public_ip"]);
+            REQUIRE( r );
+            REQUIRE( r->value == "203.0.113.1" );
+            REQUIRE( r->age >= 30s );
+
+            if ( !boot_id().empty() ) {
+                rates::counters<2> restored;
+                REQUIRE( load((*state)["counters"]["dv"]["sda"], restored) );
+                REQUIRE( restored.primed() );
+                REQUIRE( restored.values()[1] == 2000 );
+                restored.update({12s, 12s}, {3000, 2000});
+                REQUIRE( restored.rate(0) == 1000 );
+            }
+        }
+
+        SECTION("Counters are only restored within the same boot and shortly after") {
+            auto state = *read(path);
+
+            state["boot_id"] = "another boot";
+            overwrite(state);
+            REQUIRE( !read(path)->contains("counters") );
+
+            state["boot_id"] = boot_id();
+            state["saved"] = saved(max_gap + 1min);
+            overwrite(state);
+            state = *read(path);
+            REQUIRE( !state.contains("counters") );
+            REQUIRE( load(state["probes"]["public_ip"])->age >= max_gap + 1min + 30s );
+        }
+
+        SECTION("Old, future or malformed states are ignored") {
+            auto state = *read(path);
+
+            state["saved"] = saved(max_age + 1h);
+            overwrite(state);
+            REQUIRE( !read(path) );
+
+            state["saved"] = saved(-1h);
+            overwrite(state);
+            REQUIRE( !read(path) );
+
+            std::ofstream(path, std::ios::trunc) << "{\"counters\":";
+            REQUIRE( !read(path) );
+
+            rates::counters<3> other;
+            REQUIRE( !load(nlohmann::json{{"values", {1, 2}}}, other) );
+            REQUIRE( !load(nlohmann::json{{"value", 5}}) );
+        }
+
+        SECTION("Members of the wrong type do not throw") {
+            auto state = *read(path);
+
+            state["saved"] = "yesterday";
+            overwrite(state);
+            REQUIRE_NOTHROW( read(path) );
+            REQUIRE( !read(path) );
+
+            state["saved"] = saved(1min);
+            state["boot_id"] = 42;
+            state["probes"]["public_ip"]["age"] = "30";
+            overwrite(state);
+            REQUIRE_NOTHROW( read(path) );
+            state = *read(path);
+            REQUIRE( !state.contains("counters") );
+            REQUIRE( load(state["probes"]["public_ip"])->age >= 1min );
+
+            rates::counters<2> restored;
+            REQUIRE( load(nlohmann::json{{"monotonic", "10"}, {"values", {1u, 2u}}}, restored) );
+            REQUIRE( restored.at().monotonic.count() == 0 );
+        }
+
+        SECTION("Written through a synced temporary file") {
+            auto tmp = path;
+            tmp += ".tmp";
+            REQUIRE( !std::filesystem::exists(tmp) );
+            REQUIRE( nlohmann::json::parse(std::ifstream(path)).contains("saved") );
+        }
+
+        std::filesystem::remove_all(path.parent_path());
+    }
+
+}
@@ -0,0 +1,55 @@
+#include "../../../src/thinger/utils/docker/stream.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+
+namespace Docker::Stream {
+
+    std::string frame(type stream, std::string const& payload) {
+        auto size = (std::uint32_t)payload.size();
+        std::string f = {(char)stream, 0, 0, 0, (char)(size >> 24), (char)(size >> 16), (char)(size >> 8), (char)size};
+        return f + payload;
+    }
+
+    TEST_CASE("Docker stream demuxer", "[docker]") {
+
+        std::string out, err;
+        demuxer d([&out, &err](type stream, const char* data, std::size_t length) {
+            (stream == stdout_stream ? out : err).append(data, length);
+            return true;
+        });
+
+        auto payload = std::string(300, 'x') + "end";
+        auto stream = frame(stdout_stream, "dump") + frame(stderr_stream, "writing") + frame(stdout_stream, "") + frame(stdout_stream, payload);
+
+        SECTION("Whole stream") {
+            REQUIRE( d.feed(stream.data(), stream.size()) );
+            REQUIRE( d.complete() );
+            REQUIRE( out == "dump" + payload );
+            REQUIRE( err == "writing" );
+        }
+
+        SECTION("Byte by byte") {
+            for (std::size_t i = 0; i < stream.size(); i++) {
+                REQUIRE( d.feed(stream.data() + i, 1) );
+                if ( i == 3 ) REQUIRE( !d.complete() );
+            }
+            REQUIRE( d.complete() );
+            REQUIRE( out == "dump" + payload );
+            REQUIRE( err == "writing" );
+        }
+
+        SECTION("Truncated stream") {
+            REQUIRE( d.feed(stream.data(), stream.size() - 1) );
+            REQUIRE( !d.complete() );
+        }
+
+        SECTION("A refused payload stops the stream") {
+            demuxer refusing([](type, const char*, std::size_t) { return false; });
+            REQUIRE( !refusing.feed(stream.data(), stream.size()) );
+        }
+
+    }
+
+}
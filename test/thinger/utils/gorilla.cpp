@@ -0,0 +1,76 @@
+#include "../../../src/thinger/utils/gorilla.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace utils::gorilla {
+
+    TEST_CASE("Gorilla timestamps", "[gorilla]") {
+
+        std::vector<std::int64_t> timestamps = {
+            1700000000000, 1700000001000, 1700000002000, 1700000003000, // regular
+            1700000003999, 1700000005100, 1700000009000, 1700000009000, // jitter, gaps and repeats
+            1699999000000, 1800000000000, 0, -1,                        // far jumps
+        };
+
+        timestamp_encoder encoder;
+        for (auto ts : timestamps)
+            encoder.append(ts);
+        REQUIRE( encoder.size() == timestamps.size() );
+
+        timestamp_decoder decoder(encoder.bytes());
+        std::int64_t ts;
+        for (auto expected : timestamps) {
+            REQUIRE( decoder.next(ts) );
+            REQUIRE( ts == expected );
+        }
+
+        SECTION("Regular intervals cost a bit per timestamp") {
+            timestamp_encoder regular;
+            for (int i = 0; i < 800; i++)
+                regular.append(1700000000000 + i * 1000);
+            // 64 bits of the first, the first delta, then a bit each
+            REQUIRE( regular.bytes().size() <= 8 + 9 + 100 );
+        }
+
+    }
+
+    TEST_CASE("Gorilla values", "[gorilla]") {
+
+        std::vector<double> values = {
+            12.5, 12.5, 12.5, 12.75, 13, 0, -0.0, 100, 99.99, 1e-300, 1e300,
+            std::numeric_limits<double>::infinity(), 42, 42, 7.123456789,
+        };
+
+        value_encoder encoder;
+        for (auto v : values)
+            encoder.append(v);
+
+        value_decoder decoder(encoder.bytes());
+        double v;
+        for (auto expected : values) {
+            REQUIRE( decoder.next(v) );
+            REQUIRE( std::bit_cast<std::uint64_t>(v) == std::bit_cast<std::uint64_t>(expected) );
+        }
+
+        SECTION("NaN round trips with its bits") {
+            value_encoder nan;
+            nan.append(1);
+            nan.append(std::numeric_limits<double>::quiet_NaN());
+            value_decoder d(nan.bytes());
+            REQUIRE( d.next(v) );
+            REQUIRE( d.next(v) );
+            REQUIRE( std::isnan(v) );
+        }
+
+        SECTION("Truncated input stops decoding") {
+            value_decoder d(std::string_view(encoder.bytes()).substr(0, 4));
+            REQUIRE( !d.next(v) );
+        }
+
+    }
+
+}
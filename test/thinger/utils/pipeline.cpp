@@ -0,0 +1,87 @@
+#include "../../../src/thinger/utils/pipeline.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+namespace utils {
+
+    TEST_CASE("Part pipeline", "[pipeline]") {
+
+        std::string data;
+        for (int i = 0; i < 1000; i++)
+            data += std::to_string(i) + ",";
+
+        SECTION("Parts are consumed in order as they fill up") {
+            std::vector<unsigned int> numbers;
+            std::string joined;
+            part_pipeline pipeline(100, 2, [&](unsigned int part, std::string const& content) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                numbers.push_back(part);
+                joined += content;
+                return true;
+            });
+
+            for (std::size_t i = 0; i < data.size(); i += 33)
+                REQUIRE( pipeline.write(data.data() + i, std::min<std::size_t>(33, data.size() - i)) );
+            REQUIRE( pipeline.close() );
+
+            REQUIRE( pipeline.size() == data.size() );
+            REQUIRE( pipeline.count() == (data.size() + 99) / 100 );
+            REQUIRE( joined == data );
+            for (std::size_t i = 0; i < numbers.size(); i++)
+                REQUIRE( numbers[i] == i + 1 );
+        }
+
+        SECTION("Several workers consume parts at once") {
+            std::mutex mutex;
+            std::vector<std::string> parts(10);
+            std::atomic<int> running = 0;
+            std::atomic<int> max_running = 0;
+            part_pipeline pipeline(400, 5, [&](unsigned int part, std::string const& content) {
+                max_running = std::max(max_running.load(), ++running);
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                running--;
+                std::scoped_lock lock(mutex);
+                parts.at(part - 1) = content;
+                return true;
+            }, 4);
+
+            REQUIRE( pipeline.write(data.data(), data.size()) );
+            REQUIRE( pipeline.close() );
+
+            std::string joined;
+            for (auto const& part : parts) joined += part;
+            REQUIRE( pipeline.count() == parts.size() );
+            REQUIRE( joined == data );
+            REQUIRE( max_running > 1 );
+            REQUIRE( max_running <= 4 );
+        }
+
+        SECTION("An empty stream is a single empty part") {
+            std::vector<std::size_t> sizes;
+            part_pipeline pipeline(100, 2, [&](unsigned int, std::string const& content) {
+                sizes.push_back(content.size());
+                return true;
+            });
+            REQUIRE( pipeline.close() );
+            REQUIRE( sizes == std::vector<std::size_t>{0} );
+        }
+
+        SECTION("A failed part stops the writer") {
+            part_pipeline pipeline(100, 2, [](unsigned int part, std::string const&) { return part < 3; });
+
+            bool written = true;
+            for (std::size_t i = 0; i < data.size() && written; i += 50)
+                written = pipeline.write(data.data() + i, 50);
+            REQUIRE( !written );
+            REQUIRE( !pipeline.close() );
+            REQUIRE( pipeline.count() < 10 );
+        }
+
+    }
+
+}
@@ -0,0 +1,74 @@
+#include "../../../src/thinger/utils/queue.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace utils {
+
+    TEST_CASE("Bounded queue", "[queue]") {
+
+        SECTION("Items come out in order") {
+            bounded_queue<int> q(4);
+            REQUIRE( q.push(1) );
+            REQUIRE( q.push(2) );
+            REQUIRE( q.size() == 2 );
+            REQUIRE( *q.pop() == 1 );
+            REQUIRE( *q.pop() == 2 );
+        }
+
+        SECTION("Closing refuses pushes and drains pops") {
+            bounded_queue<int> q(4);
+            REQUIRE( q.push(1) );
+            q.close();
+            REQUIRE( !q.push(2) );
+            REQUIRE( *q.pop() == 1 );
+            REQUIRE( !q.pop() );
+        }
+
+        SECTION("Producers wait while it is full") {
+            bounded_queue<int> q(2);
+            std::atomic<std::size_t> max_size = 0;
+            std::vector<int> popped;
+
+            std::thread consumer([&] {
+                while ( auto item = q.pop() ) {
+                    max_size = std::max(max_size.load(), q.size());
+                    popped.push_back(*item);
+                }
+            });
+
+            std::vector<std::thread> producers;
+            for (int p = 0; p < 3; p++) {
+                producers.emplace_back([&q, p] {
+                    for (int i = 0; i < 1000; i++) q.push(p * 1000 + i);
+                });
+            }
+            for (auto& t : producers) t.join();
+            q.close();
+            consumer.join();
+
+            REQUIRE( popped.size() == 3000 );
+            REQUIRE( max_size <= q.capacity() );
+
+            // each producer keeps its order
+            std::vector<int> last(3, -1);
+            for (auto item : popped) {
+                REQUIRE( item % 1000 > last[item / 1000] );
+                last[item / 1000] = item % 1000;
+            }
+        }
+
+        SECTION("Closing wakes up a blocked producer") {
+            bounded_queue<int> q(1);
+            REQUIRE( q.push(1) );
+            std::thread producer([&q] { REQUIRE( !q.push(2) ); });
+            q.close();
+            producer.join();
+        }
+
+    }
+
+}
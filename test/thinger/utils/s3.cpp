@@ -0,0 +1,265 @@
+#include <thinger/thinger.h>
+#include <httplib.h>
+
+#include "../../../src/thinger/utils/aws.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <array>
+#include <fstream>
+#include <map>
+
+// Local HTTP server standing in for the S3 multipart upload API, answering after a delay and
+// failing parts on demand. Parts and uploads are listed as S3 lists them.
+struct s3_stand_in {
+
+    httplib::Server svr;
+    std::thread thread;
+    int port;
+
+    std::chrono::milliseconds latency;
+    std::mutex mutex;
+    std::map<unsigned int, std::size_t> parts; // part number and size
+    std::map<unsigned int, unsigned int> failures; // part number and failures left
+    std::atomic<unsigned int> in_flight = 0;
+    std::atomic<unsigned int> max_in_flight = 0;
+    std::atomic<unsigned int> puts = 0;
+    std::string completed;
+    bool aborted = false;
+    std::vector<std::string> aborted_ids;
+    std::vector<std::array<std::string, 3>> uploads; // key, upload id and initiation time
+    std::string object; // served to GET and HEAD, by ranges
+    std::string object_etag;
+    unsigned int range_failures = 0; // ranged GETs failing before the next ones are served
+    std::atomic<unsigned int> ranges = 0;
+
+    explicit s3_stand_in(std::chrono::milliseconds delay = std::chrono::milliseconds{0}) : latency(delay) {
+        svr.Post(".*", [this](const httplib::Request& req, httplib::Response& res) {
+            std::this_thread::sleep_for(latency);
+            if ( req.has_param("uploads") ) {
+                res.set_content("<InitiateMultipartUploadResult><UploadId>stand-in</UploadId></InitiateMultipartUploadResult>", "application/xml");
+                return;
+            }
+            std::scoped_lock lock(mutex);
+            completed = req.body;
+            res.set_content("<CompleteMultipartUploadResult></CompleteMultipartUploadResult>", "application/xml");
+        });
+        svr.Put(".*", [this](const httplib::Request& req, httplib::Response& res) {
+            puts++;
+            max_in_flight = std::max(max_in_flight.load(), ++in_flight);
+            std::this_thread::sleep_for(latency);
+            in_flight--;
+            auto part = (unsigned int)std::stoul(req.get_param_value("partNumber"));
+            std::scoped_lock lock(mutex);
+            if ( failures[part] > 0 ) {
+                failures[part]--;
+                res.status = 503;
+                return;
+            }
+            parts[part] = req.body.size();
+            res.set_header("ETag", "\"etag-" + std::to_string(part) + "\"");
+        });
+        svr.Get(".*", [this](const httplib::Request& req, httplib::Response& res) {
+            std::scoped_lock lock(mutex);
+            std::string body;
+            if ( !req.has_param("uploads") && !req.has_param("uploadId") ) {
+                if ( !req.ranges.empty() ) {
+                    ranges++;
+                    if ( range_failures > 0 ) {
+                        range_failures--;
+                        res.status = 500;
+                        return;
+                    }
+                }
+                res.set_header("ETag", object_etag);
+                res.set_content(object, "application/x-compressed-tar");
+                return;
+            }
+            if ( req.has_param("uploads") ) {
+                body = "<ListMultipartUploadsResult><IsTruncated>false</IsTruncated>";
+                for (auto const& [key, id, initiated] : uploads)
+                    body += "<Upload><Key>" + key + "</Key><UploadId>" + id + "</UploadId><Initiated>" + initiated + "</Initiated></Upload>";
+                body += "</ListMultipartUploadsResult>";
+            } else {
+                body = "<ListPartsResult><IsTruncated>false</IsTruncated>";
+                for (auto const& [part, size] : parts)
+                    body += "<Part><PartNumber>" + std::to_string(part) + "</PartNumber><ETag>&quot;etag-" + std::to_string(part) +
+                            "&quot;</ETag><Size>" + std::to_string(size) + "</Size></Part>";
+                body += "</ListPartsResult>";
+            }
+            res.set_content(body, "application/xml");
+        });
+        svr.Delete(".*", [this](const httplib::Request& req, httplib::Response& res) {
+            std::scoped_lock lock(mutex);
+            aborted = true;
+            aborted_ids.push_back(req.get_param_value("uploadId"));
+            res.status = 204;
+        });
+        port = svr.bind_to_any_port("127.0.0.1");
+        thread = std::thread([this] { svr.listen_after_bind(); });
+        while ( !svr.is_running() )
+            std::this_thread::sleep_for(std::chrono::milliseconds{10});
+    }
+
+    ~s3_stand_in() {
+        svr.stop();
+        thread.join();
+    }
+
+    [[nodiscard]] std::string endpoint() const {
+        return "http://127.0.0.1:" + std::to_string(port);
+    }
+};
+
+TEST_CASE("S3 multipart upload", "[s3]") {
+
+    using namespace std::chrono_literals;
+
+    auto path = std::filesystem::temp_directory_path() / "thinger_monitor_s3_test.tar";
+    auto size = 3 * S3::MultipartUpload::part_size + 1000;
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        std::string block(1 << 20, 'x');
+        for (std::size_t written = 0; written < size; written += block.size())
+            file.write(block.data(), (std::streamsize)std::min(block.size(), size - written));
+    }
+
+    std::string bucket = "bucket";
+    std::string region = "us-east-1";
+    std::string access_key = "AKIDEXAMPLE";
+    std::string secret_key = "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY";
+
+    SECTION("Parts upload at once and complete in part order") {
+        s3_stand_in s3(20ms);
+        s3.failures[2] = 1;
+
+        S3::MultipartUpload mpu(bucket, region, access_key, secret_key, path.string(),
+                                {.concurrency = 4, .retries = 2, .backoff = 1ms, .endpoint = s3.endpoint()});
+        REQUIRE( mpu.upload() );
+
+        REQUIRE( s3.parts.size() == 4 );
+        REQUIRE( s3.parts[4] == 1000 );
+        REQUIRE( s3.max_in_flight > 1 );
+        REQUIRE( s3.max_in_flight <= 4 );
+        REQUIRE( !s3.aborted );
+
+        // the failed part was retried, and the etags are listed by part number
+        std::size_t position = 0;
+        for (unsigned int part = 1; part <= 4; part++) {
+            auto found = s3.completed.find("<PartNumber>" + std::to_string(part) + "</PartNumber>\n<ETag>\"etag-" + std::to_string(part) + "\"</ETag>", position);
+            REQUIRE( found != std::string::npos );
+            position = found;
+        }
+    }
+
+    SECTION("A part failing every attempt keeps the upload to resume it") {
+        s3_stand_in s3;
+        s3.failures[3] = 10;
+
+        S3::MultipartUpload mpu(bucket, region, access_key, secret_key, path.string(),
+                                {.concurrency = 2, .retries = 2, .backoff = 1ms, .endpoint = s3.endpoint()});
+        REQUIRE( !mpu.upload() );
+        REQUIRE( s3.failures[3] == 7 );
+        REQUIRE( !s3.aborted );
+        REQUIRE( s3.completed.empty() );
+
+        auto journal = S3::MultipartUpload::read_journal(path.string());
+        REQUIRE( journal );
+        REQUIRE( (*journal)["upload_id"] == "stand-in" );
+        REQUIRE( (*journal)["parts"].size() == s3.parts.size() );
+
+        // only the parts S3 does not have are sent again
+        auto uploaded = s3.parts.size();
+        s3.failures[3] = 0;
+        s3.puts = 0;
+        S3::MultipartUpload resumed(bucket, region, access_key, secret_key, path.string(),
+                                    {.concurrency = 2, .retries = 2, .backoff = 1ms, .endpoint = s3.endpoint()});
+        REQUIRE( resumed.upload() );
+        REQUIRE( s3.puts == 4 - uploaded );
+        REQUIRE( s3.parts.size() == 4 );
+        REQUIRE( !s3.aborted );
+        REQUIRE( s3.completed.find("<PartNumber>4</PartNumber>\n<ETag>\"etag-4\"</ETag>") != std::string::npos );
+        REQUIRE( !std::filesystem::exists(S3::MultipartUpload::journal_path(path.string())) );
+    }
+
+    SECTION("A changed file starts a new upload") {
+        s3_stand_in s3;
+        s3.failures[1] = 10;
+
+        S3::MultipartUpload mpu(bucket, region, access_key, secret_key, path.string(),
+                                {.concurrency = 1, .retries = 0, .backoff = 1ms, .endpoint = s3.endpoint()});
+        REQUIRE( !mpu.upload() );
+
+        std::ofstream(path, std::ios::binary | std::ios::app) << "more";
+        s3.failures[1] = 0;
+        S3::MultipartUpload restarted(bucket, region, access_key, secret_key, path.string(),
+                                      {.concurrency = 1, .retries = 0, .backoff = 1ms, .endpoint = s3.endpoint()});
+        REQUIRE( restarted.upload() );
+        REQUIRE( s3.aborted_ids == std::vector<std::string>{"stand-in"} );
+        REQUIRE( s3.parts[4] == 1004 );
+    }
+
+    std::filesystem::remove(S3::MultipartUpload::journal_path(path.string()));
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("S3 stale upload sweeper", "[s3]") {
+
+    using namespace std::chrono_literals;
+
+    s3_stand_in s3;
+    s3.uploads = {
+        {"monitor_a.tar", "stale", "2020-01-01T00:00:00.000Z"},
+        {"monitor_b.tar", "journaled", "2020-01-01T00:00:00.000Z"},
+        {"monitor_c.tar", "recent", "2999-01-01T00:00:00.000Z"},
+    };
+
+    S3::Connection connection("bucket", "us-east-1", "AKIDEXAMPLE", "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY", s3.endpoint());
+    REQUIRE( S3::sweep_uploads(connection, "monitor_", 24h, {"journaled"}) == 1 );
+    REQUIRE( s3.aborted_ids == std::vector<std::string>{"stale"} );
+}
+
+TEST_CASE("S3 ranged download", "[s3]") {
+
+    using namespace std::chrono_literals;
+
+    auto path = std::filesystem::temp_directory_path() / "thinger_monitor_s3_download.tar";
+
+    s3_stand_in s3;
+    s3.object.resize(2 * S3::Download::range_size + 1000);
+    for (std::size_t i = 0; i < s3.object.size(); i++) s3.object[i] = (char)(i % 251);
+
+    // ETag of an object uploaded in parts of the range size
+    Crypto::hash::md5 etag;
+    for (std::size_t first = 0; first < s3.object.size(); first += S3::Download::range_size) {
+        Crypto::hash::md5 part;
+        part.update(s3.object.data() + first, std::min(S3::Download::range_size, s3.object.size() - first));
+        auto digest = part.digest();
+        etag.update(digest.data(), digest.size());
+    }
+    s3.object_etag = "\"" + Crypto::to_hex(etag.digest()) + "-3\"";
+
+    SECTION("Ranges are fetched at once, retried on their own and verified") {
+        s3.range_failures = 1;
+
+        S3::Download download("bucket", "us-east-1", "AKIDEXAMPLE", "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY", path.string(),
+                              {.concurrency = 3, .retries = 2, .backoff = 1ms, .endpoint = s3.endpoint()});
+        REQUIRE( download.download() );
+        REQUIRE( s3.ranges == 4 );
+
+        std::ifstream file(path, std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        REQUIRE( content == s3.object );
+    }
+
+    SECTION("A mismatching ETag fails the download and removes the file") {
+        s3.object_etag = "\"00000000000000000000000000000000-3\"";
+
+        S3::Download download("bucket", "us-east-1", "AKIDEXAMPLE", "wJalrXUtnFEMI/K7MDENG+bPxRfiCYEXAMPLEKEY", path.string(),
+                              {.concurrency = 2, .retries = 0, .backoff = 1ms, .endpoint = s3.endpoint()});
+        REQUIRE( !download.download() );
+        REQUIRE( !std::filesystem::exists(path) );
+    }
+
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,169 @@
+#include <thinger/thinger.h>
+
+#include "../../../src/thinger/utils/tar.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace utils::tar {
+
+    TEST_CASE("Entries of unknown length", "[tar]") {
+
+        auto dir = std::filesystem::temp_directory_path() / "thinger_monitor_tar_test";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+        auto archive_path = (dir / "backup.tar").string();
+
+        std::string data;
+        for (int i = 0; i < 10000; i++)
+            data += std::to_string(i) + ",";
+
+        auto before = (dir / "before.txt").string();
+        std::ofstream(before) << "not part of the dump";
+
+        auto a = write::create_archive(archive_path);
+        write::add_entry(a, before);
+        write::parts dump(a, "dump.gz", 4096);
+        for (std::size_t i = 0; i < data.size(); i += 1000)
+            REQUIRE( dump.write(data.data() + i, std::min<std::size_t>(1000, data.size() - i)) );
+        REQUIRE( dump.close() );
+        REQUIRE( dump.size() == data.size() );
+        REQUIRE( dump.count() == (data.size() + 4095) / 4096 );
+        write::close_archive(a);
+
+        a = read::create_archive(archive_path);
+        auto files = read::list_files(a);
+        read::close_archive(a);
+        REQUIRE( files.size() == dump.count() + 1 );
+        REQUIRE( files[1] == "dump.gz.part0000" );
+        REQUIRE( files.back() == part_name("dump.gz", dump.count() - 1) );
+
+        a = read::create_archive(archive_path);
+        REQUIRE( read::extract_parts(a, "dump.gz", (dir / "dump.gz").string()) == dump.count() );
+        read::close_archive(a);
+
+        std::ifstream joined(dir / "dump.gz", std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(joined)), std::istreambuf_iterator<char>());
+        REQUIRE( content == data );
+
+        SECTION("A whole entry is marked after its parts") {
+            a = write::create_archive(archive_path);
+            write::parts whole(a, "whole.gz", 4096);
+            REQUIRE( whole.write(data.data(), 5000) );
+            REQUIRE( whole.close() );
+            REQUIRE( whole.complete() );
+            write::parts failed(a, "failed.gz", 4096);
+            REQUIRE( failed.write(data.data(), 5000) );
+            REQUIRE( failed.close() );
+            write::close_archive(a);
+
+            a = read::create_archive(archive_path);
+            files = read::list_files(a);
+            read::close_archive(a);
+            REQUIRE( files == std::vector<std::string>{"whole.gz.part0000", "whole.gz.part0001", complete_name("whole.gz"), "failed.gz.part0000", "failed.gz.part0001"} );
+
+            // the marker is not one of the parts
+            a = read::create_archive(archive_path);
+            REQUIRE( read::extract_parts(a, "whole.gz", (dir / "whole.gz").string()) == 2 );
+            read::close_archive(a);
+            REQUIRE( std::filesystem::file_size(dir / "whole.gz") == 5000 );
+        }
+
+        SECTION("An empty stream is a single empty part") {
+            a = write::create_archive(archive_path);
+            write::parts empty(a, "empty", 4096);
+            REQUIRE( empty.close() );
+            REQUIRE( empty.count() == 1 );
+            write::close_archive(a);
+
+            a = read::create_archive(archive_path);
+            REQUIRE( read::extract_parts(a, "empty", (dir / "empty").string()) == 1 );
+            read::close_archive(a);
+            REQUIRE( std::filesystem::file_size(dir / "empty") == 0 );
+        }
+
+        std::filesystem::remove_all(dir);
+    }
+
+    TEST_CASE("Entries of several producers", "[tar]") {
+
+        auto dir = std::filesystem::temp_directory_path() / "thinger_monitor_tar_serializer_test";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir / "data" / "users" / "a");
+        std::ofstream(dir / "data" / "users" / "a" / "user.json") << "{}";
+        auto archive_path = (dir / "backup.tar").string();
+
+        auto a = write::create_archive(archive_path);
+        {
+            write::serializer writer(a, 2);
+
+            std::thread files([&writer, &dir] {
+                auto users = (dir / "data" / "users").string();
+                writer.push([users](archive* a) { return write::add_directory(a, users, "users") >= 0; });
+            });
+
+            std::thread dump([&writer] {
+                write::parts parts("dump.gz", [&writer](std::string name, std::string data) {
+                    return writer.push([name = std::move(name), data = std::move(data)](archive* a) { return write::add_data(a, name, data); });
+                }, 16);
+                for (int i = 0; i < 100; i++) parts.write("0123456789", 10);
+                parts.close();
+            });
+
+            files.join();
+            dump.join();
+            REQUIRE( writer.close() );
+        }
+        write::close_archive(a);
+
+        a = read::create_archive(archive_path);
+        auto entries = read::list_files(a);
+        read::close_archive(a);
+        REQUIRE( std::find(entries.begin(), entries.end(), "users/a/user.json") != entries.end() );
+        REQUIRE( entries.size() == 2 + 63 );
+
+        a = read::create_archive(archive_path);
+        REQUIRE( read::extract_parts(a, "dump.gz", (dir / "dump.gz").string()) == 63 );
+        read::close_archive(a);
+        REQUIRE( std::filesystem::file_size(dir / "dump.gz") == 1000 );
+
+        SECTION("A failed job drops the rest") {
+            a = write::create_archive(archive_path);
+            write::serializer writer(a, 2);
+            REQUIRE( writer.push([](archive*) { return false; }) );
+            REQUIRE( !writer.close() );
+            REQUIRE( !writer.push([](archive*) { return true; }) );
+            write::close_archive(a);
+        }
+
+        std::filesystem::remove_all(dir);
+    }
+
+    TEST_CASE("Archive written to a sink", "[tar]") {
+
+        auto dir = std::filesystem::temp_directory_path() / "thinger_monitor_tar_sink_test";
+        std::filesystem::remove_all(dir);
+        std::filesystem::create_directories(dir);
+
+        std::string bytes;
+        auto a = write::create_archive([&bytes](const char* data, std::size_t length) {
+            bytes.append(data, length);
+            return true;
+        });
+        REQUIRE( write::add_data(a, "hello.txt", "hello") );
+        write::close_archive(a);
+
+        std::ofstream(dir / "sink.tar", std::ios::binary) << bytes;
+        a = read::create_archive((dir / "sink.tar").string());
+        REQUIRE( read::list_files(a) == std::vector<std::string>{"hello.txt"} );
+        read::close_archive(a);
+
+        SECTION("A failing sink fails the archive") {
+            a = write::create_archive([](const char*, std::size_t) { return false; });
+            write::add_data(a, "hello.txt", std::string(1 << 20, 'x'));
+            REQUIRE_THROWS_AS( write::close_archive(a), error );
+        }
+
+        std::filesystem::remove_all(dir);
+    }
+
+}
@@ -0,0 +1,51 @@
+#include "../../../src/thinger/utils/watch.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <atomic>
+#include <fstream>
+
+namespace utils::watch {
+
+    TEST_CASE("File watcher", "[watch]") {
+
+        using namespace std::chrono_literals;
+
+        auto directory = std::filesystem::temp_directory_path() / "thinger_watch_test";
+        std::filesystem::remove_all(directory);
+        std::filesystem::create_directories(directory);
+        auto path = directory / "thinger_monitor.json";
+        std::ofstream(path) << "{}";
+
+        std::atomic<int> changes{0};
+        {
+            file watcher(path, 100ms, [&changes] { changes++; });
+            REQUIRE( watcher.watching() );
+
+            SECTION("A burst of writes is a single change") {
+                for (int i = 0; i < 5; i++) {
+                    std::ofstream(path) << "{\"write\":" << i << "}";
+                    std::this_thread::sleep_for(10ms);
+                }
+                std::this_thread::sleep_for(400ms);
+                REQUIRE( changes == 1 );
+            }
+
+            SECTION("Replacing the file through a rename") {
+                std::ofstream(directory / "thinger_monitor.json.tmp") << "{\"renamed\":true}";
+                std::filesystem::rename(directory / "thinger_monitor.json.tmp", path);
+                std::this_thread::sleep_for(400ms);
+                REQUIRE( changes == 1 );
+            }
+
+            SECTION("Other files are ignored") {
+                std::ofstream(directory / "other.json") << "{}";
+                std::this_thread::sleep_for(400ms);
+                REQUIRE( changes == 0 );
+            }
+        }
+
+        std::filesystem::remove_all(directory);
+    }
+
+}
@@ -0,0 +1,24 @@
+#include "../../../src/thinger/utils/xml.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace XML {
+
+    TEST_CASE("XML elements", "[xml]") {
+
+        std::string xml = "<ListPartsResult><PartNumberMarker>0</PartNumberMarker>"
+                          "<Part><PartNumber>1</PartNumber><ETag>&quot;a&quot;</ETag></Part>\n"
+                          "<Part>\n<PartNumber>2</PartNumber>\n<ETag>&quot;b&quot;</ETag>\n</Part>"
+                          "<IsTruncated>false</IsTruncated></ListPartsResult>";
+
+        auto parts = get_elements(xml, "Part");
+        REQUIRE( parts.size() == 2 );
+        REQUIRE( get_elements(parts[0], "PartNumber") == std::vector<std::string>{"1"} );
+        REQUIRE( get_elements(parts[1], "ETag") == std::vector<std::string>{"&quot;b&quot;"} );
+        REQUIRE( get_elements(xml, "IsTruncated") == std::vector<std::string>{"false"} );
+        REQUIRE( get_elements(xml, "Missing").empty() );
+        REQUIRE( get_elements("<Part>unclosed", "Part").empty() );
+
+    }
+
+}